@@ -1,6 +1,10 @@
 #include "bs2pclib/bs2pclib.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -11,56 +15,416 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-static bool bs2pc_load_file(
-		std::filesystem::path const & path,
-		std::vector<char> & data,
-		bool const print_if_failed_to_open,
-		size_t const exact_size = SIZE_MAX) {
-	assert(exact_size == SIZE_MAX ||
-			(exact_size == std::streamoff(exact_size) && exact_size == std::streamsize(exact_size)));
-	std::ifstream stream(path, std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
-	if (!stream.is_open()) {
-		if (print_if_failed_to_open) {
-			std::cerr << "Failed to open " << path.string() << " for reading." << std::endl;
+#if defined(_WIN32)
+#define BS2PC_FILE_MAPPING_SUPPORTED 0
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BS2PC_FILE_MAPPING_SUPPORTED 1
+#endif
+
+// Read-only contents of a file, memory-mapped where supported to avoid copying, or read into memory otherwise.
+// The loaders in bs2pclib take a pointer and a size, so they can work with the mapping directly.
+// Note that the file must not be modified or truncated (such as by writing the output of the conversion to the same
+// path) while it's loaded.
+class bs2pc_file {
+public:
+	bs2pc_file() = default;
+	bs2pc_file(bs2pc_file const & other) = delete;
+	bs2pc_file & operator=(bs2pc_file const & other) = delete;
+	~bs2pc_file() { reset(); }
+
+	char const * data() const { return data_; }
+	size_t size() const { return size_; }
+
+	void reset() {
+#if BS2PC_FILE_MAPPING_SUPPORTED
+		if (mapping_) {
+			munmap(mapping_, size_);
+			mapping_ = nullptr;
+		}
+#endif
+		// Release the memory, not only clear, as files may be large.
+		std::vector<char>().swap(read_data_);
+		data_ = nullptr;
+		size_ = 0;
+	}
+
+	bool load(
+			std::filesystem::path const & path,
+			std::ostream & log,
+			bool const print_if_failed_to_open,
+			size_t const exact_size = SIZE_MAX) {
+		reset();
+#if BS2PC_FILE_MAPPING_SUPPORTED
+		int const file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0) {
+			if (print_if_failed_to_open) {
+				log << "Failed to open " << path.string() << " for reading." << std::endl;
+			}
+			return false;
+		}
+		struct stat file_status;
+		if (fstat(file, &file_status) || file_status.st_size < 0) {
+			log << "Failed to get the size of " << path.string() << "." << std::endl;
+			close(file);
+			return false;
+		}
+		if (!is_size_valid(path, uint64_t(file_status.st_size), log, exact_size)) {
+			close(file);
+			return false;
+		}
+		size_t const map_size = (exact_size != SIZE_MAX ? exact_size : size_t(file_status.st_size));
+		if (!map_size) {
+			// Empty mappings can't be created.
+			close(file);
+			return true;
+		}
+		void * const mapping = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+		if (mapping != MAP_FAILED) {
+			mapping_ = mapping;
+			data_ = reinterpret_cast<char const *>(mapping);
+			size_ = map_size;
+			return true;
+		}
+		// Some files (such as on certain special file systems) can't be mapped, read them instead.
+#endif
+		return read(path, log, print_if_failed_to_open, exact_size);
+	}
+
+private:
+	static bool is_size_valid(
+			std::filesystem::path const & path, uint64_t const size, std::ostream & log, size_t const exact_size) {
+		if (exact_size != SIZE_MAX && size < exact_size) {
+			log << path.string() << " is smaller than required (" << exact_size << ")." << std::endl;
+			return false;
+		}
+		if (size > UINT32_MAX) {
+			log << path.string() << " is too large, Half-Life uses 32-bit offsets and sizes." << std::endl;
+			return false;
+		}
+		if (size > SIZE_MAX || size > uint64_t(std::numeric_limits<std::streamsize>::max())) {
+			log << path.string() << " is too large." << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	bool read(
+			std::filesystem::path const & path,
+			std::ostream & log,
+			bool const print_if_failed_to_open,
+			size_t const exact_size) {
+		assert(exact_size == SIZE_MAX ||
+				(exact_size == std::streamoff(exact_size) && exact_size == std::streamsize(exact_size)));
+		std::ifstream stream(path, std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
+		if (!stream.is_open()) {
+			if (print_if_failed_to_open) {
+				log << "Failed to open " << path.string() << " for reading." << std::endl;
+			}
+			return false;
 		}
-		return false;
+		std::streamoff const size(stream.tellg());
+		if (size < 0) {
+			log << "Failed to get the size of " << path.string() << "." << std::endl;
+			return false;
+		}
+		if (!is_size_valid(path, uint64_t(size), log, exact_size)) {
+			return false;
+		}
+		stream.seekg(0, std::ios_base::beg);
+		if (!stream.good()) {
+			log << "Failed to seek to the beginning of " << path.string() << "." << std::endl;
+			return false;
+		}
+		size_t const read_size = (exact_size != SIZE_MAX ? exact_size : size_t(size));
+		read_data_.resize(read_size);
+		stream.read(read_data_.data(), std::streamsize(read_size));
+		if (!stream.good()) {
+			log << "Failed to read " << path.string() << "." << std::endl;
+			read_data_.clear();
+			return false;
+		}
+		data_ = read_data_.data();
+		size_ = read_size;
+		return true;
+	}
+
+#if BS2PC_FILE_MAPPING_SUPPORTED
+	void * mapping_ = nullptr;
+#endif
+	std::vector<char> read_data_;
+	char const * data_ = nullptr;
+	size_t size_ = 0;
+};
+
+// Wall time of the processing stages and statistics for a single input file, gathered for -profile.
+struct file_profile {
+	// Set by begin, and updated by end_stage to the end of the last recorded stage.
+	std::chrono::steady_clock::time_point start_time;
+	std::chrono::steady_clock::time_point stage_start_time;
+	uint64_t total_nanoseconds = 0;
+	// In the order of execution, each stage starting where the previous one has ended.
+	// The names are string literals.
+	std::vector<std::pair<char const *, uint64_t>> stage_nanoseconds;
+	bool succeeded = false;
+	uint64_t bytes_in = 0;
+	uint64_t bytes_out = 0;
+	// Textures converted to the PS2 format by resampling rather than reused from the WADG or an earlier conversion.
+	uint32_t textures_resampled = 0;
+	// Textures taken from the original PS2 conversions in the WADG.
+	uint32_t wadg_hits = 0;
+	// Textures from WADs reusing a conversion made for another map (or for another texture in the same map), or for an
+	// identical texture from another WAD or map.
+	uint32_t wad_texture_reuse_hits = 0;
+	// Textures embedded in maps reusing a conversion made for an identical texture in another map or WAD (or in the
+	// same map).
+	uint32_t texture_intern_hits = 0;
+	// Faces with polygons generated, and the total vertexes and strips in them.
+	uint32_t polygons = 0;
+	uint64_t polygon_vertexes = 0;
+	uint64_t polygon_strips = 0;
+
+	void begin() {
+		start_time = std::chrono::steady_clock::now();
+		stage_start_time = start_time;
+	}
+
+	// Records the time since the end of the previous stage (or since begin) as the time of the specified stage.
+	void end_stage(char const * const name) {
+		std::chrono::steady_clock::time_point const stage_end_time = std::chrono::steady_clock::now();
+		stage_nanoseconds.emplace_back(
+				name,
+				uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+						stage_end_time - stage_start_time).count()));
+		stage_start_time = stage_end_time;
 	}
-	std::streamoff const size(stream.tellg());
-	if (size < 0) {
-		std::cerr << "Failed to get the size of " << path.string() << "." << std::endl;
-		return false;
+
+	void end() {
+		total_nanoseconds = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start_time).count());
 	}
-	if (exact_size != SIZE_MAX && size < exact_size) {
-		std::cerr << path.string() << " is smaller than required (" << exact_size << ")." << std::endl;
-		return false;
+};
+
+static void write_json_string(std::ostream & output, std::string_view const string) {
+	static char const hex_digits[] = "0123456789abcdef";
+	output << '"';
+	for (char const character : string) {
+		switch (character) {
+			case '"':
+				output << "\\\"";
+				break;
+			case '\\':
+				output << "\\\\";
+				break;
+			default:
+				if (uint8_t(character) < 0x20) {
+					output << "\\u00" << hex_digits[uint8_t(character) >> 4] << hex_digits[uint8_t(character) & 0xF];
+				} else {
+					output << character;
+				}
+				break;
+		}
 	}
-	if (size > UINT32_MAX) {
-		std::cerr << path.string() << " is too large, Half-Life uses 32-bit offsets and sizes." << std::endl;
-		return false;
+	output << '"';
+}
+
+static void write_profile_json_counters(std::ostream & output, file_profile const & profile) {
+	output <<
+			"\"bytes_in\": " << profile.bytes_in << ", " <<
+			"\"bytes_out\": " << profile.bytes_out << ", " <<
+			"\"textures_resampled\": " << profile.textures_resampled << ", " <<
+			"\"wadg_hits\": " << profile.wadg_hits << ", " <<
+			"\"wad_texture_reuse_hits\": " << profile.wad_texture_reuse_hits << ", " <<
+			"\"texture_intern_hits\": " << profile.texture_intern_hits << ", " <<
+			"\"polygons\": " << profile.polygons << ", " <<
+			"\"polygon_vertexes\": " << profile.polygon_vertexes << ", " <<
+			"\"polygon_strips\": " << profile.polygon_strips;
+}
+
+// The file profiles must be in the order of the input paths.
+static void write_profile_json(
+		std::ostream & output,
+		uint64_t const total_nanoseconds,
+		size_t const job_count, size_t const compress_thread_count, size_t const polygon_thread_count,
+		std::vector<std::filesystem::path> const & input_paths, std::vector<file_profile> const & file_profiles) {
+	// Totals for all the files, with the stages summed by name in the order they first appear.
+	file_profile total_profile;
+	for (file_profile const & profile : file_profiles) {
+		total_profile.bytes_in += profile.bytes_in;
+		total_profile.bytes_out += profile.bytes_out;
+		total_profile.textures_resampled += profile.textures_resampled;
+		total_profile.wadg_hits += profile.wadg_hits;
+		total_profile.wad_texture_reuse_hits += profile.wad_texture_reuse_hits;
+		total_profile.texture_intern_hits += profile.texture_intern_hits;
+		total_profile.polygons += profile.polygons;
+		total_profile.polygon_vertexes += profile.polygon_vertexes;
+		total_profile.polygon_strips += profile.polygon_strips;
+		for (std::pair<char const *, uint64_t> const & stage : profile.stage_nanoseconds) {
+			auto const total_stage_iterator = std::find_if(
+					total_profile.stage_nanoseconds.begin(), total_profile.stage_nanoseconds.end(),
+					[&stage](std::pair<char const *, uint64_t> const & total_stage) {
+						return !std::strcmp(total_stage.first, stage.first);
+					});
+			if (total_stage_iterator != total_profile.stage_nanoseconds.end()) {
+				total_stage_iterator->second += stage.second;
+			} else {
+				total_profile.stage_nanoseconds.push_back(stage);
+			}
+		}
 	}
-	if (size > SIZE_MAX || size > std::numeric_limits<std::streamsize>::max()) {
-		std::cerr << path.string() << " is too large." << std::endl;
-		return false;
+
+	output << "{\n";
+	output << "\t\"format\": \"bs2pc_profile\",\n";
+	output << "\t\"format_version\": 1,\n";
+	output << "\t\"jobs\": " << job_count << ",\n";
+	output << "\t\"compress_jobs\": " << compress_thread_count << ",\n";
+	output << "\t\"polygon_jobs\": " << polygon_thread_count << ",\n";
+	output << "\t\"total_ns\": " << total_nanoseconds << ",\n";
+	output << "\t\"totals\": {";
+	write_profile_json_counters(output, total_profile);
+	output << ", \"stages\": {";
+	for (size_t stage_number = 0; stage_number < total_profile.stage_nanoseconds.size(); ++stage_number) {
+		std::pair<char const *, uint64_t> const & stage = total_profile.stage_nanoseconds[stage_number];
+		output << (stage_number ? ", \"" : "\"") << stage.first << "\": " << stage.second;
 	}
-	stream.seekg(0, std::ios_base::beg);
-	if (!stream.good()) {
-		std::cerr << "Failed to seek to the beginning of " << path.string() << "." << std::endl;
-		return false;
+	output << "}},\n";
+	output << "\t\"files\": [";
+	for (size_t file_number = 0; file_number < file_profiles.size(); ++file_number) {
+		file_profile const & profile = file_profiles[file_number];
+		output << (file_number ? ",\n" : "\n") << "\t\t{\"path\": ";
+		write_json_string(output, input_paths[file_number].string());
+		output << ", \"succeeded\": " << (profile.succeeded ? "true" : "false") <<
+				", \"total_ns\": " << profile.total_nanoseconds << ", ";
+		write_profile_json_counters(output, profile);
+		output << ", \"stages\": [";
+		for (size_t stage_number = 0; stage_number < profile.stage_nanoseconds.size(); ++stage_number) {
+			std::pair<char const *, uint64_t> const & stage = profile.stage_nanoseconds[stage_number];
+			output << (stage_number ? ", " : "") <<
+					"{\"name\": \"" << stage.first << "\", \"ns\": " << stage.second << "}";
+		}
+		output << "]}";
 	}
-	size_t const read_size = (exact_size != SIZE_MAX ? exact_size : size_t(size));
-	data.resize(read_size);
-	stream.read(data.data(), std::streamsize(read_size));
-	if (!stream.good()) {
-		std::cerr << "Failed to read " << path.string() << "." << std::endl;
-		return false;
+	output << "\n\t]\n";
+	output << "}\n";
+}
+
+// The hash of the contents of a file as recorded in the manifest, or "-" if the file can't be loaded, so the outputs
+// depending on a file that was searched for, but not found, are rebuilt when the file appears.
+static std::string get_manifest_file_hash(std::filesystem::path const & path) {
+	bs2pc_file file;
+	std::ostringstream load_log;
+	if (!file.load(path, load_log, false)) {
+		return "-";
+	}
+	bs2pc::sha256 hash;
+	hash.update(file.data(), file.size());
+	return bs2pc::sha256_digest_string(hash.finish());
+}
+
+// An output recorded in the -manifest file, which is keyed by the input path.
+struct manifest_entry {
+	std::string input_hash;
+	// The hash of all the options affecting the output, including the Quake palette.
+	std::string options_hash;
+	std::string output_path;
+	// The size is compared before hashing the output, which is more expensive.
+	uint64_t output_size = 0;
+	std::string output_hash;
+	// The paths and the hashes of the files other than the input that the output depends on, such as the WADs
+	// (including the paths where they were searched for, but not found) and the WADG.
+	std::vector<std::pair<std::string, std::string>> dependencies;
+};
+
+// Must be changed whenever the format of the manifest is changed.
+// After the header line, each line is an entry, with the input path, the input hash, the options hash, the output path,
+// the output size, the output hash, and the path and the hash of each dependency, separated by tabs.
+static char const manifest_header[] = "bs2pc_manifest 2";
+
+// A missing or an incompatible manifest is treated as empty, so all the outputs are rebuilt.
+static void load_manifest(std::filesystem::path const & path, std::map<std::string, manifest_entry> & entries) {
+	std::ifstream stream(path, std::ios_base::binary | std::ios_base::in);
+	if (!stream.is_open()) {
+		return;
+	}
+	std::string line;
+	std::vector<std::string> fields;
+	auto const get_line = [&stream, &line]() -> bool {
+		if (!std::getline(stream, line)) {
+			return false;
+		}
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		return true;
+	};
+	if (!get_line() || line != manifest_header) {
+		return;
+	}
+	while (get_line()) {
+		fields.clear();
+		size_t field_start = 0;
+		while (true) {
+			size_t const field_end = line.find('\t', field_start);
+			fields.emplace_back(line, field_start, field_end - field_start);
+			if (field_end == std::string::npos) {
+				break;
+			}
+			field_start = field_end + 1;
+		}
+		if (fields.size() < 6 || ((fields.size() - 6) & 1)) {
+			continue;
+		}
+		manifest_entry entry;
+		entry.input_hash = std::move(fields[1]);
+		entry.options_hash = std::move(fields[2]);
+		entry.output_path = std::move(fields[3]);
+		entry.output_size = uint64_t(std::strtoull(fields[4].c_str(), nullptr, 10));
+		entry.output_hash = std::move(fields[5]);
+		for (size_t field_number = 6; field_number < fields.size(); field_number += 2) {
+			entry.dependencies.emplace_back(std::move(fields[field_number]), std::move(fields[field_number + 1]));
+		}
+		entries[std::move(fields[0])] = std::move(entry);
+	}
+}
+
+static void write_manifest(std::ostream & output, std::map<std::string, manifest_entry> const & entries) {
+	auto const is_field_valid = [](std::string const & field) {
+		return field.find_first_of("\t\n\r") == std::string::npos;
+	};
+	output << manifest_header << '\n';
+	for (std::pair<std::string const, manifest_entry> const & entry_pair : entries) {
+		manifest_entry const & entry = entry_pair.second;
+		// Paths containing the separators can't be stored, such outputs will just be rebuilt every time.
+		if (!is_field_valid(entry_pair.first) ||
+				!is_field_valid(entry.output_path) ||
+				std::any_of(
+						entry.dependencies.cbegin(), entry.dependencies.cend(),
+						[&is_field_valid](std::pair<std::string, std::string> const & dependency) {
+							return !is_field_valid(dependency.first);
+						})) {
+			continue;
+		}
+		output << entry_pair.first << '\t' << entry.input_hash << '\t' << entry.options_hash << '\t' <<
+				entry.output_path << '\t' << entry.output_size << '\t' << entry.output_hash;
+		for (std::pair<std::string, std::string> const & dependency : entry.dependencies) {
+			output << '\t' << dependency.first << '\t' << dependency.second;
+		}
+		output << '\n';
 	}
-	return true;
 }
 
 int main(int const argument_count, char const * const * const arguments) {
@@ -100,6 +464,17 @@ int main(int const argument_count, char const * const * const arguments) {
 
 	uint32_t extract_gbx_texture_mip = 0;
 
+	std::filesystem::path texture_cache_path;
+
+	std::filesystem::path manifest_path;
+
+	std::filesystem::path profile_path;
+
+	// 0 means the number of hardware threads.
+	size_t job_count = 1;
+	size_t compress_thread_count = 1;
+	size_t polygon_thread_count = 1;
+
 	std::filesystem::path argument_output_path;
 
 	std::vector<std::filesystem::path> input_paths;
@@ -109,7 +484,13 @@ int main(int const argument_count, char const * const * const arguments) {
 		convert_mode,
 		output,
 		extract_gbx_texture_mip,
+		compress_thread_count,
+		job_count,
+		manifest_path,
+		polygon_thread_count,
+		profile_path,
 		quake_palette_path,
+		texture_cache_path,
 		wad_search_path,
 		wadg_path,
 	};
@@ -126,10 +507,22 @@ int main(int const argument_count, char const * const * const arguments) {
 					next_argument_type = argument_type::output;
 				} else if (!std::strcmp(option, "extractps2texturemip")) {
 					next_argument_type = argument_type::extract_gbx_texture_mip;
+				} else if (!std::strcmp(option, "compressjobs")) {
+					next_argument_type = argument_type::compress_thread_count;
+				} else if (!std::strcmp(option, "jobs")) {
+					next_argument_type = argument_type::job_count;
+				} else if (!std::strcmp(option, "manifest")) {
+					next_argument_type = argument_type::manifest_path;
+				} else if (!std::strcmp(option, "polygonjobs")) {
+					next_argument_type = argument_type::polygon_thread_count;
+				} else if (!std::strcmp(option, "profile")) {
+					next_argument_type = argument_type::profile_path;
 				} else if (!std::strcmp(option, "ps2texturefile")) {
 					next_argument_type = argument_type::wadg_path;
 				} else if (!std::strcmp(option, "quakepalette")) {
 					next_argument_type = argument_type::quake_palette_path;
+				} else if (!std::strcmp(option, "texturecache")) {
+					next_argument_type = argument_type::texture_cache_path;
 				} else if (!std::strcmp(option, "waddir")) {
 					next_argument_type = argument_type::wad_search_path;
 				} else if (!std::strcmp(option, "includealltextures")) {
@@ -183,9 +576,27 @@ int main(int const argument_count, char const * const * const arguments) {
 				case argument_type::extract_gbx_texture_mip:
 					extract_gbx_texture_mip = uint32_t(std::strtoul(argument, nullptr, 0));
 					break;
+				case argument_type::compress_thread_count:
+					compress_thread_count = size_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::job_count:
+					job_count = size_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::manifest_path:
+					manifest_path = argument;
+					break;
+				case argument_type::polygon_thread_count:
+					polygon_thread_count = size_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::profile_path:
+					profile_path = argument;
+					break;
 				case argument_type::quake_palette_path:
 					quake_palette_path = argument;
 					break;
+				case argument_type::texture_cache_path:
+					texture_cache_path = argument;
+					break;
 				case argument_type::wad_search_path:
 					wad_search_paths.emplace_back(argument);
 					break;
@@ -257,12 +668,23 @@ int main(int const argument_count, char const * const * const arguments) {
 				"changed to the target one.\n"
 				"  For creation of a file with the original PS2 texture data, this is the destination file path.\n"
 				"  For extraction of texture images from PS2 maps, this is the destination directory path.\n"
+				" -compressjobs thread_count\n"
+				"  When compressing PS2 maps, split each map into blocks compressed on the specified number of "
+				"threads, or on as many threads as supported by the hardware if 0.\n"
+				"  The resulting files are different from single-threaded compression, but the same for any "
+				"number of threads above 1.\n"
 				" -extractps2texturemip mip_level\n"
 				"  For extraction of texture images from PS2 maps, the mip level to extract.\n"
 				"  0 is the base level (full resolution).\n"
 				" -includealltextures\n"
 				"  When converting PS2 maps to the PC, include the pixels of all textures directly in the resulting "
 				"map file regardless of whether they were found in a WAD file.\n"
+				" -jobs job_count\n"
+				"  Process the input files on the specified number of threads, or on as many threads as supported by "
+				"the hardware if 0.\n"
+				"  The resulting files are the same as when processing the input files one by one, and the messages "
+				"for each input file are printed together in the order of the input files.\n"
+				"  With more than one job, the input files must not be the outputs of other input files.\n"
 				" -keepnodraw\n"
 				"  When converting PS2 maps to the PC, don't remove NODRAW-textured surfaces (with a crossed circle "
 				"symbol) that are not visible in the PS2 version, but displayed by the PC engine.\n"
@@ -275,6 +697,12 @@ int main(int const argument_count, char const * const * const arguments) {
 				"supported by released version of the engine, present only on two maps, with the rest of random-tiled "
 				"textures having the minus prefix removed and stored as normal.\n"
 				"  Note that the PS2 version doesn't support randomized tiling, only the PC software renderer does.\n"
+				" -manifest manifest_file_path\n"
+				"  When converting, compressing or decompressing maps, or writing subdivided polygon .obj files, "
+				"record the hashes of the input file, of the WAD files and the original PS2 texture conversions file "
+				"consulted for it, and of the options (including the Quake palette) in the specified file for each "
+				"output, and skip the input files with the output still up to date in later runs.\n"
+				"  Changes in BS2PC itself are not tracked, so the file should be deleted after updating BS2PC.\n"
 				" -nocompress\n"
 				"  When converting PC maps to the PS2, don't compress the resulting maps.\n"
 				"  This feature is purely for debugging BS2PC itself, as the engine is only able to load compressed "
@@ -288,6 +716,16 @@ int main(int const argument_count, char const * const * const arguments) {
 				"  When converting PS2 maps to the PC, don't try to reconstruct randomized tiling of textures on the "
 				"software renderer by adding the minus prefix and searching for all textures in the sets in the WADs, "
 				"instead always displaying the specific tile selected by Gearbox.\n"
+				" -polygonjobs thread_count\n"
+				"  When converting PC maps to the PS2, generate the subdivided polygons of the faces of each map on "
+				"the specified number of threads, or on as many threads as supported by the hardware if 0.\n"
+				"  The resulting files are the same for any number of threads.\n"
+				" -profile json_file_path\n"
+				"  Write the wall time of each processing stage for each input file, and counters such as the number "
+				"of resampled textures, textures reused from the original PS2 conversions file and from earlier "
+				"conversions of WAD textures and of identical textures embedded in other maps, generated polygons and "
+				"input and output bytes, to the specified JSON file.\n"
+				"  The timings of multiple input files processed at the same time with -jobs overlap.\n"
 				" -ps2texturefile bs2pcwad_file_path\n"
 				"  When converting PC maps to the PS2, use the specified path to the file generated using `-mode "
 				"createps2texturefile` instead of hlps2.bs2pcwad from the working directory to load the original PS2 "
@@ -311,6 +749,11 @@ int main(int const argument_count, char const * const * const arguments) {
 				"the input files to be overwritten, it's important to use the -o option to specify a different output "
 				"path if needed.\n"
 				"  Ignored if -v29asv30 is specified.\n"
+				" -texturecache directory_path\n"
+				"  Store the results of texture resampling and mip generation in the specified directory, and reuse "
+				"them when converting the same textures again in later runs.\n"
+				"  The files are named by a hash of everything the conversion depends on, so the directory can be "
+				"shared between different maps, WADs and options.\n"
 				" -v29asv30\n"
 				"  Treat PC version 29 maps as Half-Life maps with colored lighting and local texture palettes, not as "
 				"Quake maps.\n"
@@ -368,34 +811,145 @@ int main(int const argument_count, char const * const * const arguments) {
 
 	bs2pc::palette_set quake_palette(bs2pc::quake_default_palette);
 	if (!quake_palette_path.empty()) {
-		std::vector<char> quake_override_palette;
-		if (bs2pc_load_file(quake_palette_path, quake_override_palette, true, 3 * 256)) {
+		bs2pc_file quake_override_palette;
+		if (quake_override_palette.load(quake_palette_path, std::cerr, true, 3 * 256)) {
 			quake_palette = bs2pc::palette_set(reinterpret_cast<uint8_t const *>(quake_override_palette.data()));
 		} else {
 			any_errors = true;
 		}
 	}
 
+	std::optional<bs2pc::texture_pixels_cache> texture_pixels_cache;
+	if (!texture_cache_path.empty()) {
+		std::error_code texture_cache_directory_error;
+		std::filesystem::create_directories(texture_cache_path, texture_cache_directory_error);
+		if (std::filesystem::is_directory(texture_cache_path)) {
+			texture_pixels_cache.emplace(texture_cache_path);
+		} else {
+			std::cerr << "Failed to create the texture cache directory " << texture_cache_path.string() <<
+					", textures will not be cached." << std::endl;
+		}
+	}
+	bs2pc::texture_pixels_cache const * const texture_pixels_cache_pointer =
+			texture_pixels_cache ? &*texture_pixels_cache : nullptr;
+
+	// Analyses of the palettes of the textures converted in this run, mostly for reusing the one of the Quake palette.
+	bs2pc::texture_palette_analysis_cache texture_palette_analysis_cache;
+
+	std::chrono::steady_clock::time_point const conversion_start_time = std::chrono::steady_clock::now();
+
 	// Convert.
 	// Note that the output file may be the same as the input file, so all input files must be loaded fully before
 	// converting.
 
+	if (!job_count) {
+		job_count = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+	}
+	job_count = std::min(job_count, input_paths.size());
+	if (!compress_thread_count) {
+		compress_thread_count = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+	}
+	if (!polygon_thread_count) {
+		polygon_thread_count = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+	}
+
+	// For -manifest, the entries from the previous runs, not modified until all the input files have been processed.
+	// The textures gathered for WADG creation and texture extraction are written for all the input files at once, so
+	// they can't be skipped.
+	bool const use_manifest = !manifest_path.empty() &&
+			argument_convert_mode != convert_mode::create_gbx_texture_wadg &&
+			argument_convert_mode != convert_mode::extract_gbx_textures;
+	std::map<std::string, manifest_entry> manifest_entries;
+	std::string manifest_options_hash;
+	if (use_manifest) {
+		load_manifest(manifest_path, manifest_entries);
+		// The WAD search paths and the WADG path are included because the dependencies are recorded as paths.
+		// Multithreaded compression produces different files than single-threaded.
+		std::ostringstream options_stream;
+		options_stream <<
+				int(argument_convert_mode) << ' ' <<
+				deserialize_quake_maps_as_valve << convert_quake_maps_to_valve_id << subdivide_quake_turbulent <<
+				compress << keep_nodraw << include_all_textures << do_reconstruct_random_texture_sequences <<
+				keep_random_prefix << (compress_thread_count > 1) << '\n' <<
+				argument_output_path.string() << '\n' << argument_output_path_is_directory << '\n' <<
+				wadg_path.string() << '\n';
+		for (std::filesystem::path const & wad_search_path : wad_search_paths) {
+			options_stream << wad_search_path.string() << '\n';
+		}
+		std::string const options_string = options_stream.str();
+		bs2pc::sha256 options_hash;
+		options_hash.update(options_string.data(), options_string.size());
+		options_hash.update(quake_palette.id.data(), quake_palette.id.size());
+		manifest_options_hash = bs2pc::sha256_digest_string(options_hash.finish());
+	}
+
+	// Buffers and maps used for processing a single input file, reused between the files processed by one job.
+	// The input file and the decompressed data are shared with the maps, that reference the large lumps in them instead
+	// of copying.
+	struct file_state {
+		std::shared_ptr<bs2pc_file> input_file;
+		std::shared_ptr<std::vector<char>> input_decompressed_data = std::make_shared<std::vector<char>>();
+		std::vector<char> output_data;
+		bs2pc::id_map map_id;
+		bs2pc::gbx_map map_gbx;
+		std::vector<std::string> map_wad_names;
+		std::vector<bs2pc::wad_textures_deserialized *> map_wads;
+		std::vector<std::pair<size_t, bool>> map_wad_name_numbers_and_used;
+		std::vector<std::string> map_wad_names_used;
+		// For -manifest, the files other than the input file consulted for the output, and the path of the output.
+		std::vector<std::filesystem::path> manifest_dependencies;
+		std::filesystem::path output_path;
+	};
+
+	// The outcome of processing a single input file, handled in the order of the input files regardless of the order
+	// in which the jobs have finished processing them.
+	struct file_result {
+		// Messages if not written directly to the standard error stream.
+		std::string log;
+		bool succeeded = false;
+		// For WADG creation and texture extraction, the textures from the map, to be gathered in the order of the
+		// input files.
+		std::vector<bs2pc::gbx_texture_deserialized> gbx_textures;
+		file_profile profile;
+		// For -manifest, the entry to record for the input file if it has been processed successfully or is up to date.
+		std::optional<manifest_entry> manifest;
+	};
+
+	// The WADs are shared between the jobs.
 	// The key is bs2pc::string_to_lower(WAD name).
-	std::unordered_map<std::string, std::optional<bs2pc::wad_textures_deserialized>> loaded_wads;
-	std::vector<std::string> map_wad_names;
-	std::vector<bs2pc::wad_textures_deserialized *> map_wads;
-	std::vector<std::pair<size_t, bool>> map_wad_name_numbers_and_used;
-	auto const load_map_wads = [&]() {
-		map_wad_name_numbers_and_used.clear();
-		map_wads.clear();
-		for (size_t map_wad_name_number = 0; map_wad_name_number < map_wad_names.size(); ++map_wad_name_number) {
-			std::string const & wad_name = map_wad_names[map_wad_name_number];
+	// The textures are decoded from the WAD files when they're needed, so the files stay loaded too.
+	// nullptr if not found.
+	struct loaded_wad {
+		std::filesystem::path path;
+		bs2pc_file file;
+		bs2pc::wad_textures_deserialized textures;
+	};
+	std::unordered_map<std::string, std::unique_ptr<loaded_wad>> loaded_wads;
+	std::mutex loaded_wads_mutex;
+	auto const load_map_wads = [&](file_state & state, std::ostream & log) {
+		state.map_wad_name_numbers_and_used.clear();
+		state.map_wads.clear();
+		// Loading under the lock so jobs needing the same WAD don't load it multiple times.
+		// Once loaded, WADs are never removed, so pointers to them stay valid after the lock is released.
+		std::lock_guard<std::mutex> const loaded_wads_lock(loaded_wads_mutex);
+		for (size_t map_wad_name_number = 0;
+				map_wad_name_number < state.map_wad_names.size();
+				++map_wad_name_number) {
+			std::string const & wad_name = state.map_wad_names[map_wad_name_number];
 			std::string const wad_name_lower = bs2pc::string_to_lower(wad_name);
 			auto const loaded_wad_iterator = loaded_wads.find(wad_name_lower);
 			if (loaded_wad_iterator != loaded_wads.cend()) {
-				if (loaded_wad_iterator->second.has_value()) {
-					map_wads.emplace_back(&loaded_wad_iterator->second.value());
-					map_wad_name_numbers_and_used.emplace_back(map_wad_name_number, false);
+				// The same paths as when the WAD was loaded have been consulted.
+				for (std::filesystem::path const & wad_search_path : wad_search_paths) {
+					state.manifest_dependencies.push_back(wad_search_path / wad_name);
+					if (loaded_wad_iterator->second &&
+							state.manifest_dependencies.back() == loaded_wad_iterator->second->path) {
+						break;
+					}
+				}
+				if (loaded_wad_iterator->second) {
+					state.map_wads.emplace_back(&loaded_wad_iterator->second->textures);
+					state.map_wad_name_numbers_and_used.emplace_back(map_wad_name_number, false);
 				}
 				continue;
 			}
@@ -403,34 +957,76 @@ int main(int const argument_count, char const * const * const arguments) {
 			for (std::filesystem::path const & wad_search_path : wad_search_paths) {
 				// Use the original case from worldspawn if the file system is case-sensitive.
 				std::filesystem::path wad_path = wad_search_path / wad_name;
-				std::vector<char> wad_file_data;
-				if (!bs2pc_load_file(wad_path, wad_file_data, false)) {
+				state.manifest_dependencies.push_back(wad_path);
+				std::unique_ptr<loaded_wad> wad = std::make_unique<loaded_wad>();
+				wad->path = wad_path;
+				if (!wad->file.load(wad_path, log, false)) {
 					continue;
 				}
-				bs2pc::wad_textures_deserialized wad;
-				char const * const wad_deserialize_error =
-						bs2pc::get_wad_textures(wad_file_data.data(), wad_file_data.size(), wad, quake_palette.id);
+				char const * const wad_deserialize_error = bs2pc::get_wad_textures(
+						wad->file.data(), wad->file.size(), wad->textures, quake_palette.id);
 				if (wad_deserialize_error) {
-					std::cerr << "Failed to deserialize " << wad_path.string() << ": " << wad_deserialize_error <<
-							'.' << std::endl;
+					log << "Failed to deserialize " << wad_path.string() << ": " << wad_deserialize_error << '.' <<
+							std::endl;
 					continue;
 				}
-				map_wads.emplace_back(&loaded_wads.emplace(wad_name_lower, std::move(wad)).first->second.value());
-				map_wad_name_numbers_and_used.emplace_back(map_wad_name_number, false);
+				state.map_wads.emplace_back(&wad->textures);
+				loaded_wads.emplace(wad_name_lower, std::move(wad));
+				state.map_wad_name_numbers_and_used.emplace_back(map_wad_name_number, false);
 				wad_loaded = true;
 				break;
 			}
 			if (wad_loaded) {
 				continue;
 			}
-			std::cerr <<
+			log <<
 					"WAD file " << wad_name << " not loaded from any search directory specified via -waddir.\n"
 					"This is fine in some cases (gbx1.wad and hlps2.wad in PS2 Half-Life, sample.wad in PC Half-Life, "
 					"Quake), but other WADs not being found may indicate that the -waddir arguments are not set up "
 					"correctly." << std::endl;
 			// Don't search for the WAD again.
-			loaded_wads.emplace(wad_name_lower, std::nullopt);
+			loaded_wads.emplace(wad_name_lower, nullptr);
+		}
+	};
+
+	// Conversions of textures from id to Gearbox shared between all the maps, so identical textures embedded in
+	// multiple maps or present in multiple WADs are converted and stored only once.
+	bs2pc::gbx_texture_intern_table gbx_texture_intern_table;
+
+	// Conversions of WAD textures for id to Gearbox conversion are cached in the loaded WADs to be reused between the
+	// maps, and they may be done by multiple jobs at once.
+	// Returns whether the pixels converted earlier have been reused.
+	std::mutex wad_texture_conversions_mutex;
+	auto const gbx_pixels_and_palette_from_wad = [&](
+			bs2pc::gbx_texture_deserialized & texture_gbx, bs2pc::wad_texture_deserialized & wad_texture) {
+		// Convert a copy outside the lock as conversion is expensive, and then store the conversion results unless
+		// another job has already done that (in this case, the conversion results are the same, so either can be used).
+		bs2pc::wad_texture_deserialized wad_texture_converted;
+		{
+			std::lock_guard<std::mutex> const wad_texture_conversions_lock(wad_texture_conversions_mutex);
+			wad_texture_converted = wad_texture;
+		}
+		bool const pixels_reused = texture_gbx.pixels_and_palette_from_wad(
+				wad_texture_converted, quake_palette.id, texture_pixels_cache_pointer, &gbx_texture_intern_table,
+				&texture_palette_analysis_cache);
+		{
+			std::lock_guard<std::mutex> const wad_texture_conversions_lock(wad_texture_conversions_mutex);
+			if (!wad_texture.default_scaled_size_pixels_gbx) {
+				wad_texture.default_scaled_size_pixels_gbx =
+						std::move(wad_texture_converted.default_scaled_size_pixels_gbx);
+			}
+			if (!wad_texture.default_scaled_size_pixels_random_gbx) {
+				wad_texture.default_scaled_size_pixels_random_gbx =
+						std::move(wad_texture_converted.default_scaled_size_pixels_random_gbx);
+			}
+			for (size_t palette_type = 0; palette_type < bs2pc::gbx_palette_type_count; ++palette_type) {
+				if (!wad_texture.palettes_id_indexed_gbx[palette_type]) {
+					wad_texture.palettes_id_indexed_gbx[palette_type] =
+							std::move(wad_texture_converted.palettes_id_indexed_gbx[palette_type]);
+				}
+			}
 		}
+		return pixels_reused;
 	};
 
 	// For WADG creation and texture extraction, the textures gathered from the maps.
@@ -439,114 +1035,186 @@ int main(int const argument_count, char const * const * const arguments) {
 	if (argument_convert_mode == convert_mode::create_gbx_texture_wadg && !overwrite_wadg) {
 		// Load the existing WADG to append new textures to it so the command can be executed multiple times (it may
 		// become too long on some operating systems especially with paths that include directories).
-		std::vector<char> wadg_file;
-		if (bs2pc_load_file(wadg_path, wadg_file, false)) {
+		bs2pc_file wadg_file;
+		if (wadg_file.load(wadg_path, std::cerr, false)) {
 			bs2pc::add_wadg_textures(wadg_file.data(), wadg_file.size(), gathered_gbx_textures, quake_palette);
 		}
 	}
 
-	std::vector<char> input_file_data;
-	std::vector<char> input_decompressed_data;
-	std::vector<char> output_data;
-	std::vector<char> output_uncompressed_data;
-	bs2pc::id_map map_id;
-	bs2pc::gbx_map map_gbx;
-	std::vector<std::string> map_wad_names_used;
 	bool wadg_load_attempted = false;
+	std::mutex wadg_load_mutex;
 	// For conversion from id to Gearbox, the textures loaded from the WADG.
-	// The key is bs2pc::string_to_lower(texture.name).
-	std::unordered_map<std::string, bs2pc::gbx_texture_deserialized> loaded_wadg_textures;
-	bool last_file_errored = false;
-	for (std::filesystem::path const & input_path : input_paths) {
-		if (last_file_errored) {
-			any_errors = true;
-		}
-		// Make sure that any `continue` means an error.
-		last_file_errored = true;
+	// The file is kept loaded as the textures are deserialized from it when they're looked up.
+	bs2pc_file loaded_wadg_file;
+	bs2pc::wadg_textures_deserialized loaded_wadg_textures;
 
-		if (!bs2pc_load_file(input_path, input_file_data, true)) {
-			continue;
+	// Returns whether the file has been processed successfully.
+	auto const process_input_file = [&](
+			std::filesystem::path const & input_path, file_state & state, file_result & result, std::ostream & log) {
+		std::shared_ptr<bs2pc_file> & input_file = state.input_file;
+		std::vector<char> & input_decompressed_data = *state.input_decompressed_data;
+		std::vector<char> & output_data = state.output_data;
+		bs2pc::id_map & map_id = state.map_id;
+		bs2pc::gbx_map & map_gbx = state.map_gbx;
+		std::vector<std::string> & map_wad_names = state.map_wad_names;
+		std::vector<bs2pc::wad_textures_deserialized *> & map_wads = state.map_wads;
+		std::vector<std::pair<size_t, bool>> & map_wad_name_numbers_and_used = state.map_wad_name_numbers_and_used;
+		std::vector<std::string> & map_wad_names_used = state.map_wad_names_used;
+		file_profile & profile = result.profile;
+
+		// Releases the input file along with the references to it and to the decompressed data from the maps.
+		// The output file may be the same as the input file, which must not be modified while it's mapped.
+		auto const release_input_file = [&input_file, &map_id, &map_gbx]() {
+			map_id.visibility.clear();
+			map_id.lighting.clear();
+			map_gbx.visibility.clear();
+			map_gbx.lighting.clear();
+			input_file.reset();
+		};
+
+		// If the output path is a directory or not specified, the extension of the output file is replaced.
+		auto const get_output_path = [&](char const * const extension) -> std::filesystem::path {
+			std::filesystem::path output_path(argument_output_path.empty() ? input_path : argument_output_path);
+			if (argument_output_path_is_directory || argument_output_path.empty()) {
+				if (argument_output_path_is_directory) {
+					output_path /= input_path.filename();
+				}
+				assert(extension[0]);
+				output_path.replace_extension(extension);
+			}
+			return output_path;
+		};
+
+		// Serializes the id map directly to the output file without keeping the whole serialized map in memory.
+		// The output file must not be the input file, as the map may be referencing the input file.
+		auto const write_id_map = [&](std::filesystem::path const & output_path) -> bool {
+			std::ofstream output_stream(output_path, std::ios_base::binary | std::ios_base::out);
+			if (!output_stream.is_open()) {
+				log << "Failed to open " << output_path.string() << " for writing." << std::endl;
+				return false;
+			}
+			bs2pc::ostream_map_sink output_sink(output_stream);
+			bool const serialized = map_id.serialize(output_sink, quake_palette.id);
+			release_input_file();
+			if (!serialized) {
+				log << "Failed to write " << output_path.string() << "." << std::endl;
+				return false;
+			}
+			profile.bytes_out = output_sink.get_written_size();
+			profile.end_stage("serialize_and_write");
+			state.output_path = output_path;
+			return true;
+		};
+
+		state.manifest_dependencies.clear();
+		state.output_path.clear();
+
+		// The maps may still be referencing the previous input file if it has failed to be processed.
+		release_input_file();
+		input_file = std::make_shared<bs2pc_file>();
+		if (!input_file->load(input_path, log, true)) {
+			return false;
 		}
+		profile.bytes_in = input_file->size();
+		profile.end_stage("load");
 
 		if (argument_convert_mode == convert_mode::create_gbx_texture_wadg ||
 				argument_convert_mode == convert_mode::extract_gbx_textures ||
 				argument_convert_mode == convert_mode::write_gbx_polygon_objs) {
 			// Extract Gearbox textures or write polygon .obj files.
-			if (input_file_data.size() < sizeof(uint32_t) + sizeof(uint16_t)) {
-				std::cerr << input_path.string() << " is too small to identify its type." << std::endl;
-				continue;
+			if (input_file->size() < sizeof(uint32_t) + sizeof(uint16_t)) {
+				log << input_path.string() << " is too small to identify its type." << std::endl;
+				return false;
 			}
+			bool const only_textures = argument_convert_mode == convert_mode::create_gbx_texture_wadg ||
+					argument_convert_mode == convert_mode::extract_gbx_textures;
 			uint32_t map_version;
-			std::memcpy(&map_version, input_file_data.data(), sizeof(uint32_t));
-			std::vector<char> * input_data = nullptr;
+			std::memcpy(&map_version, input_file->data(), sizeof(uint32_t));
+			char const * input_data = nullptr;
+			size_t input_data_size = 0;
+			std::shared_ptr<void const> input_data_owner;
+			// Textures are stored before the entities and the polygons, so when only the textures are needed, the
+			// decompression of compressed maps is stopped after the textures lump.
+			bs2pc::gbx_map_decompression_stream decompression_stream;
 			if (map_version == bs2pc::gbx_map_version) {
-				std::cerr << "Processing an uncompressed Half-Life PS2 map " << input_path.string() << "..." <<
+				log << "Processing an uncompressed Half-Life PS2 map " << input_path.string() << "..." <<
 						std::endl;
-				input_data = &input_file_data;
-			} else if (bs2pc::is_gbx_map_compressed(input_file_data.data(), input_file_data.size())) {
-				if (!bs2pc::decompress_gbx_map(
-						input_file_data.data(), input_file_data.size(), input_decompressed_data)) {
-					std::cerr << "Failed to decompress " << input_path.string() << "." << std::endl;
-					continue;
+				input_data = input_file->data();
+				input_data_size = input_file->size();
+				input_data_owner = input_file;
+			} else if (bs2pc::is_gbx_map_compressed(input_file->data(), input_file->size())) {
+				if (!decompression_stream.begin(input_file->data(), input_file->size(), input_decompressed_data) ||
+						!decompression_stream.decompress(only_textures ? bs2pc::gbx_map_header_size : SIZE_MAX)) {
+					log << "Failed to decompress " << input_path.string() << "." << std::endl;
+					return false;
+				}
+				if (input_decompressed_data.size() >= sizeof(uint32_t)) {
+					std::memcpy(&map_version, input_decompressed_data.data(), sizeof(uint32_t));
 				}
-				std::memcpy(&map_version, input_decompressed_data.data(), sizeof(uint32_t));
 				if (map_version == bs2pc::gbx_map_version) {
-					std::cerr << "Processing a compressed Half-Life PS2 map " << input_path.string() << "..." <<
+					log << "Processing a compressed Half-Life PS2 map " << input_path.string() << "..." <<
 							std::endl;
-					input_data = &input_decompressed_data;
+					if (only_textures && input_decompressed_data.size() >= bs2pc::gbx_map_header_size &&
+							!decompression_stream.decompress(
+									bs2pc::gbx_map::get_size_for_only_textures(input_decompressed_data.data()))) {
+						log << "Failed to decompress " << input_path.string() << "." << std::endl;
+						return false;
+					}
+					input_data = input_decompressed_data.data();
+					input_data_size = input_decompressed_data.size();
+					input_data_owner = state.input_decompressed_data;
 				}
+				profile.end_stage("decompress");
 			}
 			if (!input_data) {
-				std::cerr << input_path.string() << " is not a map of a supported type." << std::endl;
-				continue;
+				log << input_path.string() << " is not a map of a supported type." << std::endl;
+				return false;
 			}
 
-			char const * const deserialize_error =
-					((argument_convert_mode == convert_mode::create_gbx_texture_wadg ||
-							argument_convert_mode == convert_mode::extract_gbx_textures)
-							? map_gbx.deserialize_only_textures(input_data->data(), input_data->size(), quake_palette)
-							: map_gbx.deserialize(input_data->data(), input_data->size(), quake_palette));
+			char const * deserialize_error =
+					(only_textures
+							? map_gbx.deserialize_only_textures(input_data, input_data_size, quake_palette)
+							: map_gbx.deserialize(input_data, input_data_size, quake_palette, input_data_owner));
+			if (deserialize_error && only_textures && input_data == input_decompressed_data.data() &&
+					!decompression_stream.is_finished()) {
+				// The texture pixels or palettes may be outside the textures lump, retry with the whole map.
+				if (!decompression_stream.decompress(SIZE_MAX)) {
+					log << "Failed to decompress " << input_path.string() << "." << std::endl;
+					return false;
+				}
+				input_data = input_decompressed_data.data();
+				input_data_size = input_decompressed_data.size();
+				deserialize_error = map_gbx.deserialize_only_textures(input_data, input_data_size, quake_palette);
+			}
 			if (deserialize_error) {
-				std::cerr << "Failed to deserialize " << input_path.string() << ": " << deserialize_error << '.' <<
+				log << "Failed to deserialize " << input_path.string() << ": " << deserialize_error << '.' <<
 						std::endl;
-				continue;
+				return false;
 			}
+			profile.end_stage("deserialize");
 
 			if (argument_convert_mode == convert_mode::create_gbx_texture_wadg ||
 					argument_convert_mode == convert_mode::extract_gbx_textures) {
-				for (bs2pc::gbx_texture_deserialized const & deserialized_texture : map_gbx.textures) {
-					auto const texture_gbx_emplaced = gathered_gbx_textures.emplace(
-							bs2pc::string_to_lower(deserialized_texture.name),
-							deserialized_texture);
-					// Even if adding new textures to the WADG, there's no need to overwrite existing textures there as
-					// the data stored is the original Gearbox's conversions, which don't depend on the algorithms used
-					// in BS2PC, only on the details of storage within BS2PC - and if they're changed in a future
-					// version of BS2PC, the header of the WADG just needs to be changed.
-					if (texture_gbx_emplaced.second) {
-						// Don't need texture numbers from some map in the .bs2pcwad.
-						texture_gbx_emplaced.first->second.reset_anim();
-					}
-				}
+				// Gathered in the order of the input files after processing.
+				result.gbx_textures = std::move(map_gbx.textures);
 			} else if (argument_convert_mode == convert_mode::write_gbx_polygon_objs) {
-				std::filesystem::path output_path(argument_output_path.empty() ? input_path : argument_output_path);
-				if (argument_output_path_is_directory || argument_output_path.empty()) {
-					if (argument_output_path_is_directory) {
-						output_path /= input_path.filename();
-					}
-					output_path.replace_extension(".obj");
-				}
+				std::filesystem::path const output_path = get_output_path(".obj");
+				release_input_file();
 				{
 					std::ofstream output_stream(output_path, std::ios_base::out);
 					if (!output_stream.is_open()) {
-						std::cerr << "Failed to open " << output_path.string() << " for writing." << std::endl;
-						continue;
+						log << "Failed to open " << output_path.string() << " for writing." << std::endl;
+						return false;
 					}
 					bs2pc::write_polygons_to_obj(output_stream, map_gbx);
 					if (!output_stream.good()) {
-						std::cerr << "Failed to write " << output_path.string() << "." << std::endl;
-						continue;
+						log << "Failed to write " << output_path.string() << "." << std::endl;
+						return false;
 					}
+					profile.bytes_out = uint64_t(output_stream.tellp());
 				}
+				profile.end_stage("write");
+				state.output_path = output_path;
 			}
 		} else {
 			// Make sure all potential padding is filled with zeros, not by the previous output contents.
@@ -557,36 +1225,38 @@ int main(int const argument_count, char const * const * const arguments) {
 			switch (argument_convert_mode) {
 				case convert_mode::convert: {
 					// Convert the map.
-					if (input_file_data.size() < sizeof(uint32_t) + sizeof(uint16_t)) {
-						std::cerr << input_path.string() << " is too small to identify its type." << std::endl;
-						continue;
+					if (input_file->size() < sizeof(uint32_t) + sizeof(uint16_t)) {
+						log << input_path.string() << " is too small to identify its type." << std::endl;
+						return false;
 					}
 					uint32_t map_original_version;
-					std::memcpy(&map_original_version, input_file_data.data(), sizeof(uint32_t));
+					std::memcpy(&map_original_version, input_file->data(), sizeof(uint32_t));
 					if (map_original_version == bs2pc::id_map_version_quake ||
 							map_original_version == bs2pc::id_map_version_valve) {
 						// An id map.
 						if (map_original_version == bs2pc::id_map_version_quake) {
 							if (deserialize_quake_maps_as_valve) {
-								std::cerr << "Converting Half-Life Alpha v0.52 or Quake map " << input_path.string() <<
+								log << "Converting Half-Life Alpha v0.52 or Quake map " << input_path.string() <<
 										" as a Half-Life map..." << std::endl;
 							} else {
-								std::cerr << "Converting Quake map " << input_path.string() << "..." << std::endl;
+								log << "Converting Quake map " << input_path.string() << "..." << std::endl;
 							}
 						} else if (map_original_version == bs2pc::id_map_version_valve) {
-							std::cerr << "Converting Half-Life PC map " << input_path.string() << "..." << std::endl;
+							log << "Converting Half-Life PC map " << input_path.string() << "..." << std::endl;
 						}
 
 						char const * const deserialize_error = map_id.deserialize(
-								input_file_data.data(),
-								input_file_data.size(),
+								input_file->data(),
+								input_file->size(),
 								deserialize_quake_maps_as_valve,
-								quake_palette.id);
+								quake_palette.id,
+								input_file);
 						if (deserialize_error) {
-							std::cerr << "Failed to deserialize " << input_path.string() << ": " << deserialize_error <<
+							log << "Failed to deserialize " << input_path.string() << ": " << deserialize_error <<
 									'.' << std::endl;
-							continue;
+							return false;
 						}
+						profile.end_stage("deserialize");
 
 						map_id.upgrade_from_quake_without_model_paths(subdivide_quake_turbulent);
 
@@ -595,39 +1265,45 @@ int main(int const argument_count, char const * const * const arguments) {
 							map_id.version = bs2pc::id_map_version_valve;
 
 							bs2pc::convert_model_paths(
-									map_id.entities.data(),
-									map_id.entities.size(),
-									map_original_version,
-									bs2pc::id_map_version_valve);
-
-							map_id.serialize(output_data, quake_palette.id);
+									map_id.entities, map_original_version, bs2pc::id_map_version_valve);
+							profile.end_stage("convert_map");
 
 							output_extension = ".bsp";
+							std::filesystem::path const output_path = get_output_path(output_extension);
+							std::error_code output_path_equivalent_error;
+							if (!std::filesystem::equivalent(output_path, input_path, output_path_equivalent_error)) {
+								return write_id_map(output_path);
+							}
+							// Upgrading the map in place, write it after releasing the input file.
+							map_id.serialize(output_data, quake_palette.id);
+							profile.end_stage("serialize");
 						} else {
 							map_gbx.from_id_no_texture_pixels_and_polygons(map_id);
 
-							bs2pc::convert_model_paths(
-									map_gbx.entities.data(),
-									map_gbx.entities.size(),
-									map_original_version,
-									bs2pc::gbx_map_version);
+							bs2pc::convert_model_paths(map_gbx.entities, map_original_version, bs2pc::gbx_map_version);
+							profile.end_stage("convert_map");
 
 							// If any map needs to be converted from id to Gearbox, load the file containing the
 							// original textures extracted from the maps for more visual consistency with them so the
 							// filtering and the sizes are the same as in the original conversions.
-							if (!wadg_load_attempted) {
-								wadg_load_attempted = true;
-								std::vector<char> wadg_file;
-								if (bs2pc_load_file(wadg_path, wadg_file, true)) {
-									char const * const wadg_deserialize_error = bs2pc::add_wadg_textures(
-											wadg_file.data(), wadg_file.size(), loaded_wadg_textures, quake_palette);
-									if (wadg_deserialize_error) {
-										std::cerr << "Failed to deserialize " << wadg_path.string() << ": " <<
-												wadg_deserialize_error << '.' << std::endl;
-										continue;
+							// Loaded once for all jobs, and not modified after loading.
+							{
+								std::lock_guard<std::mutex> const wadg_load_lock(wadg_load_mutex);
+								if (!wadg_load_attempted) {
+									wadg_load_attempted = true;
+									if (loaded_wadg_file.load(wadg_path, log, true)) {
+										char const * const wadg_deserialize_error = bs2pc::get_wadg_textures(
+												loaded_wadg_file.data(), loaded_wadg_file.size(),
+												loaded_wadg_textures, quake_palette);
+										if (wadg_deserialize_error) {
+											log << "Failed to deserialize " << wadg_path.string() << ": " <<
+													wadg_deserialize_error << '.' << std::endl;
+											return false;
+										}
 									}
 								}
 							}
+							state.manifest_dependencies.push_back(wadg_path);
 
 							// If there are textures without pixels stored in the map, load the WAD files for it.
 							// Not doing this unconditionally because some original Valve's maps have all textures
@@ -638,12 +1314,13 @@ int main(int const argument_count, char const * const * const arguments) {
 									continue;
 								}
 								if (!map_id.entities.empty()) {
-									bs2pc::append_worldspawn_wad_names(map_id.entities.front(), map_wad_names);
+									bs2pc::append_worldspawn_wad_names(map_id.entities, map_wad_names);
 								}
 								break;
 							}
 							// If no textures to load from WADs, just clear the vectors.
-							load_map_wads();
+							load_map_wads(state, log);
+							profile.end_stage("load_textures");
 
 							// Convert the textures, or load an existing conversion.
 							// Also remove the random tiling prefix from textures similar to how that's done in the
@@ -663,13 +1340,12 @@ int main(int const argument_count, char const * const * const arguments) {
 								bs2pc::wad_texture_deserialized * pixels_wad_texture = nullptr;
 								if (!pixels_texture_id) {
 									for (bs2pc::wad_textures_deserialized * const wad : map_wads) {
-										auto const wad_texture_number_iterator =
-												wad->texture_number_map.find(texture_id_name_lower);
-										if (wad_texture_number_iterator == wad->texture_number_map.cend()) {
+										bs2pc::wad_texture_deserialized * const wad_texture_pointer =
+												wad->find_texture(texture_id_name_lower);
+										if (!wad_texture_pointer) {
 											continue;
 										}
-										bs2pc::wad_texture_deserialized & wad_texture =
-												wad->textures[wad_texture_number_iterator->second];
+										bs2pc::wad_texture_deserialized & wad_texture = *wad_texture_pointer;
 										if (wad_texture.texture_id.width == map_texture_id.width &&
 												wad_texture.texture_id.height == map_texture_id.height) {
 											pixels_texture_id = &wad_texture.texture_id;
@@ -687,96 +1363,127 @@ int main(int const argument_count, char const * const * const arguments) {
 									random_removed = true;
 									texture_gbx.name = texture_gbx.name.substr(1);
 								}
-								auto const wadg_texture_iterator = bs2pc::find_identical_wadg_texture(
-										loaded_wadg_textures, texture_gbx.name, *pixels_texture_id, quake_palette);
-								if (wadg_texture_iterator != loaded_wadg_textures.cend()) {
+								bs2pc::gbx_texture_deserialized const * const wadg_texture =
+										bs2pc::find_identical_wadg_texture(
+												loaded_wadg_textures, texture_gbx.name, *pixels_texture_id,
+												quake_palette);
+								if (wadg_texture) {
 									// The pixels might have been found under a different name of the texture.
 									// Store it, and restore after copying all the fields.
 									std::string texture_gbx_map_name = std::move(texture_gbx.name);
-									texture_gbx = wadg_texture_iterator->second;
+									texture_gbx = *wadg_texture;
 									texture_gbx.name = std::move(texture_gbx_map_name);
+									++profile.wadg_hits;
 								} else if (pixels_wad_texture) {
 									// Reuse conversions of WAD textures between maps.
-									texture_gbx.pixels_and_palette_from_wad(*pixels_wad_texture, quake_palette.id);
+									if (gbx_pixels_and_palette_from_wad(texture_gbx, *pixels_wad_texture)) {
+										++profile.wad_texture_reuse_hits;
+									} else {
+										++profile.textures_resampled;
+									}
 								} else {
-									texture_gbx.pixels_and_palette_from_id(*pixels_texture_id, quake_palette.id);
+									// Reuse conversions of textures embedded in maps between maps.
+									if (texture_gbx.pixels_and_palette_from_id(
+											*pixels_texture_id, quake_palette.id, texture_pixels_cache_pointer,
+											&gbx_texture_intern_table, &texture_palette_analysis_cache)) {
+										++profile.texture_intern_hits;
+									} else {
+										++profile.textures_resampled;
+									}
 								}
 							}
 							if (random_removed) {
 								// Update animation links since random-tiled textures contain them.
 								map_gbx.link_texture_anim();
 							}
+							profile.end_stage("convert_textures");
 
-							map_gbx.make_polygons(map_gbx.polygons.data(), map_gbx.polygons.size());
-
-							std::vector<char> & output_serialized_data =
-									compress ? output_uncompressed_data : output_data;
-							map_gbx.serialize(output_serialized_data, quake_palette);
+							map_gbx.make_polygons(
+									map_gbx.polygons.data(), map_gbx.polygons.size(), polygon_thread_count);
+							for (bs2pc::gbx_polygons_deserialized const & face_polygons : map_gbx.polygons) {
+								if (face_polygons.vertexes.empty()) {
+									continue;
+								}
+								++profile.polygons;
+								profile.polygon_vertexes += face_polygons.vertexes.size();
+								profile.polygon_strips += face_polygons.strips.size();
+							}
+							profile.end_stage("make_polygons");
 
 							if (compress) {
-								if (!bs2pc::compress_gbx_map(
-										output_serialized_data.data(),
-										output_serialized_data.size(),
-										output_data)) {
-									std::cerr << "Failed to compress " << input_path.string() << "." << std::endl;
-									continue;
+								// Compress the map while serializing it without keeping the whole uncompressed map.
+								bs2pc::gbx_map_compression_stream compression_stream(
+										output_data, compress_thread_count);
+								if (!map_gbx.serialize(compression_stream, quake_palette)) {
+									log << "Failed to compress " << input_path.string() << "." << std::endl;
+									return false;
 								}
+								profile.end_stage("serialize_and_compress");
+							} else {
+								map_gbx.serialize(output_data, quake_palette);
+								profile.end_stage("serialize");
 							}
 							// .bs2uz is a BS2PC addition, not an extension used by Gearbox.
 							output_extension = compress ? "bs2" : "bs2uz";
 						}
 					} else {
 						// Possibly a Gearbox map.
-						std::vector<char> * input_data = nullptr;
+						char const * input_data = nullptr;
+						size_t input_data_size = 0;
+						std::shared_ptr<void const> input_data_owner;
 						if (map_original_version == bs2pc::gbx_map_version) {
-							std::cerr << "Converting uncompressed Half-Life PS2 map " << input_path.string() << "..." <<
+							log << "Converting uncompressed Half-Life PS2 map " << input_path.string() << "..." <<
 									std::endl;
-							input_data = &input_file_data;
-						} else if (bs2pc::is_gbx_map_compressed(input_file_data.data(), input_file_data.size())) {
+							input_data = input_file->data();
+							input_data_size = input_file->size();
+							input_data_owner = input_file;
+						} else if (bs2pc::is_gbx_map_compressed(input_file->data(), input_file->size())) {
 							if (!bs2pc::decompress_gbx_map(
-									input_file_data.data(), input_file_data.size(), input_decompressed_data)) {
-								std::cerr << "Failed to decompress " << input_path.string() << "." << std::endl;
-								continue;
+									input_file->data(), input_file->size(), input_decompressed_data)) {
+								log << "Failed to decompress " << input_path.string() << "." << std::endl;
+								return false;
 							}
 							std::memcpy(&map_original_version, input_decompressed_data.data(), sizeof(uint32_t));
 							if (map_original_version == bs2pc::gbx_map_version) {
-								std::cerr << "Converting compressed Half-Life PS2 map " << input_path.string() <<
+								log << "Converting compressed Half-Life PS2 map " << input_path.string() <<
 										"..." << std::endl;
-								input_data = &input_decompressed_data;
+								input_data = input_decompressed_data.data();
+								input_data_size = input_decompressed_data.size();
+								input_data_owner = state.input_decompressed_data;
 							}
+							profile.end_stage("decompress");
 						}
 						if (!input_data) {
-							std::cerr << input_path.string() << " is not a map of a supported type." << std::endl;
-							continue;
+							log << input_path.string() << " is not a map of a supported type." << std::endl;
+							return false;
 						}
 
-						char const * const deserialize_error =
-								map_gbx.deserialize(input_data->data(), input_data->size(), quake_palette);
+						char const * const deserialize_error = map_gbx.deserialize(
+								input_data, input_data_size, quake_palette, input_data_owner);
 						if (deserialize_error) {
-							std::cerr << "Failed to deserialize " << input_path.string() << ": " << deserialize_error <<
+							log << "Failed to deserialize " << input_path.string() << ": " << deserialize_error <<
 									'.' << std::endl;
-							continue;
+							return false;
 						}
+						profile.end_stage("deserialize");
 
 						map_id.from_gbx_no_texture_pixels(map_gbx);
 
-						bs2pc::convert_model_paths(
-								map_id.entities.data(),
-								map_id.entities.size(),
-								map_original_version,
-								bs2pc::id_map_version_valve);
+						bs2pc::convert_model_paths(map_id.entities, map_original_version, bs2pc::id_map_version_valve);
+						profile.end_stage("convert_map");
 
 						// Process WAD paths for the map.
 						map_wad_names.clear();
 						if (!map_id.entities.empty()) {
-							bs2pc::append_worldspawn_wad_names(map_id.entities.front(), map_wad_names);
+							bs2pc::append_worldspawn_wad_names(map_id.entities, map_wad_names);
 							// Replace Gearbox's WADs with the PC Half-Life WADs.
 							bs2pc::replace_hlps2_wads(map_wad_names);
 						}
 						// Load the WADs to use the original textures, with 24-bit rather than 21-bit colors, and not
 						// resampled to a power of two, thus still having all the original details. If no WAD list in
 						// worldspawn, just clear the vectors.
-						load_map_wads();
+						load_map_wads(state, log);
+						profile.end_stage("load_textures");
 
 						// Convert the textures if needed, or let the engine use the original texures from the WADs.
 						// Before doing anything (such as removing nodraw) that may change the texture numbers.
@@ -784,8 +1491,10 @@ int main(int const argument_count, char const * const * const arguments) {
 						for (size_t texture_number = 0; texture_number < map_gbx.textures.size(); ++texture_number) {
 							map_id.textures[texture_number].pixels_and_palette_from_wads_or_gbx(
 									map_gbx.textures[texture_number], map_wads.data(), map_wads.size(),
-									include_all_textures, quake_palette);
+									include_all_textures, quake_palette, texture_pixels_cache_pointer,
+									&texture_palette_analysis_cache);
 						}
+						profile.end_stage("convert_textures");
 
 						if (!keep_nodraw) {
 							map_id.remove_nodraw();
@@ -819,32 +1528,42 @@ int main(int const argument_count, char const * const * const arguments) {
 								}
 								map_wad_names_used.push_back(map_wad_names[map_wad_name_number_and_used.first]);
 							}
-							bs2pc::set_worldspawn_wad_paths(map_id.entities.front(), map_wad_names_used);
+							bs2pc::set_worldspawn_wad_paths(map_id.entities, map_wad_names_used);
 						}
-
-						map_id.serialize(output_data, quake_palette.id);
+						profile.end_stage("finalize_map");
 
 						output_extension = "bsp";
+						std::filesystem::path const output_path = get_output_path(output_extension);
+						std::error_code output_path_equivalent_error;
+						if (!std::filesystem::equivalent(output_path, input_path, output_path_equivalent_error)) {
+							return write_id_map(output_path);
+						}
+						// Converting the map in place, write it after releasing the input file.
+						map_id.serialize(output_data, quake_palette.id);
+						profile.end_stage("serialize");
 					}
 				}
 				break;
 
 				case convert_mode::compress: {
-					std::cerr << "Compressing " << input_path.string() << "..." << std::endl;
-					if (!bs2pc::compress_gbx_map(input_file_data.data(), input_file_data.size(), output_data)) {
-						std::cerr << "Failed to compress " << input_path.string() << "." << std::endl;
-						continue;
+					log << "Compressing " << input_path.string() << "..." << std::endl;
+					if (!bs2pc::compress_gbx_map(
+							input_file->data(), input_file->size(), output_data, compress_thread_count)) {
+						log << "Failed to compress " << input_path.string() << "." << std::endl;
+						return false;
 					}
+					profile.end_stage("compress");
 					output_extension = "bs2";
 				}
 				break;
 
 				case convert_mode::decompress: {
-					std::cerr << "Decompressing " << input_path.string() << "..." << std::endl;
-					if (!bs2pc::decompress_gbx_map(input_file_data.data(), input_file_data.size(), output_data)) {
-						std::cerr << "Failed to decompress " << input_path.string() << "." << std::endl;
-						continue;
+					log << "Decompressing " << input_path.string() << "..." << std::endl;
+					if (!bs2pc::decompress_gbx_map(input_file->data(), input_file->size(), output_data)) {
+						log << "Failed to decompress " << input_path.string() << "." << std::endl;
+						return false;
 					}
+					profile.end_stage("decompress");
 					// .bs2uz is a BS2PC addition, not an extension used by Gearbox.
 					output_extension = "bs2uz";
 				}
@@ -852,39 +1571,207 @@ int main(int const argument_count, char const * const * const arguments) {
 			}
 
 			// Write the output file.
+			release_input_file();
 			if (output_data.size() > std::numeric_limits<std::streamsize>::max()) {
-				std::cerr << "The output for " << input_path.string() << " is too large." << std::endl;
-				continue;
+				log << "The output for " << input_path.string() << " is too large." << std::endl;
+				return false;
 			}
 			{
-				std::filesystem::path output_path(argument_output_path.empty() ? input_path : argument_output_path);
-				if (argument_output_path_is_directory || argument_output_path.empty()) {
-					if (argument_output_path_is_directory) {
-						output_path /= input_path.filename();
-					}
-					assert(output_extension[0]);
-					output_path.replace_extension(output_extension);
-				}
+				std::filesystem::path const output_path = get_output_path(output_extension);
 				{
 					std::ofstream output_stream(output_path, std::ios_base::binary | std::ios_base::out);
 					if (!output_stream.is_open()) {
-						std::cerr << "Failed to open " << output_path.string() << " for writing." << std::endl;
-						continue;
+						log << "Failed to open " << output_path.string() << " for writing." << std::endl;
+						return false;
 					}
 					output_stream.write(output_data.data(), std::streamsize(output_data.size()));
 					if (!output_stream.good()) {
-						std::cerr << "Failed to write " << output_path.string() << "." << std::endl;
-						continue;
+						log << "Failed to write " << output_path.string() << "." << std::endl;
+						return false;
 					}
 				}
+				state.output_path = output_path;
 			}
+			profile.bytes_out = output_data.size();
+			profile.end_stage("write");
 		}
 
 		// Converted successfully.
-		last_file_errored = false;
-	}
-	if (last_file_errored) {
-		any_errors = true;
+		return true;
+	};
+
+	// Hashes of the dependencies for -manifest, shared between the jobs, computed once for each path.
+	std::unordered_map<std::string, std::string> manifest_dependency_hashes;
+	std::mutex manifest_dependency_hashes_mutex;
+	auto const get_manifest_dependency_hash = [&](std::string const & path) -> std::string {
+		{
+			std::lock_guard<std::mutex> const manifest_dependency_hashes_lock(manifest_dependency_hashes_mutex);
+			auto const hash_iterator = manifest_dependency_hashes.find(path);
+			if (hash_iterator != manifest_dependency_hashes.cend()) {
+				return hash_iterator->second;
+			}
+		}
+		// Hash outside the lock as WADs may be large. If multiple jobs hash the same file, the results are the same.
+		std::string hash = get_manifest_file_hash(path);
+		std::lock_guard<std::mutex> const manifest_dependency_hashes_lock(manifest_dependency_hashes_mutex);
+		return manifest_dependency_hashes.emplace(path, std::move(hash)).first->second;
+	};
+
+	// With -manifest, skips the input file if its output is up to date, or processes it and prepares the new manifest
+	// entry for it otherwise.
+	// Returns whether the file has been processed successfully or skipped.
+	auto const process_input_file_if_outdated = [&](
+			std::filesystem::path const & input_path, file_state & state, file_result & result, std::ostream & log) {
+		result.profile.begin();
+		if (!use_manifest) {
+			return process_input_file(input_path, state, result, log);
+		}
+		std::string const input_hash = get_manifest_file_hash(input_path);
+		auto const previous_entry_iterator = manifest_entries.find(input_path.string());
+		if (previous_entry_iterator != manifest_entries.cend()) {
+			manifest_entry const & previous_entry = previous_entry_iterator->second;
+			std::error_code output_size_error;
+			bool up_to_date = previous_entry.input_hash == input_hash &&
+					previous_entry.options_hash == manifest_options_hash &&
+					std::filesystem::file_size(previous_entry.output_path, output_size_error) ==
+							previous_entry.output_size &&
+					!output_size_error &&
+					get_manifest_file_hash(previous_entry.output_path) == previous_entry.output_hash;
+			for (std::pair<std::string, std::string> const & dependency : previous_entry.dependencies) {
+				if (!up_to_date) {
+					break;
+				}
+				up_to_date = get_manifest_dependency_hash(dependency.first) == dependency.second;
+			}
+			if (up_to_date) {
+				log << previous_entry.output_path << " is up to date, skipping " << input_path.string() << "." <<
+						std::endl;
+				result.manifest = previous_entry;
+				result.profile.end_stage("check_manifest");
+				return true;
+			}
+		}
+		result.profile.end_stage("check_manifest");
+		if (!process_input_file(input_path, state, result, log)) {
+			return false;
+		}
+		// Not recording the files converted in place as the input hash is the one before it has been overwritten.
+		std::error_code output_path_equivalent_error;
+		if (input_hash == "-" || state.output_path.empty() ||
+				std::filesystem::equivalent(state.output_path, input_path, output_path_equivalent_error)) {
+			return true;
+		}
+		std::error_code output_size_error;
+		uint64_t const output_size = uint64_t(std::filesystem::file_size(state.output_path, output_size_error));
+		if (output_size_error) {
+			return true;
+		}
+		std::string output_hash = get_manifest_file_hash(state.output_path);
+		if (output_hash == "-") {
+			return true;
+		}
+		manifest_entry & entry = result.manifest.emplace();
+		entry.input_hash = input_hash;
+		entry.options_hash = manifest_options_hash;
+		entry.output_path = state.output_path.string();
+		entry.output_size = output_size;
+		entry.output_hash = std::move(output_hash);
+		for (std::filesystem::path const & dependency_path : state.manifest_dependencies) {
+			std::string dependency_path_string = dependency_path.string();
+			std::string dependency_hash = get_manifest_dependency_hash(dependency_path_string);
+			entry.dependencies.emplace_back(std::move(dependency_path_string), std::move(dependency_hash));
+		}
+		return true;
+	};
+
+	// For -profile, in the order of the input files.
+	std::vector<file_profile> file_profiles;
+
+	// For -manifest, the new entries for the processed input files, or nullopt to remove the entry if the file has
+	// failed to be processed.
+	std::vector<std::pair<std::string, std::optional<manifest_entry>>> manifest_updates;
+
+	// Handles the results of processing an input file, in the order of the input files.
+	auto const finish_input_file = [&](std::filesystem::path const & input_path, file_result & result) {
+		std::cerr << result.log;
+		if (!result.succeeded) {
+			any_errors = true;
+		}
+		if (use_manifest) {
+			manifest_updates.emplace_back(
+					input_path.string(), result.succeeded ? std::move(result.manifest) : std::nullopt);
+		}
+		if (!profile_path.empty()) {
+			result.profile.succeeded = result.succeeded;
+			file_profiles.push_back(std::move(result.profile));
+		}
+		for (bs2pc::gbx_texture_deserialized & deserialized_texture : result.gbx_textures) {
+			std::string texture_name_lower = bs2pc::string_to_lower(deserialized_texture.name);
+			auto const texture_gbx_emplaced =
+					gathered_gbx_textures.emplace(std::move(texture_name_lower), std::move(deserialized_texture));
+			// Even if adding new textures to the WADG, there's no need to overwrite existing textures there as the data
+			// stored is the original Gearbox's conversions, which don't depend on the algorithms used in BS2PC, only on
+			// the details of storage within BS2PC - and if they're changed in a future version of BS2PC, the header of
+			// the WADG just needs to be changed.
+			if (texture_gbx_emplaced.second) {
+				// Don't need texture numbers from some map in the .bs2pcwad.
+				texture_gbx_emplaced.first->second.reset_anim();
+			}
+		}
+		// Release the memory as early as possible.
+		result = file_result();
+	};
+
+	if (job_count <= 1) {
+		file_state state;
+		file_result result;
+		for (std::filesystem::path const & input_path : input_paths) {
+			// Print the messages directly as there's no need to keep them together.
+			result.succeeded = process_input_file_if_outdated(input_path, state, result, std::cerr);
+			result.profile.end();
+			finish_input_file(input_path, result);
+		}
+	} else {
+		std::vector<file_result> results(input_paths.size());
+		// Guarded by results_mutex.
+		std::vector<bool> results_ready(input_paths.size());
+		std::mutex results_mutex;
+		std::condition_variable result_ready_condition;
+		std::atomic<size_t> next_input_number(0);
+		std::vector<std::thread> jobs;
+		jobs.reserve(job_count);
+		for (size_t job_number = 0; job_number < job_count; ++job_number) {
+			jobs.emplace_back([&]() {
+				file_state state;
+				while (true) {
+					size_t const input_number = next_input_number.fetch_add(1, std::memory_order_relaxed);
+					if (input_number >= input_paths.size()) {
+						break;
+					}
+					file_result & result = results[input_number];
+					std::ostringstream log;
+					result.succeeded = process_input_file_if_outdated(input_paths[input_number], state, result, log);
+					result.profile.end();
+					result.log = log.str();
+					{
+						std::lock_guard<std::mutex> const results_lock(results_mutex);
+						results_ready[input_number] = true;
+					}
+					result_ready_condition.notify_all();
+				}
+			});
+		}
+		for (size_t input_number = 0; input_number < input_paths.size(); ++input_number) {
+			{
+				std::unique_lock<std::mutex> results_lock(results_mutex);
+				result_ready_condition.wait(
+						results_lock, [&results_ready, input_number]() { return bool(results_ready[input_number]); });
+			}
+			finish_input_file(input_paths[input_number], results[input_number]);
+		}
+		for (std::thread & job : jobs) {
+			job.join();
+		}
 	}
 
 	if (argument_convert_mode == convert_mode::create_gbx_texture_wadg) {
@@ -1030,5 +1917,44 @@ int main(int const argument_count, char const * const * const arguments) {
 		}
 	}
 
+	if (use_manifest) {
+		for (std::pair<std::string, std::optional<manifest_entry>> & manifest_update : manifest_updates) {
+			if (manifest_update.second) {
+				manifest_entries[manifest_update.first] = std::move(*manifest_update.second);
+			} else {
+				manifest_entries.erase(manifest_update.first);
+			}
+		}
+		std::ofstream manifest_stream(manifest_path, std::ios_base::binary | std::ios_base::out);
+		if (!manifest_stream.is_open()) {
+			std::cerr << "Failed to open " << manifest_path.string() << " for writing." << std::endl;
+			any_errors = true;
+		} else {
+			write_manifest(manifest_stream, manifest_entries);
+			if (!manifest_stream.good()) {
+				std::cerr << "Failed to write " << manifest_path.string() << "." << std::endl;
+				any_errors = true;
+			}
+		}
+	}
+
+	if (!profile_path.empty()) {
+		uint64_t const conversion_nanoseconds = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - conversion_start_time).count());
+		std::ofstream profile_stream(profile_path, std::ios_base::binary | std::ios_base::out);
+		if (!profile_stream.is_open()) {
+			std::cerr << "Failed to open " << profile_path.string() << " for writing." << std::endl;
+			any_errors = true;
+		} else {
+			write_profile_json(
+					profile_stream, conversion_nanoseconds, job_count, compress_thread_count, polygon_thread_count,
+					input_paths, file_profiles);
+			if (!profile_stream.good()) {
+				std::cerr << "Failed to write " << profile_path.string() << "." << std::endl;
+				any_errors = true;
+			}
+		}
+	}
+
 	return any_errors ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,697 @@
+#include "bs2pclib/bs2pclib.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Microbenchmarks of the individual stages of the conversion in bs2pclib, on synthetic data generated from a seed, so
+// no game data is needed, and the results are comparable between machines and revisions.
+
+// Synthetic data generation.
+// Not using the standard distributions as their results are implementation-defined, while the engine of std::mt19937
+// itself is fully specified, so the data is the same with all compilers.
+
+static uint32_t random_below(std::mt19937 & random, uint32_t const count) {
+	return uint32_t((uint64_t(random()) * count) >> 32);
+}
+
+static float random_float(std::mt19937 & random, float const min, float const max) {
+	return min + (max - min) * (float(random() >> 8) * (1.0f / float(UINT32_C(1) << 24)));
+}
+
+static bs2pc::vector3 normalize(bs2pc::vector3 const vector) {
+	float const length = std::sqrt(
+			vector.v[0] * vector.v[0] + vector.v[1] * vector.v[1] + vector.v[2] * vector.v[2]);
+	bs2pc::vector3 normalized;
+	for (size_t axis = 0; axis < 3; ++axis) {
+		normalized.v[axis] = vector.v[axis] / length;
+	}
+	return normalized;
+}
+
+static bs2pc::vector3 cross(bs2pc::vector3 const a, bs2pc::vector3 const b) {
+	bs2pc::vector3 result;
+	result.v[0] = a.v[1] * b.v[2] - a.v[2] * b.v[1];
+	result.v[1] = a.v[2] * b.v[0] - a.v[0] * b.v[2];
+	result.v[2] = a.v[0] * b.v[1] - a.v[1] * b.v[0];
+	return result;
+}
+
+// A Valve texture with all mips and a palette, with smooth gradients and noise for resampling and palette matching to
+// have realistic amounts of work, and holes in transparent textures.
+static bs2pc::id_texture_deserialized generate_texture(
+		std::mt19937 & random, char const * const name, uint32_t const width, uint32_t const height) {
+	bs2pc::id_texture_deserialized texture;
+	texture.name = name;
+	texture.width = width;
+	texture.height = height;
+	bool const is_transparent = name[0] == '{';
+	texture.pixels = std::make_shared<bs2pc::texture_deserialized_pixels>(
+			bs2pc::texture_pixel_count_with_mips(width, height, bs2pc::id_texture_mip_levels));
+	uint8_t * const pixels = texture.pixels->data();
+	uint32_t const frequency_x = 1 + random_below(random, 7);
+	uint32_t const frequency_y = 1 + random_below(random, 7);
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			uint8_t color = uint8_t(((x * frequency_x + y * frequency_y) & 0xFF) / 2 + random_below(random, 48));
+			if (is_transparent) {
+				color = ((x / 8 + y / 8) % 3) ? std::min(color, uint8_t(254)) : uint8_t(255);
+			}
+			pixels[width * y + x] = color;
+		}
+	}
+	// Point-sampled mips.
+	uint8_t const * mip_pixels = pixels;
+	for (uint32_t mip_level = 1; mip_level < bs2pc::id_texture_mip_levels; ++mip_level) {
+		uint32_t const mip_width = width >> mip_level;
+		uint32_t const mip_height = height >> mip_level;
+		uint8_t * const next_mip_pixels = const_cast<uint8_t *>(mip_pixels) + (mip_width * 2) * (mip_height * 2);
+		for (uint32_t y = 0; y < mip_height; ++y) {
+			for (uint32_t x = 0; x < mip_width; ++x) {
+				next_mip_pixels[mip_width * y + x] = mip_pixels[(mip_width * 2) * (y * 2) + x * 2];
+			}
+		}
+		mip_pixels = next_mip_pixels;
+	}
+	texture.palette = std::make_shared<bs2pc::id_texture_deserialized_palette>(3 * 256);
+	uint8_t * const palette = texture.palette->data();
+	uint8_t const palette_base[3] = {
+		uint8_t(random_below(random, 256)), uint8_t(random_below(random, 256)), uint8_t(random_below(random, 256)),
+	};
+	for (uint32_t color_number = 0; color_number < 256; ++color_number) {
+		for (uint32_t component = 0; component < 3; ++component) {
+			palette[3 * color_number + component] = uint8_t(
+					palette_base[component] + color_number * (component + 1) * 3 + random_below(random, 20));
+		}
+	}
+	if (is_transparent) {
+		palette[3 * 255 + 0] = 0;
+		palette[3 * 255 + 1] = 0;
+		palette[3 * 255 + 2] = 255;
+	}
+	return texture;
+}
+
+// A Valve map with all textures embedded, and a single leaf containing randomly placed and oriented convex polygons.
+static bs2pc::id_map generate_map(uint32_t const seed, uint32_t const face_count) {
+	std::mt19937 random(seed);
+	bs2pc::id_map map;
+	map.version = bs2pc::id_map_version_valve;
+	map.entities = bs2pc::deserialize_entities(
+			"{\n"
+			"\"classname\" \"worldspawn\"\n"
+			"\"wad\" \"\\half-life\\valve\\halflife.wad\"\n"
+			"}\n"
+			"{\n"
+			"\"classname\" \"info_player_start\"\n"
+			"\"origin\" \"0 0 64\"\n"
+			"}\n"
+			"{\n"
+			"\"classname\" \"cycler\"\n"
+			"\"model\" \"models/scientist.mdl\"\n"
+			"\"origin\" \"32 0 64\"\n"
+			"}\n");
+
+	static std::pair<char const *, std::pair<uint32_t, uint32_t>> const texture_definitions[] = {
+		{"!water1", {64, 64}},
+		{"!lava1", {48, 80}},
+		{"{fence", {48, 80}},
+		{"-0rand", {48, 48}},
+		{"-1rand", {48, 48}},
+		{"-2rand", {48, 48}},
+		{"+0anim", {32, 96}},
+		{"+1anim", {32, 96}},
+		{"wall1", {112, 48}},
+		{"wall2", {128, 128}},
+		{"wall3", {256, 256}},
+		{"wall4", {160, 176}},
+		{"sky", {64, 64}},
+	};
+	for (std::pair<char const *, std::pair<uint32_t, uint32_t>> const & texture_definition : texture_definitions) {
+		map.textures.push_back(generate_texture(
+				random, texture_definition.first, texture_definition.second.first, texture_definition.second.second));
+	}
+
+	bs2pc::vector3 map_mins, map_maxs;
+	for (size_t axis = 0; axis < 3; ++axis) {
+		map_mins.v[axis] = 4096.0f;
+		map_maxs.v[axis] = -4096.0f;
+	}
+	// The zero edge can't be referenced by surfedges as it can't be negated.
+	map.edges.push_back(bs2pc::edge{{0, 0}});
+	for (uint32_t face_number = 0; face_number < face_count; ++face_number) {
+		bs2pc::vector3 normal;
+		uint32_t plane_type;
+		if (random_below(random, 10) < 3) {
+			plane_type = random_below(random, 3);
+			normal.v[0] = normal.v[1] = normal.v[2] = 0.0f;
+			normal.v[plane_type] = random_below(random, 2) ? 1.0f : -1.0f;
+		} else {
+			for (size_t axis = 0; axis < 3; ++axis) {
+				normal.v[axis] = random_float(random, -1.0f, 1.0f);
+			}
+			normal = normalize(normal);
+			plane_type = bs2pc::plane_type_any_x;
+			for (uint32_t axis = 1; axis < 3; ++axis) {
+				if (std::abs(normal.v[axis]) > std::abs(normal.v[plane_type - bs2pc::plane_type_any_x])) {
+					plane_type = bs2pc::plane_type_any_x + axis;
+				}
+			}
+		}
+		bs2pc::vector3 reference;
+		reference.v[0] = std::abs(normal.v[2]) < 0.9f ? 0.0f : 1.0f;
+		reference.v[1] = 0.0f;
+		reference.v[2] = std::abs(normal.v[2]) < 0.9f ? 1.0f : 0.0f;
+		bs2pc::vector3 const u = normalize(cross(normal, reference));
+		bs2pc::vector3 const v = cross(normal, u);
+		bs2pc::vector3 center;
+		for (size_t axis = 0; axis < 3; ++axis) {
+			center.v[axis] = random_float(random, -2000.0f, 2000.0f);
+		}
+		uint32_t const texture_number = random_below(random, uint32_t(map.textures.size()));
+		char const * const texture_name = map.textures[texture_number].name.c_str();
+		bool const is_liquid_or_sky = texture_name[0] == '!' || !std::strcmp(texture_name, "sky");
+		// Liquids are subdivided into polygons, make them larger to exercise the subdivision.
+		float const radius = random_float(random, 40.0f, texture_name[0] == '!' ? 300.0f : 120.0f);
+
+		bs2pc::id_plane plane;
+		plane.normal = normal;
+		plane.distance = normal.v[0] * center.v[0] + normal.v[1] * center.v[1] + normal.v[2] * center.v[2];
+		plane.type = plane_type;
+		map.planes.push_back(plane);
+
+		bs2pc::id_face face;
+		face.plane_number = uint16_t(map.planes.size() - 1);
+		face.side = 0;
+		face.first_edge = uint32_t(map.surfedges.size());
+		face.edge_count = uint16_t(3 + random_below(random, 7));
+		face.texinfo_number = uint16_t(map.texinfo.size());
+		// A convex polygon with vertexes at jittered angles around the center, not too close to each other, as the
+		// compilers weld nearby vertexes.
+		size_t const first_vertex = map.vertexes.size();
+		float const angle_step = 6.2831853f / float(face.edge_count);
+		for (uint32_t face_vertex_number = 0; face_vertex_number < face.edge_count; ++face_vertex_number) {
+			float const angle = angle_step * (float(face_vertex_number) + random_float(random, 0.0f, 0.75f));
+			float const angle_cos = std::cos(angle), angle_sin = std::sin(angle);
+			bs2pc::vector3 vertex;
+			for (size_t axis = 0; axis < 3; ++axis) {
+				vertex.v[axis] = std::round(
+						(center.v[axis] + radius * (angle_cos * u.v[axis] + angle_sin * v.v[axis])) * 100.0f) * 0.01f;
+				map_mins.v[axis] = std::min(map_mins.v[axis], vertex.v[axis]);
+				map_maxs.v[axis] = std::max(map_maxs.v[axis], vertex.v[axis]);
+			}
+			map.vertexes.push_back(vertex);
+		}
+		for (uint32_t face_vertex_number = 0; face_vertex_number < face.edge_count; ++face_vertex_number) {
+			map.surfedges.push_back(bs2pc::surfedge(map.edges.size()));
+			map.edges.push_back(bs2pc::edge{{
+				uint16_t(first_vertex + face_vertex_number),
+				uint16_t(first_vertex + (face_vertex_number + 1) % face.edge_count),
+			}});
+		}
+
+		bs2pc::id_texinfo texinfo;
+		float const texture_scale = random_float(random, 0.5f, 2.0f);
+		float const texture_rotation = random_float(random, 0.0f, 6.2831853f);
+		for (size_t axis = 0; axis < 3; ++axis) {
+			texinfo.vectors[0].v[axis] =
+					(std::cos(texture_rotation) * u.v[axis] + std::sin(texture_rotation) * v.v[axis]) / texture_scale;
+			texinfo.vectors[1].v[axis] =
+					(std::cos(texture_rotation) * v.v[axis] - std::sin(texture_rotation) * u.v[axis]) / texture_scale;
+		}
+		texinfo.vectors[0].v[3] = random_float(random, -64.0f, 64.0f);
+		texinfo.vectors[1].v[3] = random_float(random, -64.0f, 64.0f);
+		texinfo.texture_number = texture_number;
+		texinfo.flags = is_liquid_or_sky ? uint32_t(bs2pc::id_texinfo_flag_special) : uint32_t(0);
+		map.texinfo.push_back(texinfo);
+
+		// Lighting with one or two styles, 24-bit.
+		int16_t extents[2];
+		face.calculate_extents(
+				texinfo, map.surfedges.data(), map.edges.data(), map.vertexes.data(), nullptr, extents);
+		uint32_t const style_count = random_below(random, 5) ? 1 : 2;
+		for (uint32_t style_number = 0; style_number < bs2pc::max_lightmaps; ++style_number) {
+			face.styles[style_number] = style_number < style_count ? uint8_t(style_number) : uint8_t(255);
+		}
+		std::vector<uint8_t> & lighting = map.lighting.modify();
+		face.lighting_offset = uint32_t(lighting.size());
+		lighting.resize(lighting.size() + size_t(3) * style_count * (extents[0] / 16 + 1) * (extents[1] / 16 + 1));
+		for (size_t lighting_byte_number = face.lighting_offset;
+				lighting_byte_number < lighting.size();
+				++lighting_byte_number) {
+			lighting[lighting_byte_number] = uint8_t(random_below(random, 256));
+		}
+		map.faces.push_back(face);
+	}
+
+	int16_t map_mins_int[3], map_maxs_int[3];
+	for (size_t axis = 0; axis < 3; ++axis) {
+		map_mins_int[axis] = int16_t(std::floor(map_mins.v[axis]));
+		map_maxs_int[axis] = int16_t(std::ceil(map_maxs.v[axis]));
+	}
+
+	// One node splitting the world into a solid leaf and an empty leaf containing all the faces.
+	bs2pc::id_node node;
+	node.plane_number = 0;
+	node.children[0] = -2;
+	node.children[1] = -1;
+	std::memcpy(node.mins, map_mins_int, sizeof(node.mins));
+	std::memcpy(node.maxs, map_maxs_int, sizeof(node.maxs));
+	node.first_face = 0;
+	node.face_count = uint16_t(face_count);
+	map.nodes.push_back(node);
+
+	bs2pc::id_leaf leaf = {};
+	leaf.leaf_contents = bs2pc::contents_solid;
+	leaf.visibility_offset = UINT32_MAX;
+	map.leafs.push_back(leaf);
+	leaf.leaf_contents = bs2pc::contents_empty;
+	leaf.visibility_offset = 0;
+	std::memcpy(leaf.mins, map_mins_int, sizeof(leaf.mins));
+	std::memcpy(leaf.maxs, map_maxs_int, sizeof(leaf.maxs));
+	leaf.first_marksurface = 0;
+	leaf.marksurface_count = uint16_t(face_count);
+	map.leafs.push_back(leaf);
+	for (uint32_t face_number = 0; face_number < face_count; ++face_number) {
+		map.marksurfaces.push_back(bs2pc::id_marksurface(face_number));
+	}
+	map.visibility.modify().push_back(UINT8_C(0xFF));
+
+	map.clipnodes.push_back(bs2pc::clipnode{0, {bs2pc::contents_empty, bs2pc::contents_solid}});
+
+	bs2pc::id_model model = {};
+	model.mins = map_mins;
+	model.maxs = map_maxs;
+	model.visibility_leafs = 1;
+	model.first_face = 0;
+	model.face_count = face_count;
+	map.models.push_back(model);
+
+	return map;
+}
+
+// Timing.
+
+struct bench_stage_result {
+	std::string name;
+	// The amount of input data processed in one iteration, for the throughput.
+	size_t bytes;
+	std::vector<uint64_t> iteration_nanoseconds;
+};
+
+// The preparation is not timed, and is done before every iteration, for stages that modify their inputs.
+static bench_stage_result run_bench_stage(
+		char const * const name, size_t const bytes, uint32_t const iteration_count,
+		std::function<void()> const & prepare, std::function<void()> const & run) {
+	bench_stage_result result;
+	result.name = name;
+	result.bytes = bytes;
+	result.iteration_nanoseconds.reserve(iteration_count);
+	for (uint32_t iteration_number = 0; iteration_number < iteration_count; ++iteration_number) {
+		if (prepare) {
+			prepare();
+		}
+		std::chrono::steady_clock::time_point const start_time = std::chrono::steady_clock::now();
+		run();
+		std::chrono::steady_clock::time_point const end_time = std::chrono::steady_clock::now();
+		result.iteration_nanoseconds.push_back(uint64_t(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count()));
+	}
+	return result;
+}
+
+// Writes the results as JSON, one stage per line, with the keys always in the same order.
+static void write_bench_results_json(
+		std::ostream & output,
+		uint32_t const seed, uint32_t const face_count, uint32_t const iteration_count,
+		std::vector<bench_stage_result> const & results) {
+	output << "{\n";
+	output << "\t\"format\": \"bs2pc_bench\",\n";
+	output << "\t\"format_version\": 1,\n";
+	output << "\t\"seed\": " << seed << ",\n";
+	output << "\t\"faces\": " << face_count << ",\n";
+	output << "\t\"iterations\": " << iteration_count << ",\n";
+	output << "\t\"stages\": [";
+	for (size_t result_number = 0; result_number < results.size(); ++result_number) {
+		bench_stage_result const & result = results[result_number];
+		std::vector<uint64_t> sorted_nanoseconds = result.iteration_nanoseconds;
+		std::sort(sorted_nanoseconds.begin(), sorted_nanoseconds.end());
+		uint64_t const min_nanoseconds = sorted_nanoseconds.front();
+		uint64_t const median_nanoseconds = sorted_nanoseconds[sorted_nanoseconds.size() / 2];
+		uint64_t total_nanoseconds = 0;
+		for (uint64_t const nanoseconds : sorted_nanoseconds) {
+			total_nanoseconds += nanoseconds;
+		}
+		// Throughput of the median iteration, in bytes per second.
+		uint64_t const bytes_per_second =
+				median_nanoseconds ? uint64_t(double(result.bytes) * 1.0e9 / double(median_nanoseconds)) : 0;
+		output << (result_number ? ",\n" : "\n") <<
+				"\t\t{\"name\": \"" << result.name << "\", " <<
+				"\"bytes\": " << result.bytes << ", " <<
+				"\"min_ns\": " << min_nanoseconds << ", " <<
+				"\"median_ns\": " << median_nanoseconds << ", " <<
+				"\"mean_ns\": " << total_nanoseconds / sorted_nanoseconds.size() << ", " <<
+				"\"median_bytes_per_second\": " << bytes_per_second << "}";
+	}
+	output << "\n\t]\n";
+	output << "}\n";
+}
+
+int main(int const argument_count, char const * const * const arguments) {
+	uint32_t seed = 1;
+	uint32_t face_count = 1000;
+	uint32_t iteration_count = 10;
+	size_t compress_thread_count = 1;
+	size_t polygon_thread_count = 1;
+	std::filesystem::path output_path;
+	// If empty, all stages are run.
+	std::vector<std::string> stage_names;
+
+	enum class argument_type {
+		option,
+		compress_thread_count,
+		polygon_thread_count,
+		face_count,
+		iteration_count,
+		output,
+		seed,
+		stage_name,
+	};
+	argument_type next_argument_type = argument_type::option;
+
+	for (int argument_index = 1; argument_index < argument_count; ++argument_index) {
+		char const * const argument = arguments[argument_index];
+		if (next_argument_type == argument_type::option) {
+			char const * const option = argument[0] == '-' ? argument + 1 : "";
+			if (!std::strcmp(option, "o") || !std::strcmp(option, "output")) {
+				next_argument_type = argument_type::output;
+			} else if (!std::strcmp(option, "compressjobs")) {
+				next_argument_type = argument_type::compress_thread_count;
+			} else if (!std::strcmp(option, "faces")) {
+				next_argument_type = argument_type::face_count;
+			} else if (!std::strcmp(option, "iterations")) {
+				next_argument_type = argument_type::iteration_count;
+			} else if (!std::strcmp(option, "polygonjobs")) {
+				next_argument_type = argument_type::polygon_thread_count;
+			} else if (!std::strcmp(option, "seed")) {
+				next_argument_type = argument_type::seed;
+			} else if (!std::strcmp(option, "stage")) {
+				next_argument_type = argument_type::stage_name;
+			} else {
+				std::cerr <<
+						"BS2PC stage benchmark.\n"
+						"\n"
+						"Usage: " << std::filesystem::path(arguments[0]).stem().string() << " -option value\n"
+						"\n"
+						"Generates a synthetic Half-Life map and textures, and times each stage of the conversion "
+						"separately.\n"
+						"The results are written as JSON with the minimum, the median and the mean time of the "
+						"iterations of each stage in nanoseconds, and the throughput of the median iteration.\n"
+						"\n"
+						"Options:\n"
+						"-o / -output: Path to write the results to instead of the standard output.\n"
+						"-compressjobs: Number of threads for compress_gbx_map (0 for the number of hardware threads, "
+						"1 by default).\n"
+						"-faces: Number of faces on the synthetic map (1000 by default, up to 7000).\n"
+						"-iterations: Number of times each stage is run (10 by default).\n"
+						"-polygonjobs: Number of threads for gbx_map::make_polygons (0 for the number of hardware "
+						"threads, 1 by default).\n"
+						"-seed: Seed of the synthetic data (1 by default).\n"
+						"-stage: Name of a stage to run, such as gbx_map::serialize (may be specified multiple times, "
+						"all stages are run by default).\n";
+				return EXIT_FAILURE;
+			}
+		} else {
+			switch (next_argument_type) {
+				case argument_type::compress_thread_count:
+					compress_thread_count = size_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::face_count:
+					face_count = uint32_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::iteration_count:
+					iteration_count = uint32_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::polygon_thread_count:
+					polygon_thread_count = size_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::output:
+					output_path = argument;
+					break;
+				case argument_type::seed:
+					seed = uint32_t(std::strtoul(argument, nullptr, 0));
+					break;
+				case argument_type::stage_name:
+					stage_names.emplace_back(argument);
+					break;
+				default:
+					break;
+			}
+			next_argument_type = argument_type::option;
+		}
+	}
+	// Up to 9 vertexes per face, and 16-bit vertex, face and marksurface numbers.
+	if (!face_count || face_count > 7000) {
+		std::cerr << "The number of faces must be between 1 and 7000." << std::endl;
+		return EXIT_FAILURE;
+	}
+	iteration_count = std::max(iteration_count, uint32_t(1));
+	if (!compress_thread_count) {
+		compress_thread_count = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+	}
+	if (!polygon_thread_count) {
+		polygon_thread_count = std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+	}
+
+	bs2pc::palette_set const quake_palette(bs2pc::quake_default_palette);
+
+	std::cerr << "Generating a synthetic map with " << face_count << " faces..." << std::endl;
+	bs2pc::id_map const map_id_source = generate_map(seed, face_count);
+
+	// Prepare the inputs for all stages by running the whole conversion once.
+	std::vector<char> map_id_serialized;
+	map_id_source.serialize(map_id_serialized, quake_palette.id);
+	bs2pc::id_map map_id_deserialized;
+	{
+		char const * const deserialize_error = map_id_deserialized.deserialize(
+				map_id_serialized.data(), map_id_serialized.size(), false, quake_palette.id);
+		if (deserialize_error) {
+			std::cerr << "Failed to deserialize the synthetic map: " << deserialize_error << '.' << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+	bs2pc::gbx_map map_gbx_without_polygons;
+	map_gbx_without_polygons.from_id_no_texture_pixels_and_polygons(map_id_deserialized);
+	size_t texture_pixels_bytes = 0;
+	for (size_t texture_number = 0; texture_number < map_id_deserialized.textures.size(); ++texture_number) {
+		bs2pc::id_texture_deserialized const & texture_id = map_id_deserialized.textures[texture_number];
+		map_gbx_without_polygons.textures[texture_number].pixels_and_palette_from_id(texture_id, quake_palette.id);
+		texture_pixels_bytes += texture_id.pixels->size();
+	}
+	bs2pc::gbx_map map_gbx = map_gbx_without_polygons;
+	map_gbx.make_polygons(map_gbx.polygons.data(), map_gbx.polygons.size());
+	std::vector<char> map_gbx_serialized;
+	map_gbx.serialize(map_gbx_serialized, quake_palette);
+	std::vector<char> map_gbx_compressed;
+	if (!bs2pc::compress_gbx_map(
+			map_gbx_serialized.data(), map_gbx_serialized.size(), map_gbx_compressed, compress_thread_count)) {
+		std::cerr << "Failed to compress the synthetic map." << std::endl;
+		return EXIT_FAILURE;
+	}
+	{
+		bs2pc::gbx_map map_gbx_deserialized;
+		char const * const deserialize_error =
+				map_gbx_deserialized.deserialize(map_gbx_serialized.data(), map_gbx_serialized.size(), quake_palette);
+		if (deserialize_error) {
+			std::cerr << "Failed to deserialize the converted synthetic map: " << deserialize_error << '.' <<
+					std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The outputs are reused between iterations, so allocation is mostly not measured, like when converting multiple
+	// maps in a row.
+	bs2pc::id_map map_id_output;
+	bs2pc::gbx_map map_gbx_output;
+	std::vector<char> serialized_output;
+	std::vector<bs2pc::texture_deserialized_pixels> texture_pixels_output(map_id_deserialized.textures.size());
+	bs2pc::texture_palette_analysis_cache texture_palette_analysis_cache;
+	for (size_t texture_number = 0; texture_number < map_gbx_without_polygons.textures.size(); ++texture_number) {
+		texture_pixels_output[texture_number].resize(map_gbx_without_polygons.textures[texture_number].pixels->size());
+	}
+
+	struct bench_stage {
+		char const * name;
+		size_t bytes;
+		std::function<void()> prepare;
+		std::function<void()> run;
+	};
+	bench_stage const stages[] = {
+		{
+			"id_map::deserialize",
+			map_id_serialized.size(),
+			nullptr,
+			[&]() {
+				map_id_output.deserialize(map_id_serialized.data(), map_id_serialized.size(), false, quake_palette.id);
+			},
+		},
+		{
+			"id_map::serialize",
+			map_id_serialized.size(),
+			nullptr,
+			[&]() {
+				map_id_deserialized.serialize(serialized_output, quake_palette.id);
+			},
+		},
+		{
+			"gbx_map::from_id_no_texture_pixels_and_polygons",
+			map_id_serialized.size(),
+			[&]() {
+				map_gbx_output = bs2pc::gbx_map();
+			},
+			[&]() {
+				map_gbx_output.from_id_no_texture_pixels_and_polygons(map_id_deserialized);
+			},
+		},
+		{
+			"convert_texture_pixels",
+			texture_pixels_bytes,
+			nullptr,
+			[&]() {
+				for (size_t texture_number = 0; texture_number < map_id_deserialized.textures.size(); ++texture_number) {
+					bs2pc::id_texture_deserialized const & texture_id = map_id_deserialized.textures[texture_number];
+					bs2pc::gbx_texture_deserialized const & texture_gbx =
+							map_gbx_without_polygons.textures[texture_number];
+					bs2pc::convert_texture_pixels(
+							texture_id.name.c_str()[0] == '{', *texture_id.palette,
+							texture_pixels_output[texture_number].data(),
+							texture_gbx.scaled_width, texture_gbx.scaled_height, texture_gbx.mip_levels,
+							texture_id.pixels->data(), texture_id.width, texture_id.height,
+							bs2pc::id_texture_mip_levels - 1,
+							nullptr, &texture_palette_analysis_cache);
+				}
+			},
+		},
+		{
+			"is_texture_data_identical",
+			texture_pixels_bytes,
+			nullptr,
+			[&]() {
+				for (size_t texture_number = 0; texture_number < map_id_deserialized.textures.size(); ++texture_number) {
+					bs2pc::is_texture_data_identical(
+							map_id_deserialized.textures[texture_number],
+							map_gbx_without_polygons.textures[texture_number],
+							quake_palette);
+				}
+			},
+		},
+		{
+			"gbx_map::make_polygons",
+			map_gbx_serialized.size(),
+			[&]() {
+				map_gbx_output = map_gbx_without_polygons;
+			},
+			[&]() {
+				map_gbx_output.make_polygons(
+						map_gbx_output.polygons.data(), map_gbx_output.polygons.size(), polygon_thread_count);
+			},
+		},
+		{
+			"gbx_map::serialize",
+			map_gbx_serialized.size(),
+			nullptr,
+			[&]() {
+				map_gbx.serialize(serialized_output, quake_palette);
+			},
+		},
+		{
+			"gbx_map::deserialize",
+			map_gbx_serialized.size(),
+			nullptr,
+			[&]() {
+				map_gbx_output.deserialize(map_gbx_serialized.data(), map_gbx_serialized.size(), quake_palette);
+			},
+		},
+		{
+			"id_map::from_gbx_no_texture_pixels",
+			map_gbx_serialized.size(),
+			[&]() {
+				map_id_output = bs2pc::id_map();
+			},
+			[&]() {
+				map_id_output.from_gbx_no_texture_pixels(map_gbx);
+			},
+		},
+		{
+			"compress_gbx_map",
+			map_gbx_serialized.size(),
+			nullptr,
+			[&]() {
+				bs2pc::compress_gbx_map(
+						map_gbx_serialized.data(), map_gbx_serialized.size(), serialized_output,
+						compress_thread_count);
+			},
+		},
+		{
+			"gbx_map::serialize+compress_gbx_map",
+			map_gbx_serialized.size(),
+			nullptr,
+			[&]() {
+				bs2pc::gbx_map_compression_stream compression_stream(serialized_output, compress_thread_count);
+				map_gbx.serialize(compression_stream, quake_palette);
+			},
+		},
+		{
+			"decompress_gbx_map",
+			map_gbx_serialized.size(),
+			nullptr,
+			[&]() {
+				bs2pc::decompress_gbx_map(map_gbx_compressed.data(), map_gbx_compressed.size(), serialized_output);
+			},
+		},
+	};
+
+	std::vector<bench_stage_result> results;
+	for (bench_stage const & stage : stages) {
+		if (!stage_names.empty() &&
+				std::find(stage_names.cbegin(), stage_names.cend(), stage.name) == stage_names.cend()) {
+			continue;
+		}
+		results.push_back(run_bench_stage(stage.name, stage.bytes, iteration_count, stage.prepare, stage.run));
+		std::cerr << "Ran " << stage.name << "." << std::endl;
+	}
+	if (results.empty()) {
+		std::cerr << "No stages with the specified names." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (output_path.empty()) {
+		write_bench_results_json(std::cout, seed, face_count, iteration_count, results);
+	} else {
+		std::ofstream output_stream(output_path, std::ios_base::out | std::ios_base::binary);
+		if (!output_stream.is_open()) {
+			std::cerr << "Failed to open " << output_path.string() << " for writing." << std::endl;
+			return EXIT_FAILURE;
+		}
+		write_bench_results_json(output_stream, seed, face_count, iteration_count, results);
+		if (!output_stream) {
+			std::cerr << "Failed to write " << output_path.string() << "." << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -2,8 +2,12 @@
 
 #include "../zlib/zlib.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <thread>
 
 namespace bs2pc {
 
@@ -16,55 +20,310 @@ bool is_gbx_map_compressed(void const * const map_file, size_t const map_file_si
 			uint8_t(map_bytes[sizeof(uint32_t) + 1]) == gbx_map_zlib_flg;
 }
 
-bool compress_gbx_map(void const * const uncompressed, size_t const uncompressed_size, std::vector<char> & compressed) {
-	if (uncompressed_size > UINT32_MAX) {
-		// Gearbox map files store a 32-bit uncompressed size.
-		return false;
-	}
-	// Make sure the uncompressed size can be used as all types it's used as.
-	if (uncompressed_size != uInt(uncompressed_size) || uncompressed_size != uLong(uncompressed_size)) {
-		return false;
-	}
+// Multithreaded compression splits the map into blocks of this size, each deflated independently, but with the
+// preceding 32 KB of the uncompressed data as the preset dictionary so the compression ratio is barely affected.
+// The output only depends on the block size, not on the number of threads.
+static constexpr size_t gbx_map_parallel_block_size = size_t(1) << 17;
+
+struct gbx_map_parallel_block {
+	std::vector<Bytef> deflated;
+	uLong adler;
+	bool succeeded;
+};
+
+// The dictionary is the uncompressed data preceding the block, up to the window size.
+static bool deflate_gbx_map_parallel_block(
+		Bytef const * const block_uncompressed,
+		size_t const block_size,
+		size_t const dictionary_size,
+		bool const is_last_block,
+		gbx_map_parallel_block & block) {
+	block.adler = adler32(adler32(0, nullptr, 0), block_uncompressed, uInt(block_size));
 	z_stream stream;
 	stream.zalloc = nullptr;
 	stream.zfree = nullptr;
 	stream.opaque = nullptr;
-	if (deflateInit2(&stream, gbx_map_zlib_level, Z_DEFLATED, gbx_map_zlib_window_bits, 8, Z_DEFAULT_STRATEGY) !=
+	// Raw deflate without the zlib header and trailer, which are written once for the whole stream.
+	if (deflateInit2(&stream, gbx_map_zlib_level, Z_DEFLATED, -gbx_map_zlib_window_bits, 8, Z_DEFAULT_STRATEGY) !=
 			Z_OK) {
 		return false;
 	}
-	stream.next_in = const_cast<Bytef z_const *>(reinterpret_cast<Bytef const *>(uncompressed));
-	stream.avail_in = uInt(uncompressed_size);
-	uLong const deflate_bound = deflateBound(&stream, uLong(uncompressed_size));
-	// Make sure the upper bound can be used as all types it's used as,
-	// and also that both the uncompressed size and the compressed data can be stored in a vector.
-	if (deflate_bound != size_t(deflate_bound) || SIZE_MAX - size_t(deflate_bound) < sizeof(uint32_t) ||
-			deflate_bound != uInt(deflate_bound)) {
-		deflateEnd(&stream);
-		return false;
+	if (dictionary_size) {
+		if (deflateSetDictionary(&stream, block_uncompressed - dictionary_size, uInt(dictionary_size)) != Z_OK) {
+			deflateEnd(&stream);
+			return false;
+		}
 	}
-	// Make sure any potential unwritten bytes are zero for deterministic conversion.
-	compressed.clear();
-	compressed.resize(sizeof(uint32_t) + size_t(deflate_bound));
-	stream.next_out = reinterpret_cast<Bytef *>(compressed.data() + sizeof(uint32_t));
+	// Extra space for the empty stored block written by the sync flush.
+	uLong const deflate_bound = deflateBound(&stream, uLong(block_size)) + 16;
+	block.deflated.clear();
+	block.deflated.resize(size_t(deflate_bound));
+	stream.next_in = const_cast<Bytef z_const *>(block_uncompressed);
+	stream.avail_in = uInt(block_size);
+	stream.next_out = block.deflated.data();
 	stream.avail_out = uInt(deflate_bound);
-	int const deflate_result = deflate(&stream, Z_FINISH);
+	// The sync flush aligns the end of the block to a byte boundary without marking it as the final one, so the next
+	// block can be appended directly.
+	int const deflate_result = deflate(&stream, is_last_block ? Z_FINISH : Z_SYNC_FLUSH);
 	deflateEnd(&stream);
-	if (deflate_result != Z_STREAM_END) {
-		return false;
+	if (is_last_block) {
+		if (deflate_result != Z_STREAM_END) {
+			return false;
+		}
+	} else {
+		// If the output buffer was filled completely, the flush may be incomplete.
+		if (deflate_result != Z_OK || stream.avail_in || !stream.avail_out) {
+			return false;
+		}
+	}
+	block.deflated.resize(block.deflated.size() - stream.avail_out);
+	return true;
+}
+
+// For multithreaded compression, the blocks are deflated in batches of this many blocks per thread, so only a part of
+// the uncompressed map needs to be kept in memory.
+static constexpr size_t gbx_map_parallel_batch_blocks_per_thread = 2;
+
+bool compress_gbx_map(
+		void const * const uncompressed,
+		size_t const uncompressed_size,
+		std::vector<char> & compressed,
+		size_t const thread_count) {
+	gbx_map_compression_stream compression_stream(compressed, thread_count);
+	return compression_stream.begin(uncompressed_size) &&
+			compression_stream.write(uncompressed, uncompressed_size) &&
+			compression_stream.end();
+}
+
+gbx_map_compression_stream::gbx_map_compression_stream(std::vector<char> & compressed, size_t const thread_count) :
+		compressed(compressed),
+		thread_count(thread_count),
+		stream(std::make_unique<z_stream>()) {}
+
+gbx_map_compression_stream::~gbx_map_compression_stream() {
+	reset();
+}
+
+void gbx_map_compression_stream::reset() {
+	if (stream_initialized) {
+		deflateEnd(stream.get());
+		stream_initialized = false;
 	}
-	// Truncate the output since the upper bound may be larger than the compressed size.
-	if (stream.avail_out > deflate_bound) {
+	failed = false;
+	uncompressed_size = 0;
+	written_size = 0;
+	compressed_size = 0;
+	parallel = false;
+	// Release the memory, not only clear, as the batches may be large.
+	std::vector<uint8_t>().swap(pending);
+	pending_dictionary_size = 0;
+	adler = adler32(0, nullptr, 0);
+}
+
+bool gbx_map_compression_stream::begin(size_t const uncompressed_size) {
+	reset();
+	compressed.clear();
+	if (uncompressed_size > UINT32_MAX) {
+		// Gearbox map files store a 32-bit uncompressed size.
+		failed = true;
 		return false;
 	}
-	compressed.resize(compressed.size() - stream.avail_out);
-	// Gearbox maps store the compressed size in the beginning.
-	uint32_t uncompressed_size_32 = uint32_t(uncompressed_size);
+	this->uncompressed_size = uncompressed_size;
+	// Gearbox maps store the uncompressed size in the beginning.
+	uint32_t const uncompressed_size_32 = uint32_t(uncompressed_size);
+	compressed.resize(sizeof(uint32_t));
 	std::memcpy(compressed.data(), &uncompressed_size_32, sizeof(uint32_t));
+	compressed_size = sizeof(uint32_t);
+	if (thread_count > 1 && uncompressed_size > gbx_map_parallel_block_size) {
+		parallel = true;
+		compressed.push_back(char(gbx_map_zlib_cmf));
+		compressed.push_back(char(gbx_map_zlib_flg));
+		pending.reserve(
+				(size_t(1) << gbx_map_zlib_window_bits) +
+				gbx_map_parallel_block_size * gbx_map_parallel_batch_blocks_per_thread * thread_count);
+		return true;
+	}
+	stream->zalloc = nullptr;
+	stream->zfree = nullptr;
+	stream->opaque = nullptr;
+	if (deflateInit2(stream.get(), gbx_map_zlib_level, Z_DEFLATED, gbx_map_zlib_window_bits, 8, Z_DEFAULT_STRATEGY) !=
+			Z_OK) {
+		failed = true;
+		return false;
+	}
+	stream_initialized = true;
+	return true;
+}
+
+bool gbx_map_compression_stream::deflate_to_compressed(int const flush) {
+	while (true) {
+		// Grow the output geometrically, the part of it beyond compressed_size is dropped in the end.
+		if (compressed.size() - compressed_size < (size_t(1) << 16)) {
+			compressed.resize(std::max(compressed.size() * 2, compressed_size + (size_t(1) << 16)));
+		}
+		stream->next_out = reinterpret_cast<Bytef *>(compressed.data() + compressed_size);
+		stream->avail_out = uInt(std::min(compressed.size() - compressed_size, size_t(UINT32_MAX)));
+		int const deflate_result = deflate(stream.get(), flush);
+		compressed_size = size_t(reinterpret_cast<char *>(stream->next_out) - compressed.data());
+		if (deflate_result != Z_OK && deflate_result != Z_STREAM_END && deflate_result != Z_BUF_ERROR) {
+			return false;
+		}
+		if (flush == Z_FINISH ? deflate_result == Z_STREAM_END : (!stream->avail_in && stream->avail_out)) {
+			return true;
+		}
+	}
+}
+
+bool gbx_map_compression_stream::deflate_pending_blocks() {
+	size_t const pending_blocks_size = pending.size() - pending_dictionary_size;
+	size_t const block_count = (pending_blocks_size + (gbx_map_parallel_block_size - 1)) / gbx_map_parallel_block_size;
+	if (!block_count) {
+		return true;
+	}
+	Bytef const * const pending_blocks = pending.data() + pending_dictionary_size;
+	std::vector<gbx_map_parallel_block> blocks(block_count);
+	std::atomic<size_t> next_batch_block_index(0);
+	auto const deflate_blocks = [&]() {
+		while (true) {
+			size_t const batch_block_index = next_batch_block_index.fetch_add(1, std::memory_order_relaxed);
+			if (batch_block_index >= block_count) {
+				break;
+			}
+			size_t const block_offset = gbx_map_parallel_block_size * batch_block_index;
+			size_t const block_size = std::min(pending_blocks_size - block_offset, gbx_map_parallel_block_size);
+			size_t const block_dictionary_size =
+					std::min(pending_dictionary_size + block_offset, size_t(1) << gbx_map_zlib_window_bits);
+			bool const is_last_block =
+					written_size - pending_blocks_size + block_offset + block_size >= uncompressed_size;
+			gbx_map_parallel_block & block = blocks[batch_block_index];
+			block.succeeded = deflate_gbx_map_parallel_block(
+					pending_blocks + block_offset, block_size, block_dictionary_size, is_last_block, block);
+		}
+	};
+	// The calling thread deflates blocks too.
+	std::vector<std::thread> threads;
+	size_t const additional_thread_count = std::min(thread_count, block_count) - 1;
+	threads.reserve(additional_thread_count);
+	for (size_t thread_index = 0; thread_index < additional_thread_count; ++thread_index) {
+		threads.emplace_back(deflate_blocks);
+	}
+	deflate_blocks();
+	for (std::thread & thread : threads) {
+		thread.join();
+	}
+	// Append the blocks to the zlib stream.
+	for (size_t batch_block_index = 0; batch_block_index < block_count; ++batch_block_index) {
+		gbx_map_parallel_block const & block = blocks[batch_block_index];
+		if (!block.succeeded) {
+			return false;
+		}
+		compressed.insert(compressed.end(), block.deflated.cbegin(), block.deflated.cend());
+		size_t const block_size = std::min(
+				pending_blocks_size - gbx_map_parallel_block_size * batch_block_index, gbx_map_parallel_block_size);
+		adler = adler32_combine(adler, block.adler, z_off_t(block_size));
+	}
+	// Keep the end of the data as the dictionary for the next block.
+	size_t const next_dictionary_size = std::min(pending.size(), size_t(1) << gbx_map_zlib_window_bits);
+	pending.erase(pending.begin(), pending.end() - next_dictionary_size);
+	pending_dictionary_size = next_dictionary_size;
+	return true;
+}
+
+bool gbx_map_compression_stream::write(void const * const data, size_t const size) {
+	if (failed || size > uncompressed_size - written_size) {
+		failed = true;
+		return false;
+	}
+	Bytef const * const data_bytes = reinterpret_cast<Bytef const *>(data);
+	if (!parallel) {
+		size_t data_offset = 0;
+		while (data_offset < size) {
+			// Make sure the size can be used as all types it's used as.
+			size_t const data_part_size = std::min(size - data_offset, size_t(UINT32_MAX));
+			stream->next_in = const_cast<Bytef z_const *>(data_bytes + data_offset);
+			stream->avail_in = uInt(data_part_size);
+			if (!deflate_to_compressed(Z_NO_FLUSH)) {
+				failed = true;
+				return false;
+			}
+			data_offset += data_part_size;
+		}
+		written_size += size;
+		return true;
+	}
+	// Deflate full batches of blocks as soon as they're available.
+	size_t const batch_size = gbx_map_parallel_block_size * gbx_map_parallel_batch_blocks_per_thread * thread_count;
+	size_t data_offset = 0;
+	while (data_offset < size) {
+		size_t const data_part_size =
+				std::min(size - data_offset, batch_size - (pending.size() - pending_dictionary_size));
+		pending.insert(pending.end(), data_bytes + data_offset, data_bytes + data_offset + data_part_size);
+		written_size += data_part_size;
+		data_offset += data_part_size;
+		if (pending.size() - pending_dictionary_size >= batch_size) {
+			if (!deflate_pending_blocks()) {
+				failed = true;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool gbx_map_compression_stream::end() {
+	if (failed || written_size != uncompressed_size) {
+		failed = true;
+		return false;
+	}
+	if (!parallel) {
+		stream->next_in = nullptr;
+		stream->avail_in = 0;
+		if (!deflate_to_compressed(Z_FINISH)) {
+			failed = true;
+			return false;
+		}
+		deflateEnd(stream.get());
+		stream_initialized = false;
+		compressed.resize(compressed_size);
+		return true;
+	}
+	if (!deflate_pending_blocks()) {
+		failed = true;
+		return false;
+	}
+	// The zlib stream stores the Adler-32 checksum in big endian.
+	for (uint32_t adler_shift = 32; adler_shift; adler_shift -= 8) {
+		compressed.push_back(char(uint8_t(adler >> (adler_shift - 8))));
+	}
 	return true;
 }
 
 bool decompress_gbx_map(void const * const compressed, size_t const compressed_size, std::vector<char> & uncompressed) {
+	gbx_map_decompression_stream decompression_stream;
+	return decompression_stream.begin(compressed, compressed_size, uncompressed) &&
+			decompression_stream.decompress(SIZE_MAX) && decompression_stream.is_finished();
+}
+
+gbx_map_decompression_stream::gbx_map_decompression_stream() : stream(std::make_unique<z_stream>()) {}
+
+gbx_map_decompression_stream::~gbx_map_decompression_stream() {
+	end();
+}
+
+void gbx_map_decompression_stream::end() {
+	if (stream_initialized) {
+		inflateEnd(stream.get());
+		stream_initialized = false;
+	}
+	uncompressed = nullptr;
+	uncompressed_size = 0;
+	finished = false;
+}
+
+bool gbx_map_decompression_stream::begin(
+		void const * const compressed, size_t const compressed_size, std::vector<char> & uncompressed) {
+	end();
+	uncompressed.clear();
 	if (compressed_size < sizeof(uint32_t)) {
 		// The uncompressed size is out of bounds.
 		return false;
@@ -80,24 +339,46 @@ bool decompress_gbx_map(void const * const compressed, size_t const compressed_s
 	if (uncompressed_size_32 != size_t(uncompressed_size_32) || uncompressed_size_32 != uInt(uncompressed_size_32)) {
 		return false;
 	}
-	z_stream stream;
-	stream.next_in = const_cast<Bytef z_const *>(reinterpret_cast<Bytef const *>(compressed) + sizeof(uint32_t));
-	stream.avail_in = uInt(compressed_stream_size);
-	stream.zalloc = nullptr;
-	stream.zfree = nullptr;
-	stream.opaque = nullptr;
-	if (inflateInit(&stream) != Z_OK) {
+	stream->next_in = const_cast<Bytef z_const *>(reinterpret_cast<Bytef const *>(compressed) + sizeof(uint32_t));
+	stream->avail_in = uInt(compressed_stream_size);
+	stream->zalloc = nullptr;
+	stream->zfree = nullptr;
+	stream->opaque = nullptr;
+	if (inflateInit(stream.get()) != Z_OK) {
 		return false;
 	}
+	stream_initialized = true;
+	this->uncompressed = &uncompressed;
+	uncompressed_size = size_t(uncompressed_size_32);
+	return true;
+}
+
+bool gbx_map_decompression_stream::decompress(size_t const size) {
+	if (!stream_initialized) {
+		return false;
+	}
+	size_t const decompressed_size = uncompressed->size();
+	size_t const target_size = std::min(size, uncompressed_size);
+	if (finished || (target_size <= decompressed_size && target_size < uncompressed_size)) {
+		return true;
+	}
 	// Make sure any potential unwritten bytes are zero for deterministic conversion,
 	// though the size shouldn't be different than the actual compressed data size, but the size is stored externally.
-	uncompressed.clear();
-	uncompressed.resize(size_t(uncompressed_size_32));
-	stream.next_out = reinterpret_cast<Bytef *>(uncompressed.data());
-	stream.avail_out = uInt(uncompressed_size_32);
-	int const inflate_result = inflate(&stream, Z_FINISH);
-	inflateEnd(&stream);
-	return inflate_result == Z_STREAM_END;
+	uncompressed->resize(target_size);
+	stream->next_out = reinterpret_cast<Bytef *>(uncompressed->data() + decompressed_size);
+	stream->avail_out = uInt(target_size - decompressed_size);
+	// At the end of the map, also make sure the stream ends there, and verify the checksum.
+	while (stream->avail_out || target_size == uncompressed_size) {
+		int const inflate_result = inflate(stream.get(), Z_NO_FLUSH);
+		if (inflate_result == Z_STREAM_END) {
+			finished = true;
+			break;
+		}
+		if (inflate_result != Z_OK) {
+			return false;
+		}
+	}
+	return true;
 }
 
 }
@@ -1,49 +1,166 @@
 #include "bs2pclib.hpp"
 
-#include <utility>
+#include <cassert>
+#include <cstring>
+#include <string_view>
 
 namespace bs2pc {
 
-std::vector<entity_key_values> deserialize_entities(char const * entities_string) {
-	std::vector<entity_key_values> entities;
+void entity_store::clear() {
+	strings.clear();
+	key_values.clear();
+	entity_first_key_values.clear();
+}
+
+void entity_store::add_entity() {
+	entity_first_key_values.push_back(key_values.size());
+}
+
+void entity_store::remove_last_entity() {
+	key_values.resize(entity_first_key_values.back());
+	entity_first_key_values.pop_back();
+}
+
+size_t entity_store::find_key(size_t const entity_number, std::string_view const key) const {
+	size_t const key_value_count = get_key_value_count(entity_number);
+	for (size_t key_value_number = 0; key_value_number < key_value_count; ++key_value_number) {
+		if (get_key(entity_number, key_value_number) == key) {
+			return key_value_number;
+		}
+	}
+	return SIZE_MAX;
+}
+
+size_t entity_store::append_string(std::string_view const string) {
+	size_t const offset = strings.size();
+	strings.append(string);
+	strings.push_back('\0');
+	return offset;
+}
+
+void entity_store::add_key_value(size_t const entity_number, std::string_view const key, std::string_view const value) {
+	key_value pair;
+	pair.key_offset = append_string(key);
+	pair.key_length = key.size();
+	pair.value_offset = append_string(value);
+	pair.value_length = value.size();
+	key_values.insert(key_values.cbegin() + get_key_value_end(entity_number), pair);
+	for (size_t next_entity_number = entity_number + 1;
+			next_entity_number < entity_first_key_values.size();
+			++next_entity_number) {
+		++entity_first_key_values[next_entity_number];
+	}
+}
+
+void entity_store::set_value(size_t const entity_number, size_t const key_value_number, std::string_view const value) {
+	key_value & pair = key_values[entity_first_key_values[entity_number] + key_value_number];
+	if (value.size() <= pair.value_length) {
+		// Fits in place of the old value.
+		char * const value_data = strings.data() + pair.value_offset;
+		std::memcpy(value_data, value.data(), value.size());
+		value_data[value.size()] = '\0';
+	} else {
+		pair.value_offset = append_string(value);
+	}
+	pair.value_length = value.size();
+}
+
+void entity_store::replace_value_prefix(
+		size_t const entity_number,
+		size_t const key_value_number,
+		size_t const prefix_length,
+		std::string_view const new_prefix) {
+	key_value & pair = key_values[entity_first_key_values[entity_number] + key_value_number];
+	assert(prefix_length <= pair.value_length);
+	size_t const suffix_length = pair.value_length - prefix_length;
+	size_t new_value_offset;
+	if (new_prefix.size() <= prefix_length) {
+		// Fits in place of the old value.
+		new_value_offset = pair.value_offset;
+		std::memmove(
+				strings.data() + new_value_offset + new_prefix.size(),
+				strings.data() + pair.value_offset + prefix_length,
+				suffix_length);
+	} else {
+		new_value_offset = strings.size();
+		strings.resize(new_value_offset + new_prefix.size() + suffix_length + 1);
+		std::memcpy(
+				strings.data() + new_value_offset + new_prefix.size(),
+				strings.data() + pair.value_offset + prefix_length,
+				suffix_length);
+	}
+	std::memcpy(strings.data() + new_value_offset, new_prefix.data(), new_prefix.size());
+	strings[new_value_offset + new_prefix.size() + suffix_length] = '\0';
+	pair.value_offset = new_value_offset;
+	pair.value_length = new_prefix.size() + suffix_length;
+}
+
+void entity_store::remove_key_value(size_t const entity_number, size_t const key_value_number) {
+	key_values.erase(key_values.cbegin() + (entity_first_key_values[entity_number] + key_value_number));
+	for (size_t next_entity_number = entity_number + 1;
+			next_entity_number < entity_first_key_values.size();
+			++next_entity_number) {
+		--entity_first_key_values[next_entity_number];
+	}
+}
+
+entity_store deserialize_entities(char const * entities_string) {
+	entity_store entities;
 	while (true) {
 		// Also checks if the string is empty. Not performing error checking though for simplicity.
-		if (parse_token(entities_string).c_str()[0] != '{') {
+		std::string_view const entity_start = parse_token(entities_string);
+		if (entity_start.empty() || entity_start[0] != '{') {
 			break;
 		}
-		entity_key_values entity;
+		entities.add_entity();
+		size_t const entity_number = entities.size() - 1;
 		while (true) {
-			std::string key = parse_token(entities_string);
-			if (key.c_str()[0] == '}') {
-				entities.emplace_back(std::move(entity));
+			std::string_view const key = parse_token(entities_string);
+			if (!key.empty() && key[0] == '}') {
 				break;
 			}
 			if (!entities_string[0]) {
 				// EOF without a closing brace.
+				entities.remove_last_entity();
 				break;
 			}
-			std::string value = parse_token(entities_string);
-			if (!entities_string[0] || value.c_str()[0] == '}') {
+			std::string_view const value = parse_token(entities_string);
+			if (!entities_string[0] || (!value.empty() && value[0] == '}')) {
 				// EOF without a closing brace, or a closing brace without data.
+				entities.remove_last_entity();
 				break;
 			}
 			// Keeping key names with a leading underscore (utility comments) for 1:1 conversion.
-			entity.emplace_back(std::move(key), std::move(value));
+			entities.add_key_value(entity_number, key, value);
 		}
 	}
 	return entities;
 }
 
-std::string serialize_entities(entity_key_values const * const entities, size_t const entity_count) {
+std::string serialize_entities(entity_store const & entities) {
+	size_t const entity_count = entities.size();
+	// Reserve the upper bound of the size, as the strings in the store may include replaced values.
+	size_t entities_string_size = 0;
+	for (size_t entity_number = 0; entity_number < entity_count; ++entity_number) {
+		size_t const key_value_count = entities.get_key_value_count(entity_number);
+		entities_string_size += sizeof("{\n") - 1 + sizeof("}\n") - 1;
+		for (size_t key_value_number = 0; key_value_number < key_value_count; ++key_value_number) {
+			entities_string_size +=
+					sizeof("\"\" \"\"\n") - 1 +
+					entities.get_key(entity_number, key_value_number).size() +
+					entities.get_value(entity_number, key_value_number).size();
+		}
+	}
 	std::string entities_string;
-	for (size_t i = 0; i < entity_count; ++i) {
-		entity_key_values const & entity = entities[i];
+	entities_string.reserve(entities_string_size);
+	for (size_t entity_number = 0; entity_number < entity_count; ++entity_number) {
+		size_t const key_value_count = entities.get_key_value_count(entity_number);
 		entities_string.append("{\n");
-		for (entity_key_value_pair const & entity_key_value : entity) {
+		for (size_t key_value_number = 0; key_value_number < key_value_count; ++key_value_number) {
 			entities_string.push_back('"');
-			entities_string.append(entity_key_value.first);
+			entities_string.append(entities.get_key(entity_number, key_value_number));
 			entities_string.append("\" \"");
-			entities_string.append(entity_key_value.second);
+			entities_string.append(entities.get_value(entity_number, key_value_number));
 			entities_string.append("\"\n");
 		}
 		entities_string.append("}\n");
@@ -51,75 +168,79 @@ std::string serialize_entities(entity_key_values const * const entities, size_t
 	return entities_string;
 }
 
-void convert_model_paths(
-		entity_key_values * const entities,
-		size_t const entity_count,
-		uint32_t const version_from,
-		uint32_t const version_to) {
+void convert_model_paths(entity_store & entities, uint32_t const version_from, uint32_t const version_to) {
 	if (version_from == version_to) {
 		// Let the conditionals assume that a Quake to Quake conversion is not performed, in particular.
 		return;
 	}
+	size_t const entity_count = entities.size();
 	for (size_t entity_number = 0; entity_number < entity_count; ++entity_number) {
-		for (entity_key_value_pair & key_value_pair : entities[entity_number]) {
-			std::string & value = key_value_pair.second;
-			if (value.size() < 4) {
+		size_t const key_value_count = entities.get_key_value_count(entity_number);
+		for (size_t key_value_number = 0; key_value_number < key_value_count; ++key_value_number) {
+			size_t const value_length = entities.get_value(entity_number, key_value_number).size();
+			if (value_length < 4) {
 				continue;
 			}
-			char * const extension = value.data() + value.size() - 4;
+			// Null-terminated, so the prefixes can be compared even if the value is shorter.
+			char * const value = entities.get_value_data(entity_number, key_value_number);
+			char * const extension = value + value_length - 4;
 			// Disregarding the key because it may be not only "model", but also "gibmodel", "shootmodel", or something
 			// else.
 			if (version_from == gbx_map_version) {
 				if (!bs2pc_strncasecmp(extension, ".dol", 4)) {
-					if (!bs2pc_strncasecmp(value.c_str(), "models/", sizeof("models/") - 1)) {
+					if (!bs2pc_strncasecmp(value, "models/", sizeof("models/") - 1)) {
 						extension[1] += int('m') - int('d');
 						extension[2] += int('d') - int('o');
 						if (version_to == id_map_version_quake) {
-							// Invalidates the extension pointer.
-							value = "progs/" + std::string(value.cbegin() + (sizeof("models/") - 1), value.cend());
+							// Invalidates the value and the extension pointers.
+							entities.replace_value_prefix(
+									entity_number, key_value_number, sizeof("models/") - 1, "progs/");
 						}
 					}
 				} else if (!bs2pc_strncasecmp(extension, ".spz", 4)) {
-					if (!bs2pc_strncasecmp(value.c_str(), "sprites/", sizeof("sprites/") - 1)) {
+					if (!bs2pc_strncasecmp(value, "sprites/", sizeof("sprites/") - 1)) {
 						extension[3] += int('r') - int('z');
 						if (version_to == id_map_version_quake) {
-							// Invalidates the extension pointer.
-							value = "progs/" + std::string(value.cbegin() + (sizeof("sprites/") - 1), value.cend());
+							// Invalidates the value and the extension pointers.
+							entities.replace_value_prefix(
+									entity_number, key_value_number, sizeof("sprites/") - 1, "progs/");
 						}
 					}
 				} else if (!bs2pc_strncasecmp(extension, ".bs2", 4)) {
-					if (!bs2pc_strncasecmp(value.c_str(), "maps/", sizeof("maps/") - 1)) {
+					if (!bs2pc_strncasecmp(value, "maps/", sizeof("maps/") - 1)) {
 						extension[3] = (extension[2] == 'S' ? 'P' : 'p');
 					}
 				}
 			} else {
 				if (!bs2pc_strncasecmp(extension, ".mdl", 4)) {
 					if (version_from == id_map_version_quake
-							? !bs2pc_strncasecmp(value.c_str(), "progs/", sizeof("progs/") - 1)
-							: !bs2pc_strncasecmp(value.c_str(), "models/", sizeof("models/") - 1)) {
+							? !bs2pc_strncasecmp(value, "progs/", sizeof("progs/") - 1)
+							: !bs2pc_strncasecmp(value, "models/", sizeof("models/") - 1)) {
 						if (version_to == gbx_map_version) {
 							extension[1] += int('d') - int('m');
 							extension[2] += int('o') - int('d');
 						}
 						if (version_from == id_map_version_quake) {
-							// Invalidates the extension pointer.
-							value = "models/" + std::string(value.cbegin() + (sizeof("progs/") - 1), value.cend());
+							// Invalidates the value and the extension pointers.
+							entities.replace_value_prefix(
+									entity_number, key_value_number, sizeof("progs/") - 1, "models/");
 						}
 					}
 				} else if (!bs2pc_strncasecmp(extension, ".spr", 4)) {
 					if (version_from == id_map_version_quake
-							? !bs2pc_strncasecmp(value.c_str(), "progs/", sizeof("progs/") - 1)
-							: !bs2pc_strncasecmp(value.c_str(), "sprites/", sizeof("sprites/") - 1)) {
+							? !bs2pc_strncasecmp(value, "progs/", sizeof("progs/") - 1)
+							: !bs2pc_strncasecmp(value, "sprites/", sizeof("sprites/") - 1)) {
 						if (version_to == gbx_map_version) {
 							extension[3] += int('z') - int('r');
 						}
 						if (version_from == id_map_version_quake) {
-							// Invalidates the extension pointer.
-							value = "sprites/" + std::string(value.cbegin() + (sizeof("progs/") - 1), value.cend());
+							// Invalidates the value and the extension pointers.
+							entities.replace_value_prefix(
+									entity_number, key_value_number, sizeof("progs/") - 1, "sprites/");
 						}
 					}
 				} else if (!bs2pc_strncasecmp(extension, ".bsp", 4)) {
-					if (!bs2pc_strncasecmp(value.c_str(), "maps/", sizeof("maps/") - 1)) {
+					if (!bs2pc_strncasecmp(value, "maps/", sizeof("maps/") - 1)) {
 						extension[3] = '2';
 					}
 				}
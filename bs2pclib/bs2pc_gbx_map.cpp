@@ -75,11 +75,13 @@ char const * gbx_map::deserialize_textures(
 	return nullptr;
 }
 
-char const * gbx_map::deserialize(void const * const map, size_t const map_size, palette_set const & quake_palette) {
+char const * gbx_map::deserialize(
+		void const * const map, size_t const map_size, palette_set const & quake_palette,
+		std::shared_ptr<void const> const & map_owner) {
 	// Version and lumps (arrays of offsets, lengths, counts, and then unknown - zeros - for lumps).
 	std::array<uint32_t, gbx_lump_count> lump_offsets, lump_lengths, lump_counts;
 	{
-		if (map_size < sizeof(uint32_t) + sizeof(uint32_t) * gbx_lump_count * 4) {
+		if (map_size < gbx_map_header_size) {
 			return "Map version and lumps are out of bounds";
 		}
 		uint32_t version;
@@ -425,13 +427,12 @@ char const * gbx_map::deserialize(void const * const map, size_t const map_size,
 	// The count is not stored, only the length.
 	{
 		uint32_t const visibility_length = lump_lengths[gbx_lump_number_visibility];
-		visibility.clear();
-		if (visibility_length) {
-			visibility.resize(visibility_length);
-			std::memcpy(
-					visibility.data(),
-					reinterpret_cast<char const *>(map) + lump_offsets[gbx_lump_number_visibility],
-					visibility_length);
+		char const * const visibility_data =
+				reinterpret_cast<char const *>(map) + lump_offsets[gbx_lump_number_visibility];
+		if (map_owner) {
+			visibility.borrow(map_owner, visibility_data, visibility_length);
+		} else {
+			visibility.assign(visibility_data, visibility_length);
 		}
 	}
 
@@ -439,13 +440,12 @@ char const * gbx_map::deserialize(void const * const map, size_t const map_size,
 	// The count is not stored, only the length.
 	{
 		uint32_t const lighting_length = lump_lengths[gbx_lump_number_lighting];
-		lighting.clear();
-		if (lighting_length) {
-			lighting.resize(lighting_length);
-			std::memcpy(
-					lighting.data(),
-					reinterpret_cast<char const *>(map) + lump_offsets[gbx_lump_number_lighting],
-					lighting_length);
+		char const * const lighting_data =
+				reinterpret_cast<char const *>(map) + lump_offsets[gbx_lump_number_lighting];
+		if (map_owner) {
+			lighting.borrow(map_owner, lighting_data, lighting_length);
+		} else {
+			lighting.assign(lighting_data, lighting_length);
 		}
 	}
 
@@ -569,532 +569,239 @@ char const * gbx_map::deserialize(void const * const map, size_t const map_size,
 }
 
 void gbx_map::serialize(std::vector<char> & map, palette_set const & quake_palette) const {
-	map.clear();
-	// As a result of the clear, all padding created by resizing will be zero-initialized.
+	serialize(map, nullptr, quake_palette);
+}
 
-	// Reserve aligned space for the header, and fill the unknown fourth array of per-lump values with zeros.
-	map.resize(
-			(sizeof(uint32_t) + sizeof(uint32_t) * gbx_lump_count * 4 + (gbx_lump_alignment - 1)) &
-					~size_t(gbx_lump_alignment - 1));
+bool gbx_map::serialize(serialized_map_sink & sink, palette_set const & quake_palette) const {
+	std::vector<char> buffer;
+	return serialize(buffer, &sink, quake_palette);
+}
 
-	// Version.
-	constexpr uint32_t version = gbx_map_version;
-	std::memcpy(map.data(), &version, sizeof(uint32_t));
+// When serializing to a sink, small writes are gathered in a buffer of about this size before passing them to the
+// sink, and large ones are passed directly.
+static constexpr size_t gbx_map_serialize_buffer_size = size_t(1) << 16;
 
-	// Write the lumps that don't have offsets depending on subsequent lumps, or allocate space for those that do.
+bool gbx_map::serialize(
+		std::vector<char> & buffer, serialized_map_sink * const sink, palette_set const & quake_palette) const {
+	// The offsets of all the lumps and of everything referenced by absolute addresses are calculated first, so the
+	// whole map can be written in order into a single allocation of the exact size, with the lumps containing addresses
+	// inside subsequent lumps written directly.
 
 	std::array<uint32_t, gbx_lump_count> lump_offsets{}, lump_lengths{}, lump_counts{};
 
-	auto const finish_lump = [&map, &lump_offsets, &lump_lengths](gbx_lump_number lump_number) {
-		size_t const map_current_size = map.size();
-		lump_lengths[lump_number] = uint32_t(map_current_size - lump_offsets[lump_number]);
+	// Reserve aligned space for the header.
+	size_t map_size = (gbx_map_header_size + (gbx_lump_alignment - 1)) & ~size_t(gbx_lump_alignment - 1);
+
+	auto const add_lump = [&map_size, &lump_offsets, &lump_lengths](
+			gbx_lump_number const lump_number, size_t const length) {
+		lump_offsets[lump_number] = uint32_t(map_size);
+		lump_lengths[lump_number] = uint32_t(length);
 		// Align the end of the lump.
-		map.resize(map_current_size + (gbx_lump_alignment - 1) & ~size_t(gbx_lump_alignment - 1));
+		map_size = (map_size + length + (gbx_lump_alignment - 1)) & ~size_t(gbx_lump_alignment - 1);
 	};
 
-	// Planes.
-	size_t const planes_offset = map.size();
-	{
-		size_t const plane_count = planes.size();
-		lump_offsets[gbx_lump_number_planes] = uint32_t(planes_offset);
-		lump_counts[gbx_lump_number_planes] = uint32_t(plane_count);
-		if (plane_count) {
-			map.resize(planes_offset + sizeof(gbx_plane) * plane_count);
-			std::memcpy(map.data() + planes_offset, planes.data(), sizeof(gbx_plane) * plane_count);
-		}
-		finish_lump(gbx_lump_number_planes);
-	}
-
-	// Nodes - only allocate as leafs (as well as planes, preceding nodes) are needed.
-	size_t const nodes_offset = map.size();
 	size_t const node_count = nodes.size();
-	{
-		lump_offsets[gbx_lump_number_nodes] = uint32_t(nodes_offset);
-		lump_counts[gbx_lump_number_nodes] = uint32_t(node_count);
-		map.resize(nodes_offset + sizeof(gbx_node) * node_count);
-		finish_lump(gbx_lump_number_nodes);
-	}
-
-	// Leafs - only allocate as visibility (as well as nodes, preceding leafs) is needed.
-	size_t const leafs_offset = map.size();
 	size_t const leaf_count = leafs.size();
-	{
-		lump_offsets[gbx_lump_number_leafs] = uint32_t(leafs_offset);
-		lump_counts[gbx_lump_number_leafs] = uint32_t(leaf_count);
-		map.resize(leafs_offset + sizeof(gbx_leaf) * leaf_count);
-		finish_lump(gbx_lump_number_leafs);
-	}
-
-	// Edges.
-	{
-		size_t const edges_offset = map.size();
-		size_t const edge_count = edges.size();
-		lump_offsets[gbx_lump_number_edges] = uint32_t(edges_offset);
-		lump_counts[gbx_lump_number_edges] = uint32_t(edge_count);
-		if (edge_count) {
-			map.resize(edges_offset + sizeof(edge) * edge_count);
-			std::memcpy(map.data() + edges_offset, edges.data(), sizeof(edge) * edge_count);
-		}
-		finish_lump(gbx_lump_number_edges);
-	}
-
-	// Surfedges.
-	{
-		size_t const surfedges_offset = map.size();
-		size_t const surfedge_count = surfedges.size();
-		lump_offsets[gbx_lump_number_surfedges] = uint32_t(surfedges_offset);
-		lump_counts[gbx_lump_number_surfedges] = uint32_t(surfedge_count);
-		if (surfedge_count) {
-			map.resize(surfedges_offset + sizeof(surfedge) * surfedge_count);
-			std::memcpy(map.data() + surfedges_offset, surfedges.data(), sizeof(surfedge) * surfedge_count);
-		}
-		finish_lump(gbx_lump_number_surfedges);
-	}
-
-	// Vertexes.
-	{
-		size_t const vertexes_offset = map.size();
-		size_t const vertex_count = vertexes.size();
-		lump_offsets[gbx_lump_number_vertexes] = uint32_t(vertexes_offset);
-		lump_counts[gbx_lump_number_vertexes] = uint32_t(vertex_count);
-		if (vertex_count) {
-			map.resize(vertexes_offset + sizeof(vector4) * vertex_count);
-			std::memcpy(map.data() + vertexes_offset, vertexes.data(), sizeof(vector4) * vertex_count);
-		}
-		finish_lump(gbx_lump_number_vertexes);
-	}
-
-	// Drawing hull as clipping hull (hull 0).
-	{
-		size_t const hull_0_offset = map.size();
-		size_t const hull_0_clipnode_count = hull_0.size();
-		lump_offsets[gbx_lump_number_hull_0] = uint32_t(hull_0_offset);
-		lump_counts[gbx_lump_number_hull_0] = uint32_t(hull_0_clipnode_count);
-		if (hull_0_clipnode_count) {
-			map.resize(hull_0_offset + sizeof(clipnode) * hull_0_clipnode_count);
-			std::memcpy(map.data() + hull_0_offset, hull_0.data(), sizeof(clipnode) * hull_0_clipnode_count);
-		}
-		finish_lump(gbx_lump_number_hull_0);
-	}
-
-	// Clipnodes.
-	{
-		size_t const clipnodes_offset = map.size();
-		size_t const clipnode_count = clipnodes.size();
-		lump_offsets[gbx_lump_number_clipnodes] = uint32_t(clipnodes_offset);
-		lump_counts[gbx_lump_number_clipnodes] = uint32_t(clipnode_count);
-		if (clipnode_count) {
-			map.resize(clipnodes_offset + sizeof(clipnode) * clipnode_count);
-			std::memcpy(map.data() + clipnodes_offset, clipnodes.data(), sizeof(clipnode) * clipnode_count);
-		}
-		finish_lump(gbx_lump_number_clipnodes);
-	}
-
-	// Models.
-	{
-		size_t const models_offset = map.size();
-		size_t const model_count = models.size();
-		lump_offsets[gbx_lump_number_models] = uint32_t(models_offset);
-		lump_counts[gbx_lump_number_models] = uint32_t(model_count);
-		if (model_count) {
-			map.resize(models_offset + sizeof(gbx_model) * model_count);
-			std::memcpy(map.data() + models_offset, models.data(), sizeof(gbx_model) * model_count);
-		}
-		finish_lump(gbx_lump_number_models);
-	}
-
-	// Faces - only allocate as textures, lighting and polygons (as well as planes, preceding faces) are needed.
-	size_t const faces_offset = map.size();
 	size_t const face_count = faces.size();
-	{
-		lump_offsets[gbx_lump_number_faces] = uint32_t(faces_offset);
-		lump_counts[gbx_lump_number_faces] = uint32_t(face_count);
-		map.resize(faces_offset + sizeof(gbx_face) * face_count);
-		finish_lump(gbx_lump_number_faces);
-	}
-
-	// Marksurfaces.
-	{
-		size_t const marksurfaces_offset = map.size();
-		size_t const marksurface_count = marksurfaces.size();
-		lump_offsets[gbx_lump_number_marksurfaces] = uint32_t(marksurfaces_offset);
-		lump_counts[gbx_lump_number_marksurfaces] = uint32_t(marksurface_count);
-		if (marksurface_count) {
-			map.resize(marksurfaces_offset + sizeof(gbx_marksurface) * marksurface_count);
-			std::memcpy(
-					map.data() + marksurfaces_offset,
-					marksurfaces.data(),
-					sizeof(gbx_marksurface) * marksurface_count);
-		}
-		finish_lump(gbx_lump_number_marksurfaces);
-	}
 
-	// Visibility.
+	lump_counts[gbx_lump_number_planes] = uint32_t(planes.size());
+	add_lump(gbx_lump_number_planes, sizeof(gbx_plane) * planes.size());
+	lump_counts[gbx_lump_number_nodes] = uint32_t(node_count);
+	add_lump(gbx_lump_number_nodes, sizeof(gbx_node) * node_count);
+	lump_counts[gbx_lump_number_leafs] = uint32_t(leaf_count);
+	add_lump(gbx_lump_number_leafs, sizeof(gbx_leaf) * leaf_count);
+	lump_counts[gbx_lump_number_edges] = uint32_t(edges.size());
+	add_lump(gbx_lump_number_edges, sizeof(edge) * edges.size());
+	lump_counts[gbx_lump_number_surfedges] = uint32_t(surfedges.size());
+	add_lump(gbx_lump_number_surfedges, sizeof(surfedge) * surfedges.size());
+	lump_counts[gbx_lump_number_vertexes] = uint32_t(vertexes.size());
+	add_lump(gbx_lump_number_vertexes, sizeof(vector4) * vertexes.size());
+	lump_counts[gbx_lump_number_hull_0] = uint32_t(hull_0.size());
+	add_lump(gbx_lump_number_hull_0, sizeof(clipnode) * hull_0.size());
+	lump_counts[gbx_lump_number_clipnodes] = uint32_t(clipnodes.size());
+	add_lump(gbx_lump_number_clipnodes, sizeof(clipnode) * clipnodes.size());
+	lump_counts[gbx_lump_number_models] = uint32_t(models.size());
+	add_lump(gbx_lump_number_models, sizeof(gbx_model) * models.size());
+	lump_counts[gbx_lump_number_faces] = uint32_t(face_count);
+	add_lump(gbx_lump_number_faces, sizeof(gbx_face) * face_count);
+	lump_counts[gbx_lump_number_marksurfaces] = uint32_t(marksurfaces.size());
+	add_lump(gbx_lump_number_marksurfaces, sizeof(gbx_marksurface) * marksurfaces.size());
 	// The count is not stored, only the length.
-	size_t const visibility_offset = map.size();
-	{
-		size_t const visibility_length = visibility.size();
-		lump_offsets[gbx_lump_number_visibility] = uint32_t(visibility_offset);
-		if (visibility_length) {
-			map.resize(visibility_offset + visibility_length);
-			std::memcpy(map.data() + visibility_offset, visibility.data(), visibility_length);
-		}
-		finish_lump(gbx_lump_number_visibility);
-	}
-
-	// Lighting.
+	add_lump(gbx_lump_number_visibility, visibility.size());
 	// The count is not stored, only the length.
-	size_t const lighting_offset = map.size();
-	{
-		size_t const lighting_length = lighting.size();
-		lump_offsets[gbx_lump_number_lighting] = uint32_t(lighting_offset);
-		if (lighting_length) {
-			map.resize(lighting_offset + lighting_length);
-			std::memcpy(map.data() + lighting_offset, lighting.data(), lighting_length);
-		}
-		finish_lump(gbx_lump_number_lighting);
-	}
+	add_lump(gbx_lump_number_lighting, lighting.size());
 
 	// Textures.
-	size_t const textures_offset = map.size();
-	{
-		size_t const texture_count = textures.size();
-		lump_offsets[gbx_lump_number_textures] = uint32_t(textures_offset);
+	size_t const texture_count = textures.size();
+	size_t const textures_offset = map_size;
+	// In the original maps, the textures lump contains first the texture information, then the pixels, then the
+	// palettes.
+	std::vector<size_t> texture_pixels_offsets, texture_pixels_sizes, texture_palette_offsets;
+	// The textures whose palettes are written, in the order of the palettes.
+	// Fixed palettes (Quake, checkerboard) are written only once, for the first use.
+	std::vector<size_t> palette_texture_numbers;
+	if (texture_count) {
 		lump_counts[gbx_lump_number_textures] = uint32_t(texture_count);
-		if (texture_count) {
-			// In the original maps, the textures lump contains first the texture information, then the pixels, then the
-			// palettes.
-			size_t const textures_pixels_offset = textures_offset + sizeof(gbx_texture) * texture_count;
-			size_t textures_information_and_pixels_size = textures_pixels_offset;
-			for (gbx_texture_deserialized const & texture : textures) {
-				// texture.mip_levels doesn't include the base level.
-				for (uint32_t texture_mip_level = 0; texture_mip_level <= texture.mip_levels; ++texture_mip_level) {
-					uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
-					uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
-					if (!texture_mip_width || !texture_mip_height) {
-						break;
-					}
-					textures_information_and_pixels_size += size_t(texture_mip_width) * size_t(texture_mip_height);
+		texture_pixels_offsets.reserve(texture_count);
+		texture_pixels_sizes.reserve(texture_count);
+		size_t next_texture_pixels_offset = textures_offset + sizeof(gbx_texture) * texture_count;
+		for (gbx_texture_deserialized const & texture : textures) {
+			size_t texture_pixels_size = 0;
+			// texture.mip_levels doesn't include the base level.
+			for (uint32_t texture_mip_level = 0; texture_mip_level <= texture.mip_levels; ++texture_mip_level) {
+				uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
+				uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
+				if (!texture_mip_width || !texture_mip_height) {
+					break;
 				}
+				texture_pixels_size += size_t(texture_mip_width) * size_t(texture_mip_height);
 			}
-			map.resize(textures_information_and_pixels_size);
-			size_t next_texture_pixels_offset = textures_pixels_offset;
-			std::array<size_t, gbx_palette_type_count> texture_quake_palette_offsets;
-			std::fill(
-					texture_quake_palette_offsets.begin(),
-					texture_quake_palette_offsets.end(),
-					SIZE_MAX);
-			std::array<size_t, gbx_palette_type_count> texture_checkerboard_palette_offsets;
-			std::fill(
-					texture_checkerboard_palette_offsets.begin(),
-					texture_checkerboard_palette_offsets.end(),
-					SIZE_MAX);
-			for (size_t texture_number = 0; texture_number < texture_count; ++texture_number) {
-				gbx_texture_deserialized const & texture = textures[texture_number];
-				gbx_palette_type const texture_palette_type = gbx_texture_palette_type(texture.name.c_str());
-				// Pixels.
-				size_t const texture_pixels_offset = next_texture_pixels_offset;
-				bool const texture_is_random = texture_palette_type == gbx_palette_type_random;
-				size_t texture_mip_pixels_offset = 0;
-				// texture.mip_levels doesn't include the base level.
-				for (uint32_t texture_mip_level = 0; texture_mip_level <= texture.mip_levels; ++texture_mip_level) {
-					uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
-					uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
-					if (!texture_mip_width || !texture_mip_height) {
-						break;
-					}
-					if (!texture.pixels) {
-						// Checkerboard.
-						char * const texture_mip = map.data() + texture_pixels_offset + texture_mip_pixels_offset;
-						uint32_t const checkerboard_cell_size = 8 >> texture_mip_level;
-						uint32_t const checkerboard_two_cells_mask = (checkerboard_cell_size << 1) - 1;
-						for (uint32_t texture_mip_y = 0; texture_mip_y < texture_mip_height; ++texture_mip_y) {
-							for (uint32_t texture_mip_x = 0; texture_mip_x < texture_mip_width; ++texture_mip_x) {
-								uint32_t checkerboard_y =
-										texture_is_random
-												? deinterleave_random_gbx_texture_y(texture_mip_y, texture_mip_height)
-												: texture_mip_y;
-								texture_mip[texture_mip_y * size_t(texture_mip_width) + texture_mip_x] = char(
-										(((checkerboard_y & checkerboard_two_cells_mask) < checkerboard_cell_size) !=
-										((texture_mip_x & checkerboard_two_cells_mask) < checkerboard_cell_size))
-												? 0
-												: 255);
-							}
-						}
-					}
-					texture_mip_pixels_offset += size_t(texture_mip_width) * size_t(texture_mip_height);
-				}
-				if (texture.pixels) {
-					assert(texture_mip_pixels_offset <= texture.pixels->size());
-					if (texture_is_random) {
-						// Interleave the random-tiled texture.
-						size_t texture_interleave_mip_offset = 0;
-						for (uint32_t texture_mip_level = 0;
-								texture_mip_level <= texture.mip_levels;
-								++texture_mip_level) {
-							uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
-							uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
-							if (!texture_mip_width || !texture_mip_height) {
-								break;
-							}
-							for (uint32_t texture_mip_y = 0; texture_mip_y < texture_mip_height; ++texture_mip_y) {
-								std::memcpy(
-										map.data() + texture_pixels_offset + texture_interleave_mip_offset +
-												size_t(texture_mip_width) * texture_mip_y,
-										texture.pixels->data() + texture_interleave_mip_offset +
-												size_t(texture_mip_width) *
-														deinterleave_random_gbx_texture_y(
-																texture_mip_y, texture_mip_height),
-										texture_mip_width);
-							}
-							texture_interleave_mip_offset += size_t(texture_mip_width) * size_t(texture_mip_height);
-						}
-					} else {
-						// Copy all mips at once.
-						std::memcpy(
-								map.data() + texture_pixels_offset,
-								texture.pixels->data(),
-								texture_mip_pixels_offset);
-					}
-				}
-				next_texture_pixels_offset += texture_mip_pixels_offset;
-				// Palette.
-				// Fixed palettes (Quake, checkerboard) are written only once, for the first use.
-				size_t texture_palette_offset = SIZE_MAX;
-				char * const texture_palette = map.data() + texture_palette_offset;
-				if (texture.pixels) {
-					if (!texture.palette_id_indexed) {
-						texture_palette_offset = texture_quake_palette_offsets[texture_palette_type];
-					}
-					if (texture_palette_offset == SIZE_MAX) {
-						texture_palette_offset = map.size();
-						if (!texture.palette_id_indexed) {
-							texture_quake_palette_offsets[texture_palette_type] = texture_palette_offset;
-						}
-						map.resize(texture_palette_offset + 4 * 256);
-						char * const texture_palette_serialized = map.data() + texture_palette_offset;
-						gbx_texture_deserialized_palette const & texture_palette_id_indexed =
-								texture.palette_id_indexed
-										? *texture.palette_id_indexed
-										: quake_palette.gbx_id_indexed[texture_palette_type];
-						// Reordering of colors is done with the granularity of 8 colors.
-						for (size_t color_number = 0; color_number < 256; color_number += 8) {
-							std::memcpy(
-									texture_palette_serialized +
-											4 * size_t(convert_palette_color_number(uint8_t(color_number))),
-									texture_palette_id_indexed.data() + 4 * color_number,
-									4 * 8);
-						}
-					}
-				} else {
-					texture_palette_offset = texture_checkerboard_palette_offsets[texture_palette_type];
-					if (texture_palette_offset == SIZE_MAX) {
-						texture_palette_offset = map.size();
-						texture_checkerboard_palette_offsets[texture_palette_type] = texture_palette_offset;
-						map.resize(texture_palette_offset + 4 * 256);
-						char * const texture_palette_serialized = map.data() + texture_palette_offset;
-						if (texture_is_random) {
-							// Inverted colors.
-							for (uint32_t color_number = 0; color_number < 255; ++color_number) {
-								texture_palette_serialized[4 * color_number] = 0x7F;
-								texture_palette_serialized[4 * color_number + 1] = 0x7F;
-								texture_palette_serialized[4 * color_number + 2] = 0x7F;
-								texture_palette_serialized[4 * color_number + 3] = char(0x80);
-							}
-							texture_palette_serialized[4 * 255] = 0;
-							texture_palette_serialized[4 * 255 + 1] = 0x7F;
-							texture_palette_serialized[4 * 255 + 2] = 0;
-							texture_palette_serialized[4 * 255 + 3] = char(0x80);
-						} else {
-							for (uint32_t color_number = 0; color_number < 255; ++color_number) {
-								texture_palette_serialized[4 * color_number] = 0;
-								texture_palette_serialized[4 * color_number + 1] = 0;
-								texture_palette_serialized[4 * color_number + 2] = 0;
-								texture_palette_serialized[4 * color_number + 3] = char(0x80);
-							}
-							if (is_gbx_palette_24_bit(texture_palette_type)) {
-								if (texture_palette_type == gbx_palette_type_transparent) {
-									texture_palette_serialized[4 * 255] = 0;
-									texture_palette_serialized[4 * 255 + 1] = 0;
-									texture_palette_serialized[4 * 255 + 2] = 0;
-									texture_palette_serialized[4 * 255 + 3] = 0;
-								} else {
-									texture_palette_serialized[4 * 255] = char(0xFF);
-									texture_palette_serialized[4 * 255 + 1] = 0;
-									texture_palette_serialized[4 * 255 + 2] = char(0xFF);
-									texture_palette_serialized[4 * 255 + 3] = char(0x80);
-								}
-							} else {
-								texture_palette_serialized[4 * 255] = 0x7F;
-								texture_palette_serialized[4 * 255 + 1] = 0;
-								texture_palette_serialized[4 * 255 + 2] = 0x7F;
-								texture_palette_serialized[4 * 255 + 3] = char(0x80);
-							}
-						}
-					}
+			texture_pixels_offsets.push_back(next_texture_pixels_offset);
+			texture_pixels_sizes.push_back(texture_pixels_size);
+			next_texture_pixels_offset += texture_pixels_size;
+		}
+		texture_palette_offsets.reserve(texture_count);
+		size_t next_texture_palette_offset = next_texture_pixels_offset;
+		std::array<size_t, gbx_palette_type_count> texture_quake_palette_offsets;
+		std::fill(texture_quake_palette_offsets.begin(), texture_quake_palette_offsets.end(), SIZE_MAX);
+		std::array<size_t, gbx_palette_type_count> texture_checkerboard_palette_offsets;
+		std::fill(
+				texture_checkerboard_palette_offsets.begin(),
+				texture_checkerboard_palette_offsets.end(),
+				SIZE_MAX);
+		for (size_t texture_number = 0; texture_number < texture_count; ++texture_number) {
+			gbx_texture_deserialized const & texture = textures[texture_number];
+			gbx_palette_type const texture_palette_type = gbx_texture_palette_type(texture.name.c_str());
+			size_t * const texture_shared_palette_offset =
+					texture.pixels
+							? (texture.palette_id_indexed
+									? nullptr
+									: &texture_quake_palette_offsets[texture_palette_type])
+							: &texture_checkerboard_palette_offsets[texture_palette_type];
+			size_t texture_palette_offset = texture_shared_palette_offset ? *texture_shared_palette_offset : SIZE_MAX;
+			if (texture_palette_offset == SIZE_MAX) {
+				texture_palette_offset = next_texture_palette_offset;
+				next_texture_palette_offset += 4 * 256;
+				if (texture_shared_palette_offset) {
+					*texture_shared_palette_offset = texture_palette_offset;
 				}
-				// Texture information.
-				gbx_texture texture_serialized;
-				texture_serialized.pixels = uint32_t(texture_pixels_offset);
-				texture_serialized.palette = uint32_t(texture_palette_offset);
-				texture_serialized.width = texture.width;
-				texture_serialized.height = texture.height;
-				texture_serialized.scaled_width = texture.scaled_width;
-				texture_serialized.scaled_height = texture.scaled_height;
-				size_t const texture_name_length = std::min(size_t(texture_name_max_length), texture.name.size());
-				std::memcpy(
-						texture_serialized.name,
-						texture.name.c_str(),
-						texture_name_length);
-				std::memset(
-						texture_serialized.name + texture_name_length,
-						0,
-						texture_name_max_length + 1 - texture_name_length);
-				std::memset(&texture_serialized.unknown_0, 0, sizeof(texture_serialized.unknown_0));
-				texture_serialized.mip_levels = texture.mip_levels;
-				std::memset(&texture_serialized.unknown_1, 0, sizeof(texture_serialized.unknown_1));
-				texture_serialized.anim_total = texture.anim_total;
-				texture_serialized.anim_min = texture.anim_min;
-				texture_serialized.anim_max = texture.anim_max;
-				texture_serialized.anim_next =
-						texture.anim_next != UINT32_MAX
-								? uint32_t(textures_offset + sizeof(gbx_texture) * texture.anim_next)
-								: UINT32_MAX;
-				texture_serialized.alternate_anims =
-						texture.alternate_anims != UINT32_MAX
-								? uint32_t(textures_offset + sizeof(gbx_texture) * texture.alternate_anims)
-								: UINT32_MAX;
-				std::memcpy(
-						map.data() + textures_offset + sizeof(gbx_texture) * texture_number,
-						&texture_serialized,
-						sizeof(gbx_texture));
-			}
-		} else {
-			// Single checkerboard texture of the smallest possible size (16x16) with a single 8x8 mip.
-			lump_counts[gbx_lump_number_textures] = 1;
-			size_t const notexture_mip_0_offset = textures_offset + sizeof(gbx_texture);
-			size_t const notexture_mip_1_offset = notexture_mip_0_offset + 16 * 16;
-			size_t const notexture_palette_offset = notexture_mip_1_offset + 8 * 8;
-			map.resize(notexture_palette_offset + 4 * 256);
-			gbx_texture notexture;
-			notexture.pixels = uint32_t(notexture_mip_0_offset);
-			notexture.palette = uint32_t(notexture_palette_offset);
-			notexture.width = 16;
-			notexture.height = 16;
-			notexture.scaled_width = 16;
-			notexture.scaled_height = 16;
-			static char const notexture_name[texture_name_max_length + 1] = "notexture";
-			static_assert(sizeof(notexture.name) == sizeof(notexture_name));
-			std::memcpy(&notexture.name, &notexture_name, sizeof(notexture_name));
-			std::memset(&notexture.unknown_0, 0, sizeof(notexture.unknown_0));
-			notexture.mip_levels = 1;
-			std::memset(&notexture.unknown_1, 0, sizeof(notexture.unknown_1));
-			notexture.anim_total = 0;
-			notexture.anim_min = 0;
-			notexture.anim_max = 0;
-			notexture.anim_next = UINT32_MAX;
-			notexture.alternate_anims = UINT32_MAX;
-			std::memcpy(map.data() + textures_offset, &notexture, sizeof(gbx_texture));
-			for (size_t notexture_y = 0; notexture_y < 8; ++notexture_y) {
-				uint8_t const notexture_row_left = ((notexture_y < 4) ? UINT8_MAX : 0);
-				uint8_t const notexture_row_right = notexture_row_left ^ UINT8_MAX;
-				char * const notexture_mip_0_row =
-						map.data() + notexture_mip_0_offset + (16 * 2) * notexture_y;
-				char * const notexture_mip_1_row =
-						map.data() + notexture_mip_1_offset + 8 * notexture_y;
-				std::memset(notexture_mip_0_row, notexture_row_left, 8);
-				std::memset(notexture_mip_0_row + 8, notexture_row_right, 8);
-				std::memset(notexture_mip_0_row + 16, notexture_row_left, 8);
-				std::memset(notexture_mip_0_row + 24, notexture_row_right, 8);
-				std::memset(notexture_mip_1_row, notexture_row_left, 4);
-				std::memset(notexture_mip_1_row + 4, notexture_row_right, 4);
+				palette_texture_numbers.push_back(texture_number);
 			}
-			char * const notexture_palette = map.data() + notexture_palette_offset;
-			for (uint32_t color_number = 0; color_number < 255; ++color_number) {
-				notexture_palette[4 * color_number] = 0;
-				notexture_palette[4 * color_number + 1] = 0;
-				notexture_palette[4 * color_number + 2] = 0;
-				notexture_palette[4 * color_number + 3] = char(0x80);
-			}
-			notexture_palette[4 * 255] = 0x7F;
-			notexture_palette[4 * 255 + 1] = 0;
-			notexture_palette[4 * 255 + 2] = 0x7F;
-			notexture_palette[4 * 255 + 3] = char(0x80);
+			texture_palette_offsets.push_back(texture_palette_offset);
 		}
-		finish_lump(gbx_lump_number_textures);
+		add_lump(gbx_lump_number_textures, next_texture_palette_offset - textures_offset);
+	} else {
+		// Single checkerboard texture of the smallest possible size (16x16) with a single 8x8 mip.
+		lump_counts[gbx_lump_number_textures] = 1;
+		add_lump(gbx_lump_number_textures, sizeof(gbx_texture) + 16 * 16 + 8 * 8 + 4 * 256);
 	}
 
 	// Entities.
 	// The count is not stored, only the length.
-	{
-		size_t const entities_offset = map.size();
-		std::string entities_string = serialize_entities(entities.data(), entities.size());
-		// Null-terminated.
-		size_t const entities_length = entities_string.size() + 1;
-		lump_offsets[gbx_lump_number_entities] = uint32_t(entities_offset);
-		map.resize(entities_offset + entities_length);
-		std::memcpy(map.data() + entities_offset, entities_string.c_str(), entities_length);
-		finish_lump(gbx_lump_number_entities);
-	}
+	std::string const entities_string = serialize_entities(entities);
+	// Null-terminated.
+	add_lump(gbx_lump_number_entities, entities_string.size() + 1);
 
 	// Polygons.
-	size_t const polygons_offset = map.size();
+	size_t const polygon_count = polygons.size();
 	std::vector<size_t> face_polygons_offsets;
+	face_polygons_offsets.reserve(polygon_count);
 	{
-		size_t const polygon_count = polygons.size();
-		lump_offsets[gbx_lump_number_polygons] = uint32_t(polygons_offset);
-		lump_counts[gbx_lump_number_polygons] = uint32_t(polygon_count);
-		face_polygons_offsets.reserve(polygon_count);
+		size_t const polygons_offset = map_size;
+		size_t next_face_polygons_offset = polygons_offset;
 		for (gbx_polygons_deserialized const & face_polygons : polygons) {
-			size_t const face_polygons_offset = map.size();
-			face_polygons_offsets.push_back(face_polygons_offset);
-			size_t const face_polygons_vertexes_size = sizeof(gbx_polygon_vertex) * face_polygons.vertexes.size();
-			map.resize(face_polygons_offset + sizeof(uint32_t) * 2 + face_polygons_vertexes_size + sizeof(uint32_t));
-			uint32_t const face_polygons_face_number = uint32_t(face_polygons.face_number);
-			std::memcpy(
-					map.data() + face_polygons_offset,
-					&face_polygons_face_number,
-					sizeof(uint32_t));
-			uint32_t const face_polygons_vertex_count = uint32_t(face_polygons.vertexes.size());
-			std::memcpy(
-					map.data() + face_polygons_offset + sizeof(uint32_t),
-					&face_polygons_vertex_count,
-					sizeof(uint32_t));
-			std::memcpy(
-					map.data() + face_polygons_offset + sizeof(uint32_t) * 2,
-					face_polygons.vertexes.data(),
-					face_polygons_vertexes_size);
-			uint32_t const face_polygons_strip_count = uint32_t(face_polygons.strips.size());
-			std::memcpy(
-					map.data() + face_polygons_offset + sizeof(uint32_t) * 2 + face_polygons_vertexes_size,
-					&face_polygons_strip_count,
-					sizeof(uint32_t));
+			face_polygons_offsets.push_back(next_face_polygons_offset);
+			next_face_polygons_offset +=
+					sizeof(uint32_t) * 2 + sizeof(gbx_polygon_vertex) * face_polygons.vertexes.size() +
+					sizeof(uint32_t);
 			for (std::vector<uint16_t> const & face_polygons_strip : face_polygons.strips) {
-				size_t const face_polygons_strip_offset = map.size();
-				size_t const face_polygons_strip_size = sizeof(uint16_t) * face_polygons_strip.size();
-				map.resize(face_polygons_strip_offset + sizeof(uint16_t) + face_polygons_strip_size);
-				uint16_t const face_polygons_strip_vertex_count = uint16_t(face_polygons_strip.size());
-				std::memcpy(
-						map.data() + face_polygons_strip_offset,
-						&face_polygons_strip_vertex_count,
-						sizeof(uint16_t));
-				std::memcpy(
-						map.data() + face_polygons_strip_offset + sizeof(uint16_t),
-						face_polygons_strip.data(),
-						face_polygons_strip_size);
-				while (map.size() & 3) {
-					map.push_back(char(gbx_polygon_strip_alignment_byte));
+				next_face_polygons_offset = (next_face_polygons_offset + sizeof(uint16_t) +
+						sizeof(uint16_t) * face_polygons_strip.size() + 3) & ~size_t(3);
+			}
+		}
+		lump_counts[gbx_lump_number_polygons] = uint32_t(polygon_count);
+		add_lump(gbx_lump_number_polygons, next_face_polygons_offset - polygons_offset);
+	}
+
+	// Write the map.
+
+	buffer.clear();
+	// The size of the data already passed from the buffer to the sink.
+	size_t flushed_size = 0;
+	bool sink_succeeded = true;
+	if (sink) {
+		buffer.reserve(gbx_map_serialize_buffer_size);
+		sink_succeeded = sink->begin(map_size);
+	} else {
+		buffer.reserve(map_size);
+	}
+
+	auto const position = [&buffer, &flushed_size]() -> size_t {
+		return flushed_size + buffer.size();
+	};
+	auto const flush = [&buffer, sink, &flushed_size, &sink_succeeded]() {
+		if (buffer.empty()) {
+			return;
+		}
+		if (sink_succeeded) {
+			sink_succeeded = sink->write(buffer.data(), buffer.size());
+		}
+		flushed_size += buffer.size();
+		buffer.clear();
+	};
+	auto const write = [&buffer, sink, &flushed_size, &sink_succeeded, &flush](
+			void const * const data, size_t const size) {
+		if (sink && buffer.size() + size > gbx_map_serialize_buffer_size) {
+			flush();
+			if (size >= gbx_map_serialize_buffer_size) {
+				if (sink_succeeded) {
+					sink_succeeded = sink->write(data, size);
 				}
+				flushed_size += size;
+				return;
 			}
 		}
-		finish_lump(gbx_lump_number_polygons);
+		buffer.insert(
+				buffer.end(), reinterpret_cast<char const *>(data), reinterpret_cast<char const *>(data) + size);
+	};
+	// Returns the pointer to the written zeros to modify them, valid until the next write.
+	auto const write_zeros = [&buffer, sink, &flush](size_t const size) -> char * {
+		if (sink && buffer.size() + size > gbx_map_serialize_buffer_size) {
+			flush();
+		}
+		size_t const offset = buffer.size();
+		buffer.resize(offset + size);
+		return buffer.data() + offset;
+	};
+	auto const finish_lump = [&lump_offsets, &lump_lengths, &position, &write_zeros](
+			gbx_lump_number const lump_number) {
+		assert(position() == size_t(lump_offsets[lump_number]) + lump_lengths[lump_number]);
+		// Align the end of the lump.
+		size_t const lump_end = position();
+		write_zeros(((lump_end + (gbx_lump_alignment - 1)) & ~size_t(gbx_lump_alignment - 1)) - lump_end);
+	};
+
+	// Header, with the unknown fourth array of per-lump values filled with zeros.
+	{
+		constexpr uint32_t version = gbx_map_version;
+		write(&version, sizeof(uint32_t));
+		write(lump_offsets.data(), sizeof(uint32_t) * gbx_lump_count);
+		write(lump_lengths.data(), sizeof(uint32_t) * gbx_lump_count);
+		write(lump_counts.data(), sizeof(uint32_t) * gbx_lump_count);
+		write_zeros(lump_offsets[0] - position());
 	}
 
-	// Write the lumps with absolute addresses inside subsequent lumps.
+	size_t const planes_offset = lump_offsets[gbx_lump_number_planes];
+	size_t const nodes_offset = lump_offsets[gbx_lump_number_nodes];
+	size_t const leafs_offset = lump_offsets[gbx_lump_number_leafs];
+
+	// Planes.
+	write(planes.data(), sizeof(gbx_plane) * planes.size());
+	finish_lump(gbx_lump_number_planes);
 
 	// Nodes.
-	for (size_t node_number = 0; node_number < node_count; ++node_number) {
-		gbx_node node_serialized(nodes[node_number]);
+	for (gbx_node const & node : nodes) {
+		gbx_node node_serialized(node);
 		if (node_serialized.parent != UINT32_MAX) {
 			node_serialized.parent = uint32_t(nodes_offset + sizeof(gbx_node) * node_serialized.parent);
 		}
@@ -1106,54 +813,350 @@ void gbx_map::serialize(std::vector<char> & map, palette_set const & quake_palet
 							? uint32_t(nodes_offset + sizeof(gbx_node) * uint32_t(child))
 							: uint32_t(leafs_offset + sizeof(gbx_leaf) * uint32_t(INT32_C(-1) - child)));
 		}
-		std::memcpy(map.data() + nodes_offset + sizeof(gbx_node) * node_number, &node_serialized, sizeof(gbx_node));
+		write(&node_serialized, sizeof(gbx_node));
 	}
+	finish_lump(gbx_lump_number_nodes);
 
 	// Leafs.
-	for (size_t leaf_number = 0; leaf_number < leaf_count; ++leaf_number) {
-		gbx_leaf leaf_serialized(leafs[leaf_number]);
+	for (gbx_leaf const & leaf : leafs) {
+		gbx_leaf leaf_serialized(leaf);
 		if (leaf_serialized.parent != UINT32_MAX) {
 			leaf_serialized.parent = uint32_t(nodes_offset + sizeof(gbx_node) * leaf_serialized.parent);
 		}
 		if (leaf_serialized.visibility_offset != UINT32_MAX) {
-			leaf_serialized.visibility_offset += uint32_t(visibility_offset);
+			leaf_serialized.visibility_offset += lump_offsets[gbx_lump_number_visibility];
 		}
-		std::memcpy(map.data() + leafs_offset + sizeof(gbx_leaf) * leaf_number, &leaf_serialized, sizeof(gbx_leaf));
+		write(&leaf_serialized, sizeof(gbx_leaf));
 	}
+	finish_lump(gbx_lump_number_leafs);
+
+	// Edges.
+	write(edges.data(), sizeof(edge) * edges.size());
+	finish_lump(gbx_lump_number_edges);
+
+	// Surfedges.
+	write(surfedges.data(), sizeof(surfedge) * surfedges.size());
+	finish_lump(gbx_lump_number_surfedges);
+
+	// Vertexes.
+	write(vertexes.data(), sizeof(vector4) * vertexes.size());
+	finish_lump(gbx_lump_number_vertexes);
+
+	// Drawing hull as clipping hull (hull 0).
+	write(hull_0.data(), sizeof(clipnode) * hull_0.size());
+	finish_lump(gbx_lump_number_hull_0);
+
+	// Clipnodes.
+	write(clipnodes.data(), sizeof(clipnode) * clipnodes.size());
+	finish_lump(gbx_lump_number_clipnodes);
+
+	// Models.
+	write(models.data(), sizeof(gbx_model) * models.size());
+	finish_lump(gbx_lump_number_models);
 
 	// Faces.
-	for (size_t face_number = 0; face_number < face_count; ++face_number) {
-		gbx_face face_serialized(faces[face_number]);
+	for (gbx_face const & face : faces) {
+		gbx_face face_serialized(face);
 		face_serialized.texture =
 				uint32_t(textures_offset + sizeof(gbx_texture) * (textures.empty() ? 0 : face_serialized.texture));
 		if (face_serialized.lighting_offset != UINT32_MAX) {
-			face_serialized.lighting_offset += uint32_t(lighting_offset);
+			face_serialized.lighting_offset += lump_offsets[gbx_lump_number_lighting];
 		}
 		face_serialized.plane = uint32_t(planes_offset + sizeof(gbx_plane) * face_serialized.plane);
 		if (face_serialized.polygons != UINT32_MAX) {
 			face_serialized.polygons = uint32_t(face_polygons_offsets[face_serialized.polygons]);
 		}
-		std::memcpy(map.data() + faces_offset + sizeof(gbx_face) * face_number, &face_serialized, sizeof(gbx_face));
+		write(&face_serialized, sizeof(gbx_face));
+	}
+	finish_lump(gbx_lump_number_faces);
+
+	// Marksurfaces.
+	write(marksurfaces.data(), sizeof(gbx_marksurface) * marksurfaces.size());
+	finish_lump(gbx_lump_number_marksurfaces);
+
+	// Visibility.
+	write(visibility.data(), visibility.size());
+	finish_lump(gbx_lump_number_visibility);
+
+	// Lighting.
+	write(lighting.data(), lighting.size());
+	finish_lump(gbx_lump_number_lighting);
+
+	// Textures.
+	if (texture_count) {
+		// Texture information.
+		for (size_t texture_number = 0; texture_number < texture_count; ++texture_number) {
+			gbx_texture_deserialized const & texture = textures[texture_number];
+			gbx_texture texture_serialized;
+			texture_serialized.pixels = uint32_t(texture_pixels_offsets[texture_number]);
+			texture_serialized.palette = uint32_t(texture_palette_offsets[texture_number]);
+			texture_serialized.width = texture.width;
+			texture_serialized.height = texture.height;
+			texture_serialized.scaled_width = texture.scaled_width;
+			texture_serialized.scaled_height = texture.scaled_height;
+			size_t const texture_name_length = std::min(size_t(texture_name_max_length), texture.name.size());
+			std::memcpy(
+					texture_serialized.name,
+					texture.name.c_str(),
+					texture_name_length);
+			std::memset(
+					texture_serialized.name + texture_name_length,
+					0,
+					texture_name_max_length + 1 - texture_name_length);
+			std::memset(&texture_serialized.unknown_0, 0, sizeof(texture_serialized.unknown_0));
+			texture_serialized.mip_levels = texture.mip_levels;
+			std::memset(&texture_serialized.unknown_1, 0, sizeof(texture_serialized.unknown_1));
+			texture_serialized.anim_total = texture.anim_total;
+			texture_serialized.anim_min = texture.anim_min;
+			texture_serialized.anim_max = texture.anim_max;
+			texture_serialized.anim_next =
+					texture.anim_next != UINT32_MAX
+							? uint32_t(textures_offset + sizeof(gbx_texture) * texture.anim_next)
+							: UINT32_MAX;
+			texture_serialized.alternate_anims =
+					texture.alternate_anims != UINT32_MAX
+							? uint32_t(textures_offset + sizeof(gbx_texture) * texture.alternate_anims)
+							: UINT32_MAX;
+			write(&texture_serialized, sizeof(gbx_texture));
+		}
+		// Pixels.
+		for (size_t texture_number = 0; texture_number < texture_count; ++texture_number) {
+			gbx_texture_deserialized const & texture = textures[texture_number];
+			assert(position() == texture_pixels_offsets[texture_number]);
+			bool const texture_is_random =
+					gbx_texture_palette_type(texture.name.c_str()) == gbx_palette_type_random;
+			size_t const texture_pixels_size = texture_pixels_sizes[texture_number];
+			if (!texture.pixels) {
+				// Checkerboard.
+				for (uint32_t texture_mip_level = 0; texture_mip_level <= texture.mip_levels; ++texture_mip_level) {
+					uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
+					uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
+					if (!texture_mip_width || !texture_mip_height) {
+						break;
+					}
+					char * const texture_mip = write_zeros(size_t(texture_mip_width) * size_t(texture_mip_height));
+					uint32_t const checkerboard_cell_size = 8 >> texture_mip_level;
+					uint32_t const checkerboard_two_cells_mask = (checkerboard_cell_size << 1) - 1;
+					for (uint32_t texture_mip_y = 0; texture_mip_y < texture_mip_height; ++texture_mip_y) {
+						for (uint32_t texture_mip_x = 0; texture_mip_x < texture_mip_width; ++texture_mip_x) {
+							uint32_t checkerboard_y =
+									texture_is_random
+											? deinterleave_random_gbx_texture_y(texture_mip_y, texture_mip_height)
+											: texture_mip_y;
+							texture_mip[texture_mip_y * size_t(texture_mip_width) + texture_mip_x] = char(
+									(((checkerboard_y & checkerboard_two_cells_mask) < checkerboard_cell_size) !=
+									((texture_mip_x & checkerboard_two_cells_mask) < checkerboard_cell_size))
+											? 0
+											: 255);
+						}
+					}
+				}
+			} else {
+				assert(texture_pixels_size <= texture.pixels->size());
+				if (texture_is_random) {
+					// Interleave the random-tiled texture.
+					size_t texture_interleave_mip_offset = 0;
+					for (uint32_t texture_mip_level = 0;
+							texture_mip_level <= texture.mip_levels;
+							++texture_mip_level) {
+						uint32_t const texture_mip_width = texture.scaled_width >> texture_mip_level;
+						uint32_t const texture_mip_height = texture.scaled_height >> texture_mip_level;
+						if (!texture_mip_width || !texture_mip_height) {
+							break;
+						}
+						for (uint32_t texture_mip_y = 0; texture_mip_y < texture_mip_height; ++texture_mip_y) {
+							write(
+									texture.pixels->data() + texture_interleave_mip_offset +
+											size_t(texture_mip_width) *
+													deinterleave_random_gbx_texture_y(
+															texture_mip_y, texture_mip_height),
+									texture_mip_width);
+						}
+						texture_interleave_mip_offset += size_t(texture_mip_width) * size_t(texture_mip_height);
+					}
+				} else {
+					// Copy all mips at once.
+					write(texture.pixels->data(), texture_pixels_size);
+				}
+			}
+		}
+		// Palettes.
+		for (size_t const texture_number : palette_texture_numbers) {
+			gbx_texture_deserialized const & texture = textures[texture_number];
+			gbx_palette_type const texture_palette_type = gbx_texture_palette_type(texture.name.c_str());
+			assert(position() == texture_palette_offsets[texture_number]);
+			char * const texture_palette_serialized = write_zeros(4 * 256);
+			if (texture.pixels) {
+				gbx_texture_deserialized_palette const & texture_palette_id_indexed =
+						texture.palette_id_indexed
+								? *texture.palette_id_indexed
+								: quake_palette.gbx_id_indexed[texture_palette_type];
+				// Reordering of colors is done with the granularity of 8 colors.
+				for (size_t color_number = 0; color_number < 256; color_number += 8) {
+					std::memcpy(
+							texture_palette_serialized +
+									4 * size_t(convert_palette_color_number(uint8_t(color_number))),
+							texture_palette_id_indexed.data() + 4 * color_number,
+							4 * 8);
+				}
+			} else if (texture_palette_type == gbx_palette_type_random) {
+				// Inverted colors.
+				for (uint32_t color_number = 0; color_number < 255; ++color_number) {
+					texture_palette_serialized[4 * color_number] = 0x7F;
+					texture_palette_serialized[4 * color_number + 1] = 0x7F;
+					texture_palette_serialized[4 * color_number + 2] = 0x7F;
+					texture_palette_serialized[4 * color_number + 3] = char(0x80);
+				}
+				texture_palette_serialized[4 * 255] = 0;
+				texture_palette_serialized[4 * 255 + 1] = 0x7F;
+				texture_palette_serialized[4 * 255 + 2] = 0;
+				texture_palette_serialized[4 * 255 + 3] = char(0x80);
+			} else {
+				for (uint32_t color_number = 0; color_number < 255; ++color_number) {
+					texture_palette_serialized[4 * color_number] = 0;
+					texture_palette_serialized[4 * color_number + 1] = 0;
+					texture_palette_serialized[4 * color_number + 2] = 0;
+					texture_palette_serialized[4 * color_number + 3] = char(0x80);
+				}
+				if (is_gbx_palette_24_bit(texture_palette_type)) {
+					if (texture_palette_type == gbx_palette_type_transparent) {
+						texture_palette_serialized[4 * 255] = 0;
+						texture_palette_serialized[4 * 255 + 1] = 0;
+						texture_palette_serialized[4 * 255 + 2] = 0;
+						texture_palette_serialized[4 * 255 + 3] = 0;
+					} else {
+						texture_palette_serialized[4 * 255] = char(0xFF);
+						texture_palette_serialized[4 * 255 + 1] = 0;
+						texture_palette_serialized[4 * 255 + 2] = char(0xFF);
+						texture_palette_serialized[4 * 255 + 3] = char(0x80);
+					}
+				} else {
+					texture_palette_serialized[4 * 255] = 0x7F;
+					texture_palette_serialized[4 * 255 + 1] = 0;
+					texture_palette_serialized[4 * 255 + 2] = 0x7F;
+					texture_palette_serialized[4 * 255 + 3] = char(0x80);
+				}
+			}
+		}
+	} else {
+		// Single checkerboard texture of the smallest possible size (16x16) with a single 8x8 mip.
+		size_t const notexture_mip_0_offset = textures_offset + sizeof(gbx_texture);
+		size_t const notexture_mip_1_offset = notexture_mip_0_offset + 16 * 16;
+		size_t const notexture_palette_offset = notexture_mip_1_offset + 8 * 8;
+		gbx_texture notexture;
+		notexture.pixels = uint32_t(notexture_mip_0_offset);
+		notexture.palette = uint32_t(notexture_palette_offset);
+		notexture.width = 16;
+		notexture.height = 16;
+		notexture.scaled_width = 16;
+		notexture.scaled_height = 16;
+		static char const notexture_name[texture_name_max_length + 1] = "notexture";
+		static_assert(sizeof(notexture.name) == sizeof(notexture_name));
+		std::memcpy(&notexture.name, &notexture_name, sizeof(notexture_name));
+		std::memset(&notexture.unknown_0, 0, sizeof(notexture.unknown_0));
+		notexture.mip_levels = 1;
+		std::memset(&notexture.unknown_1, 0, sizeof(notexture.unknown_1));
+		notexture.anim_total = 0;
+		notexture.anim_min = 0;
+		notexture.anim_max = 0;
+		notexture.anim_next = UINT32_MAX;
+		notexture.alternate_anims = UINT32_MAX;
+		write(&notexture, sizeof(gbx_texture));
+		char * const notexture_mip_0 = write_zeros(16 * 16 + 8 * 8);
+		char * const notexture_mip_1 = notexture_mip_0 + 16 * 16;
+		for (size_t notexture_y = 0; notexture_y < 8; ++notexture_y) {
+			uint8_t const notexture_row_left = ((notexture_y < 4) ? UINT8_MAX : 0);
+			uint8_t const notexture_row_right = notexture_row_left ^ UINT8_MAX;
+			char * const notexture_mip_0_row = notexture_mip_0 + (16 * 2) * notexture_y;
+			char * const notexture_mip_1_row = notexture_mip_1 + 8 * notexture_y;
+			std::memset(notexture_mip_0_row, notexture_row_left, 8);
+			std::memset(notexture_mip_0_row + 8, notexture_row_right, 8);
+			std::memset(notexture_mip_0_row + 16, notexture_row_left, 8);
+			std::memset(notexture_mip_0_row + 24, notexture_row_right, 8);
+			std::memset(notexture_mip_1_row, notexture_row_left, 4);
+			std::memset(notexture_mip_1_row + 4, notexture_row_right, 4);
+		}
+		char * const notexture_palette = write_zeros(4 * 256);
+		for (uint32_t color_number = 0; color_number < 255; ++color_number) {
+			notexture_palette[4 * color_number] = 0;
+			notexture_palette[4 * color_number + 1] = 0;
+			notexture_palette[4 * color_number + 2] = 0;
+			notexture_palette[4 * color_number + 3] = char(0x80);
+		}
+		notexture_palette[4 * 255] = 0x7F;
+		notexture_palette[4 * 255 + 1] = 0;
+		notexture_palette[4 * 255 + 2] = 0x7F;
+		notexture_palette[4 * 255 + 3] = char(0x80);
+	}
+	finish_lump(gbx_lump_number_textures);
+
+	// Entities.
+	// Null-terminated.
+	write(entities_string.c_str(), entities_string.size() + 1);
+	finish_lump(gbx_lump_number_entities);
+
+	// Polygons.
+	for (gbx_polygons_deserialized const & face_polygons : polygons) {
+		uint32_t const face_polygons_face_number = uint32_t(face_polygons.face_number);
+		write(&face_polygons_face_number, sizeof(uint32_t));
+		uint32_t const face_polygons_vertex_count = uint32_t(face_polygons.vertexes.size());
+		write(&face_polygons_vertex_count, sizeof(uint32_t));
+		write(face_polygons.vertexes.data(), sizeof(gbx_polygon_vertex) * face_polygons.vertexes.size());
+		uint32_t const face_polygons_strip_count = uint32_t(face_polygons.strips.size());
+		write(&face_polygons_strip_count, sizeof(uint32_t));
+		for (std::vector<uint16_t> const & face_polygons_strip : face_polygons.strips) {
+			uint16_t const face_polygons_strip_vertex_count = uint16_t(face_polygons_strip.size());
+			write(&face_polygons_strip_vertex_count, sizeof(uint16_t));
+			write(face_polygons_strip.data(), sizeof(uint16_t) * face_polygons_strip.size());
+			size_t const strip_end = position();
+			if (strip_end & 3) {
+				size_t const strip_padding_size = ((strip_end + 3) & ~size_t(3)) - strip_end;
+				std::memset(
+						write_zeros(strip_padding_size), char(gbx_polygon_strip_alignment_byte), strip_padding_size);
+			}
+		}
+	}
+	finish_lump(gbx_lump_number_polygons);
+
+	assert(position() == map_size);
+	if (!sink) {
+		return true;
+	}
+	flush();
+	if (sink_succeeded) {
+		sink_succeeded = sink->end();
 	}
+	return sink_succeeded;
+}
+
+struct gbx_textures_lump_header {
+	uint32_t offset;
+	uint32_t length;
+	uint32_t count;
+};
 
-	// Lumps header.
+// The map must contain at least gbx_map_header_size bytes.
+static gbx_textures_lump_header get_textures_lump_header(void const * const map) {
+	gbx_textures_lump_header textures_lump_header;
 	std::memcpy(
-			map.data() + sizeof(uint32_t),
-			lump_offsets.data(),
-			sizeof(uint32_t) * gbx_lump_count);
+			&textures_lump_header.offset,
+			reinterpret_cast<char const *>(map) + sizeof(uint32_t) * (1 + gbx_lump_number_textures),
+			sizeof(uint32_t));
 	std::memcpy(
-			map.data() + sizeof(uint32_t) * (1 + gbx_lump_count),
-			lump_lengths.data(),
-			sizeof(uint32_t) * gbx_lump_count);
+			&textures_lump_header.length,
+			reinterpret_cast<char const *>(map) + sizeof(uint32_t) * (1 + gbx_lump_count + gbx_lump_number_textures),
+			sizeof(uint32_t));
 	std::memcpy(
-			map.data() + sizeof(uint32_t) * (1 + gbx_lump_count * 2),
-			lump_counts.data(),
-			sizeof(uint32_t) * gbx_lump_count);
+			&textures_lump_header.count,
+			reinterpret_cast<char const *>(map) +
+					sizeof(uint32_t) * (1 + gbx_lump_count * 2 + gbx_lump_number_textures),
+			sizeof(uint32_t));
+	return textures_lump_header;
 }
 
 char const * gbx_map::deserialize_only_textures(
 		void const * const map, size_t const map_size, palette_set const & quake_palette) {
-	if (map_size < sizeof(uint32_t) + sizeof(uint32_t) * gbx_lump_count * 4) {
+	if (map_size < gbx_map_header_size) {
 		return "Map version and lumps are out of bounds";
 	}
 	uint32_t version;
@@ -1161,23 +1164,22 @@ char const * gbx_map::deserialize_only_textures(
 	if (version != gbx_map_version) {
 		return "Map has the wrong version number";
 	}
-	uint32_t textures_offset, textures_lump_length, texture_count;
-	std::memcpy(
-			&textures_offset,
-			reinterpret_cast<char const *>(map) +
-					sizeof(uint32_t) * (1 + gbx_lump_number_textures),
-			sizeof(uint32_t));
-	std::memcpy(
-			&textures_lump_length,
-			reinterpret_cast<char const *>(map) +
-					sizeof(uint32_t) * (1 + gbx_lump_count + gbx_lump_number_textures),
-			sizeof(uint32_t));
-	std::memcpy(
-			&texture_count,
-			reinterpret_cast<char const *>(map) +
-					sizeof(uint32_t) * (1 + gbx_lump_count * 2 + gbx_lump_number_textures),
-			sizeof(uint32_t));
-	return deserialize_textures(map, map_size, textures_offset, textures_lump_length, texture_count, quake_palette);
+	gbx_textures_lump_header const textures_lump_header = get_textures_lump_header(map);
+	return deserialize_textures(
+			map, map_size,
+			textures_lump_header.offset, textures_lump_header.length, textures_lump_header.count,
+			quake_palette);
+}
+
+size_t gbx_map::get_size_for_only_textures(void const * const map) {
+	gbx_textures_lump_header const textures_lump_header = get_textures_lump_header(map);
+	if (!textures_lump_header.count) {
+		return gbx_map_header_size;
+	}
+	if (SIZE_MAX - size_t(textures_lump_header.offset) < textures_lump_header.length) {
+		return SIZE_MAX;
+	}
+	return std::max(size_t(textures_lump_header.offset) + size_t(textures_lump_header.length), gbx_map_header_size);
 }
 
 }
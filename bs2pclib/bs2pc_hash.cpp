@@ -0,0 +1,135 @@
+#include "bs2pclib.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace bs2pc {
+
+// FIPS 180-4.
+
+static constexpr std::array<uint32_t, 64> sha256_round_constants = {
+	UINT32_C(0x428A2F98), UINT32_C(0x71374491), UINT32_C(0xB5C0FBCF), UINT32_C(0xE9B5DBA5),
+	UINT32_C(0x3956C25B), UINT32_C(0x59F111F1), UINT32_C(0x923F82A4), UINT32_C(0xAB1C5ED5),
+	UINT32_C(0xD807AA98), UINT32_C(0x12835B01), UINT32_C(0x243185BE), UINT32_C(0x550C7DC3),
+	UINT32_C(0x72BE5D74), UINT32_C(0x80DEB1FE), UINT32_C(0x9BDC06A7), UINT32_C(0xC19BF174),
+	UINT32_C(0xE49B69C1), UINT32_C(0xEFBE4786), UINT32_C(0x0FC19DC6), UINT32_C(0x240CA1CC),
+	UINT32_C(0x2DE92C6F), UINT32_C(0x4A7484AA), UINT32_C(0x5CB0A9DC), UINT32_C(0x76F988DA),
+	UINT32_C(0x983E5152), UINT32_C(0xA831C66D), UINT32_C(0xB00327C8), UINT32_C(0xBF597FC7),
+	UINT32_C(0xC6E00BF3), UINT32_C(0xD5A79147), UINT32_C(0x06CA6351), UINT32_C(0x14292967),
+	UINT32_C(0x27B70A85), UINT32_C(0x2E1B2138), UINT32_C(0x4D2C6DFC), UINT32_C(0x53380D13),
+	UINT32_C(0x650A7354), UINT32_C(0x766A0ABB), UINT32_C(0x81C2C92E), UINT32_C(0x92722C85),
+	UINT32_C(0xA2BFE8A1), UINT32_C(0xA81A664B), UINT32_C(0xC24B8B70), UINT32_C(0xC76C51A3),
+	UINT32_C(0xD192E819), UINT32_C(0xD6990624), UINT32_C(0xF40E3585), UINT32_C(0x106AA070),
+	UINT32_C(0x19A4C116), UINT32_C(0x1E376C08), UINT32_C(0x2748774C), UINT32_C(0x34B0BCB5),
+	UINT32_C(0x391C0CB3), UINT32_C(0x4ED8AA4A), UINT32_C(0x5B9CCA4F), UINT32_C(0x682E6FF3),
+	UINT32_C(0x748F82EE), UINT32_C(0x78A5636F), UINT32_C(0x84C87814), UINT32_C(0x8CC70208),
+	UINT32_C(0x90BEFFFA), UINT32_C(0xA4506CEB), UINT32_C(0xBEF9A3F7), UINT32_C(0xC67178F2),
+};
+
+static uint32_t sha256_rotate_right(uint32_t const value, unsigned int const bits) {
+	return (value >> bits) | (value << (32 - bits));
+}
+
+void sha256::update(void const * const data, size_t const size) {
+	uint8_t const * bytes = reinterpret_cast<uint8_t const *>(data);
+	size_t remaining_size = size;
+	total_size += size;
+	if (buffer_size) {
+		size_t const buffer_append_size = std::min(remaining_size, buffer.size() - buffer_size);
+		std::memcpy(buffer.data() + buffer_size, bytes, buffer_append_size);
+		buffer_size += buffer_append_size;
+		bytes += buffer_append_size;
+		remaining_size -= buffer_append_size;
+		if (buffer_size < buffer.size()) {
+			return;
+		}
+		process_block(buffer.data());
+		buffer_size = 0;
+	}
+	// Process whole blocks directly from the data.
+	while (remaining_size >= buffer.size()) {
+		process_block(bytes);
+		bytes += buffer.size();
+		remaining_size -= buffer.size();
+	}
+	std::memcpy(buffer.data(), bytes, remaining_size);
+	buffer_size = remaining_size;
+}
+
+sha256::digest sha256::finish() {
+	uint64_t const total_bits = total_size * 8;
+	// The 1 bit, zeros up to 8 bytes before the end of a block, and the length in bits in big endian.
+	uint8_t padding[64 + sizeof(uint64_t)] = {0x80};
+	size_t const padding_size = (buffer_size < 56 ? 56 : 64 + 56) - buffer_size;
+	for (size_t length_byte_number = 0; length_byte_number < sizeof(uint64_t); ++length_byte_number) {
+		padding[padding_size + length_byte_number] = uint8_t(total_bits >> (56 - 8 * length_byte_number));
+	}
+	update(padding, padding_size + sizeof(uint64_t));
+	digest result;
+	for (size_t word_number = 0; word_number < state.size(); ++word_number) {
+		for (size_t byte_number = 0; byte_number < sizeof(uint32_t); ++byte_number) {
+			result[sizeof(uint32_t) * word_number + byte_number] =
+					uint8_t(state[word_number] >> (24 - 8 * byte_number));
+		}
+	}
+	return result;
+}
+
+void sha256::process_block(uint8_t const * const block) {
+	std::array<uint32_t, 64> schedule;
+	for (size_t word_number = 0; word_number < 16; ++word_number) {
+		uint8_t const * const word_bytes = block + sizeof(uint32_t) * word_number;
+		schedule[word_number] =
+				(uint32_t(word_bytes[0]) << 24) | (uint32_t(word_bytes[1]) << 16) |
+				(uint32_t(word_bytes[2]) << 8) | uint32_t(word_bytes[3]);
+	}
+	for (size_t word_number = 16; word_number < 64; ++word_number) {
+		uint32_t const word_15 = schedule[word_number - 15], word_2 = schedule[word_number - 2];
+		uint32_t const sigma_0 =
+				sha256_rotate_right(word_15, 7) ^ sha256_rotate_right(word_15, 18) ^ (word_15 >> 3);
+		uint32_t const sigma_1 =
+				sha256_rotate_right(word_2, 17) ^ sha256_rotate_right(word_2, 19) ^ (word_2 >> 10);
+		schedule[word_number] = schedule[word_number - 16] + sigma_0 + schedule[word_number - 7] + sigma_1;
+	}
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for (size_t round_number = 0; round_number < 64; ++round_number) {
+		uint32_t const sum_1 = sha256_rotate_right(e, 6) ^ sha256_rotate_right(e, 11) ^ sha256_rotate_right(e, 25);
+		uint32_t const choice = (e & f) ^ (~e & g);
+		uint32_t const temp_1 = h + sum_1 + choice + sha256_round_constants[round_number] + schedule[round_number];
+		uint32_t const sum_0 = sha256_rotate_right(a, 2) ^ sha256_rotate_right(a, 13) ^ sha256_rotate_right(a, 22);
+		uint32_t const majority = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t const temp_2 = sum_0 + majority;
+		h = g;
+		g = f;
+		f = e;
+		e = d + temp_1;
+		d = c;
+		c = b;
+		b = a;
+		a = temp_1 + temp_2;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+std::string sha256_digest_string(sha256::digest const & digest) {
+	static char const hex_digits[] = "0123456789ABCDEF";
+	std::string digest_string(2 * digest.size(), '0');
+	for (size_t byte_number = 0; byte_number < digest.size(); ++byte_number) {
+		digest_string[2 * byte_number] = hex_digits[digest[byte_number] >> 4];
+		digest_string[2 * byte_number + 1] = hex_digits[digest[byte_number] & 15];
+	}
+	return digest_string;
+}
+
+}
@@ -76,7 +76,8 @@ void id_face::calculate_extents(
 
 char const * id_map::deserialize(
 		void const * const map, size_t const map_size, bool const quake_as_valve,
-		id_texture_deserialized_palette const & quake_palette) {
+		id_texture_deserialized_palette const & quake_palette,
+		std::shared_ptr<void const> const & map_owner) {
 	// Version and lump offsets and length.
 	std::array<id_header_lump, id_lump_count> lumps;
 	{
@@ -194,13 +195,11 @@ char const * id_map::deserialize(
 	// Visibility.
 	{
 		id_header_lump const & lump_visibility = lumps[id_lump_number_visibility];
-		visibility.clear();
-		if (lump_visibility.length) {
-			visibility.resize(lump_visibility.length);
-			std::memcpy(
-					visibility.data(),
-					reinterpret_cast<char const *>(map) + lump_visibility.offset,
-					lump_visibility.length);
+		char const * const visibility_data = reinterpret_cast<char const *>(map) + lump_visibility.offset;
+		if (map_owner) {
+			visibility.borrow(map_owner, visibility_data, lump_visibility.length);
+		} else {
+			visibility.assign(visibility_data, lump_visibility.length);
 		}
 	}
 
@@ -258,14 +257,11 @@ char const * id_map::deserialize(
 	// Lighting.
 	{
 		id_header_lump const & lump_lighting = lumps[id_lump_number_lighting];
-		lighting.clear();
-		uint32_t const lighting_length = lump_lighting.length;
-		if (lighting_length) {
-			lighting.resize(lighting_length);
-			std::memcpy(
-					lighting.data(),
-					reinterpret_cast<char const *>(map) + lump_lighting.offset,
-					lighting_length);
+		char const * const lighting_data = reinterpret_cast<char const *>(map) + lump_lighting.offset;
+		if (map_owner) {
+			lighting.borrow(map_owner, lighting_data, lump_lighting.length);
+		} else {
+			lighting.assign(lighting_data, lump_lighting.length);
 		}
 	}
 
@@ -375,288 +371,232 @@ char const * id_map::deserialize(
 }
 
 void id_map::serialize(std::vector<char> & map, id_texture_deserialized_palette const & quake_palette) const {
-	map.clear();
+	serialize(map, nullptr, quake_palette);
+}
+
+bool id_map::serialize(seekable_map_sink & sink, id_texture_deserialized_palette const & quake_palette) const {
+	std::vector<char> buffer;
+	return serialize(buffer, &sink, quake_palette);
+}
+
+// When serializing to a sink, small writes are gathered in a buffer of about this size before passing them to the
+// sink, and large ones are passed directly.
+static constexpr size_t id_map_serialize_buffer_size = size_t(1) << 16;
+
+bool id_map::serialize(
+		std::vector<char> & buffer, seekable_map_sink * const sink,
+		id_texture_deserialized_palette const & quake_palette) const {
+	buffer.clear();
 	// As a result of the clear, all padding created by resizing will be zero-initialized.
+	if (sink) {
+		buffer.reserve(id_map_serialize_buffer_size);
+	}
+	// The size of the data already passed from the buffer to the sink.
+	size_t flushed_size = 0;
+	bool sink_succeeded = true;
 
-	// Reserve aligned space for the header.
-	map.resize(
-			(sizeof(uint32_t) + sizeof(id_header_lump) * id_lump_count + (id_lump_alignment - 1)) &
-					~size_t(id_lump_alignment - 1));
+	auto const position = [&buffer, &flushed_size]() -> size_t {
+		return flushed_size + buffer.size();
+	};
+	auto const flush = [&buffer, sink, &flushed_size, &sink_succeeded]() {
+		if (buffer.empty()) {
+			return;
+		}
+		if (sink_succeeded) {
+			sink_succeeded = sink->write(buffer.data(), buffer.size());
+		}
+		flushed_size += buffer.size();
+		buffer.clear();
+	};
+	auto const write = [&buffer, sink, &flushed_size, &sink_succeeded, &flush](
+			void const * const data, size_t const size) {
+		if (sink && buffer.size() + size > id_map_serialize_buffer_size) {
+			flush();
+			if (size >= id_map_serialize_buffer_size) {
+				if (sink_succeeded) {
+					sink_succeeded = sink->write(data, size);
+				}
+				flushed_size += size;
+				return;
+			}
+		}
+		buffer.insert(
+				buffer.end(), reinterpret_cast<char const *>(data), reinterpret_cast<char const *>(data) + size);
+	};
+	auto const write_zeros = [&buffer, sink, &flush](size_t const size) {
+		if (sink && buffer.size() + size > id_map_serialize_buffer_size) {
+			flush();
+		}
+		buffer.resize(buffer.size() + size);
+	};
+	// Replaces the data that has already been written, either in the buffer or passed to the sink.
+	auto const overwrite = [&buffer, sink, &flushed_size, &sink_succeeded](
+			size_t const offset, void const * const data, size_t const size) {
+		assert(offset + size <= flushed_size + buffer.size());
+		size_t flushed_part_size = 0;
+		if (offset < flushed_size) {
+			flushed_part_size = std::min(flushed_size - offset, size);
+			if (sink_succeeded) {
+				sink_succeeded = sink->overwrite(offset, data, flushed_part_size);
+			}
+		}
+		if (flushed_part_size < size) {
+			std::memcpy(
+					buffer.data() + (offset + flushed_part_size - flushed_size),
+					reinterpret_cast<char const *>(data) + flushed_part_size,
+					size - flushed_part_size);
+		}
+	};
 
-	// Version.
+	// Version, and aligned space for the lumps header written in the end.
 	static_assert(sizeof(version) == sizeof(uint32_t));
-	std::memcpy(map.data(), &version, sizeof(uint32_t));
+	write(&version, sizeof(uint32_t));
+	write_zeros(
+			((sizeof(uint32_t) + sizeof(id_header_lump) * id_lump_count + (id_lump_alignment - 1)) &
+					~size_t(id_lump_alignment - 1)) -
+			sizeof(uint32_t));
 
 	std::array<id_header_lump, id_lump_count> lumps;
 
-	auto const finish_lump = [&map, &lumps](id_lump_number lump_number) {
-		size_t const map_current_size = map.size();
-		lumps[lump_number].length = uint32_t(map_current_size - lumps[lump_number].offset);
+	auto const finish_lump = [&lumps, &position, &write_zeros](id_lump_number lump_number) {
+		size_t const lump_end = position();
+		lumps[lump_number].length = uint32_t(lump_end - lumps[lump_number].offset);
 		// Align the end of the lump.
-		map.resize(map_current_size + (id_lump_alignment - 1) & ~size_t(id_lump_alignment - 1));
+		write_zeros(((lump_end + (id_lump_alignment - 1)) & ~size_t(id_lump_alignment - 1)) - lump_end);
+	};
+	auto const write_lump = [&lumps, &position, &write, &finish_lump](
+			id_lump_number const lump_number, void const * const data, size_t const size) {
+		lumps[lump_number].offset = uint32_t(position());
+		write(data, size);
+		finish_lump(lump_number);
 	};
 
 	// Planes.
-	{
-		size_t const planes_offset = map.size();
-		size_t const plane_count = planes.size();
-		lumps[id_lump_number_planes].offset = uint32_t(planes_offset);
-		if (plane_count) {
-			map.resize(planes_offset + sizeof(id_plane) * plane_count);
-			std::memcpy(map.data() + planes_offset, planes.data(), sizeof(id_plane) * plane_count);
-		}
-		finish_lump(id_lump_number_planes);
-	}
+	write_lump(id_lump_number_planes, planes.data(), sizeof(id_plane) * planes.size());
 
 	// Leafs.
-	{
-		size_t const leafs_offset = map.size();
-		size_t const leaf_count = leafs.size();
-		lumps[id_lump_number_leafs].offset = uint32_t(leafs_offset);
-		if (leaf_count) {
-			map.resize(leafs_offset + sizeof(id_leaf) * leaf_count);
-			std::memcpy(map.data() + leafs_offset, leafs.data(), sizeof(id_leaf) * leaf_count);
-		}
-		finish_lump(id_lump_number_leafs);
-	}
+	write_lump(id_lump_number_leafs, leafs.data(), sizeof(id_leaf) * leafs.size());
 
 	// Vertexes.
-	{
-		size_t const vertexes_offset = map.size();
-		size_t const vertex_count = vertexes.size();
-		lumps[id_lump_number_vertexes].offset = uint32_t(vertexes_offset);
-		if (vertex_count) {
-			map.resize(vertexes_offset + sizeof(vector3) * vertex_count);
-			std::memcpy(map.data() + vertexes_offset, vertexes.data(), sizeof(vector3) * vertex_count);
-		}
-		finish_lump(id_lump_number_vertexes);
-	}
+	write_lump(id_lump_number_vertexes, vertexes.data(), sizeof(vector3) * vertexes.size());
 
 	// Nodes.
-	{
-		size_t const nodes_offset = map.size();
-		size_t const node_count = nodes.size();
-		lumps[id_lump_number_nodes].offset = uint32_t(nodes_offset);
-		if (node_count) {
-			map.resize(nodes_offset + sizeof(id_node) * node_count);
-			std::memcpy(map.data() + nodes_offset, nodes.data(), sizeof(id_node) * node_count);
-		}
-		finish_lump(id_lump_number_nodes);
-	}
+	write_lump(id_lump_number_nodes, nodes.data(), sizeof(id_node) * nodes.size());
 
 	// Texinfo.
-	{
-		size_t const texinfo_offset = map.size();
-		size_t const texinfo_count = texinfo.size();
-		lumps[id_lump_number_texinfo].offset = uint32_t(texinfo_offset);
-		if (texinfo_count) {
-			map.resize(texinfo_offset + sizeof(id_texinfo) * texinfo_count);
-			std::memcpy(map.data() + texinfo_offset, texinfo.data(), sizeof(id_texinfo) * texinfo_count);
-		}
-		finish_lump(id_lump_number_texinfo);
-	}
+	write_lump(id_lump_number_texinfo, texinfo.data(), sizeof(id_texinfo) * texinfo.size());
 
 	// Faces.
-	{
-		size_t const faces_offset = map.size();
-		size_t const face_count = faces.size();
-		lumps[id_lump_number_faces].offset = uint32_t(faces_offset);
-		if (face_count) {
-			map.resize(faces_offset + sizeof(id_face) * face_count);
-			std::memcpy(map.data() + faces_offset, faces.data(), sizeof(id_face) * face_count);
-		}
-		finish_lump(id_lump_number_faces);
-	}
+	write_lump(id_lump_number_faces, faces.data(), sizeof(id_face) * faces.size());
 
 	// Clipnodes.
-	{
-		size_t const clipnodes_offset = map.size();
-		size_t const clipnode_count = clipnodes.size();
-		lumps[id_lump_number_clipnodes].offset = uint32_t(clipnodes_offset);
-		if (clipnode_count) {
-			map.resize(clipnodes_offset + sizeof(clipnode) * clipnode_count);
-			std::memcpy(map.data() + clipnodes_offset, clipnodes.data(), sizeof(clipnode) * clipnode_count);
-		}
-		finish_lump(id_lump_number_clipnodes);
-	}
+	write_lump(id_lump_number_clipnodes, clipnodes.data(), sizeof(clipnode) * clipnodes.size());
 
 	// Marksurfaces.
-	{
-		size_t const marksurfaces_offset = map.size();
-		size_t const marksurface_count = marksurfaces.size();
-		lumps[id_lump_number_marksurfaces].offset = uint32_t(marksurfaces_offset);
-		if (marksurface_count) {
-			map.resize(marksurfaces_offset + sizeof(id_marksurface) * marksurface_count);
-			std::memcpy(
-					map.data() + marksurfaces_offset,
-					marksurfaces.data(),
-					sizeof(id_marksurface) * marksurface_count);
-		}
-		finish_lump(id_lump_number_marksurfaces);
-	}
+	write_lump(id_lump_number_marksurfaces, marksurfaces.data(), sizeof(id_marksurface) * marksurfaces.size());
 
 	// Surfedges.
-	{
-		size_t const surfedges_offset = map.size();
-		size_t const surfedge_count = surfedges.size();
-		lumps[id_lump_number_surfedges].offset = uint32_t(surfedges_offset);
-		if (surfedge_count) {
-			map.resize(surfedges_offset + sizeof(surfedge) * surfedge_count);
-			std::memcpy(map.data() + surfedges_offset, surfedges.data(), sizeof(surfedge) * surfedge_count);
-		}
-		finish_lump(id_lump_number_surfedges);
-	}
+	write_lump(id_lump_number_surfedges, surfedges.data(), sizeof(surfedge) * surfedges.size());
 
 	// Edges.
-	{
-		size_t const edges_offset = map.size();
-		size_t const edge_count = edges.size();
-		lumps[id_lump_number_edges].offset = uint32_t(edges_offset);
-		if (edge_count) {
-			map.resize(edges_offset + sizeof(edge) * edge_count);
-			std::memcpy(map.data() + edges_offset, edges.data(), sizeof(edge) * edge_count);
-		}
-		finish_lump(id_lump_number_edges);
-	}
+	write_lump(id_lump_number_edges, edges.data(), sizeof(edge) * edges.size());
 
 	// Models.
-	{
-		size_t const models_offset = map.size();
-		size_t const model_count = models.size();
-		lumps[id_lump_number_models].offset = uint32_t(models_offset);
-		if (model_count) {
-			map.resize(models_offset + sizeof(id_model) * model_count);
-			std::memcpy(map.data() + models_offset, models.data(), sizeof(id_model) * model_count);
-		}
-		finish_lump(id_lump_number_models);
-	}
+	write_lump(id_lump_number_models, models.data(), sizeof(id_model) * models.size());
 
 	// Lighting.
-	{
-		size_t const lighting_offset = map.size();
-		size_t const lighting_length = lighting.size();
-		lumps[id_lump_number_lighting].offset = uint32_t(lighting_offset);
-		if (lighting_length) {
-			map.resize(lighting_offset + lighting_length);
-			std::memcpy(map.data() + lighting_offset, lighting.data(), lighting_length);
-		}
-		finish_lump(id_lump_number_lighting);
-	}
+	write_lump(id_lump_number_lighting, lighting.data(), lighting.size());
 
 	// Visibility.
-	{
-		size_t const visibility_offset = map.size();
-		size_t const visibility_length = visibility.size();
-		lumps[id_lump_number_visibility].offset = uint32_t(visibility_offset);
-		if (visibility_length) {
-			map.resize(visibility_offset + visibility_length);
-			std::memcpy(map.data() + visibility_offset, visibility.data(), visibility_length);
-		}
-		finish_lump(id_lump_number_visibility);
-	}
+	write_lump(id_lump_number_visibility, visibility.data(), visibility.size());
 
 	// Entities.
 	{
-		size_t const entities_offset = map.size();
-		std::string entities_string = serialize_entities(entities.data(), entities.size());
+		std::string entities_string = serialize_entities(entities);
 		// Null-terminated.
-		size_t const entities_length = entities_string.size() + 1;
-		lumps[id_lump_number_entities].offset = uint32_t(entities_offset);
-		map.resize(entities_offset + entities_length);
-		std::memcpy(map.data() + entities_offset, entities_string.c_str(), entities_length);
-		finish_lump(id_lump_number_entities);
+		write_lump(id_lump_number_entities, entities_string.c_str(), entities_string.size() + 1);
 	}
 
 	// Textures.
 	{
-		size_t const textures_offset = map.size();
+		size_t const textures_offset = position();
 		uint32_t const texture_count = uint32_t(textures.size());
 		lumps[id_lump_number_textures].offset = uint32_t(textures_offset);
 		// If no textures, a special case (lump length 0).
 		// Makes the engine use the checkerboard for all textures, ignoring the texinfo texture numbers.
 		if (texture_count) {
-			// Reserve space for the texture count and the texture offsets relative to the lump.
-			map.resize(textures_offset + sizeof(uint32_t) + sizeof(uint32_t) * texture_count);
 			// Write the texture count.
 			static_assert(sizeof(texture_count) == sizeof(uint32_t));
-			std::memcpy(map.data() + textures_offset, &texture_count, sizeof(uint32_t));
+			write(&texture_count, sizeof(uint32_t));
+			// Reserve space for the texture offsets relative to the lump, written after the textures.
+			std::vector<uint32_t> texture_offsets(texture_count, UINT32_MAX);
+			size_t const texture_offsets_offset = position();
+			write_zeros(sizeof(uint32_t) * texture_count);
 			for (uint32_t texture_number = 0; texture_number < texture_count; ++texture_number) {
-				uint32_t texture_offset;
 				id_texture_deserialized const & texture = textures[texture_number];
-				if (!texture.empty()) {
-					size_t const texture_map_offset = map.size();
-					texture_offset = uint32_t(texture_map_offset - textures_offset);
-					// Reserve space for the texture header.
-					map.resize(texture_map_offset + sizeof(id_texture));
-					id_texture texture_serialized;
-					// Clear the unused name characters, and initialize the offsets to 0 for a WAD texture.
-					std::memset(&texture_serialized, 0, sizeof(id_texture));
-					std::memcpy(
-							texture_serialized.name,
-							texture.name.data(),
-							std::min(size_t(texture_name_max_length), texture.name.size()));
-					texture_serialized.width = texture.width;
-					texture_serialized.height = texture.height;
-					if (texture.pixels) {
-						// Not a WAD texture.
-						size_t const texture_pixel_count =
-								texture_pixel_count_with_mips(texture.width, texture.height, id_texture_mip_levels);
-						assert(texture.pixels->size() == texture_pixel_count);
-						size_t const texture_pixels_offset = map.size();
-						map.resize(texture_pixels_offset + texture_pixel_count);
-						std::memcpy(
-								map.data() + texture_pixels_offset,
-								texture.pixels->data(),
-								texture_pixel_count);
-						if (version >= id_map_version_valve) {
-							id_texture_deserialized_palette const & texture_palette =
-									(texture.palette ? *texture.palette : quake_palette);
-							uint16_t const texture_palette_color_count = uint16_t(texture_palette.size() / 3);
-							size_t const texture_palette_offset = map.size();
-							map.resize(
-									texture_palette_offset +
-									sizeof(uint16_t) + 3 * size_t(texture_palette_color_count));
-							static_assert(sizeof(texture_palette_color_count) == sizeof(uint16_t));
-							std::memcpy(
-									map.data() + texture_palette_offset,
-									&texture_palette_color_count,
-									sizeof(uint16_t));
-							std::memcpy(
-									map.data() + texture_palette_offset + sizeof(uint16_t),
-									texture_palette.data(),
-									3 * size_t(texture_palette_color_count));
-						}
-						// Textures are 4-aligned (2 padding bytes after a 256-color palette prefixed with color count
-						// uint16_t, for example).
-						map.resize((map.size() + (sizeof(uint32_t) - 1)) & ~(sizeof(uint32_t) - 1));
-						// Mip offsets.
-						size_t texture_mip_offset = sizeof(id_texture);
-						for (uint32_t texture_mip_level = 0;
-								texture_mip_level < id_texture_mip_levels;
-								++texture_mip_level) {
-							texture_serialized.offsets[texture_mip_level] = uint32_t(texture_mip_offset);
-							texture_mip_offset +=
-									size_t(texture.width >> texture_mip_level) *
-									size_t(texture.height >> texture_mip_level);
-						}
-					}
-					std::memcpy(map.data() + texture_map_offset, &texture_serialized, sizeof(id_texture));
-				} else {
-					texture_offset = UINT32_MAX;
+				if (texture.empty()) {
+					continue;
 				}
-				// Write the texture offset to the header of the lump.
-				static_assert(sizeof(texture_offset) == sizeof(uint32_t));
+				texture_offsets[texture_number] = uint32_t(position() - textures_offset);
+				id_texture texture_serialized;
+				// Clear the unused name characters, and initialize the offsets to 0 for a WAD texture.
+				std::memset(&texture_serialized, 0, sizeof(id_texture));
 				std::memcpy(
-						map.data() + textures_offset + sizeof(uint32_t) + sizeof(uint32_t) * texture_number,
-						&texture_offset,
-						sizeof(uint32_t));
+						texture_serialized.name,
+						texture.name.data(),
+						std::min(size_t(texture_name_max_length), texture.name.size()));
+				texture_serialized.width = texture.width;
+				texture_serialized.height = texture.height;
+				if (texture.pixels) {
+					// Not a WAD texture.
+					// Mip offsets.
+					size_t texture_mip_offset = sizeof(id_texture);
+					for (uint32_t texture_mip_level = 0;
+							texture_mip_level < id_texture_mip_levels;
+							++texture_mip_level) {
+						texture_serialized.offsets[texture_mip_level] = uint32_t(texture_mip_offset);
+						texture_mip_offset +=
+								size_t(texture.width >> texture_mip_level) *
+								size_t(texture.height >> texture_mip_level);
+					}
+				}
+				write(&texture_serialized, sizeof(id_texture));
+				if (texture.pixels) {
+					size_t const texture_pixel_count =
+							texture_pixel_count_with_mips(texture.width, texture.height, id_texture_mip_levels);
+					assert(texture.pixels->size() == texture_pixel_count);
+					write(texture.pixels->data(), texture_pixel_count);
+					if (version >= id_map_version_valve) {
+						id_texture_deserialized_palette const & texture_palette =
+								(texture.palette ? *texture.palette : quake_palette);
+						uint16_t const texture_palette_color_count = uint16_t(texture_palette.size() / 3);
+						static_assert(sizeof(texture_palette_color_count) == sizeof(uint16_t));
+						write(&texture_palette_color_count, sizeof(uint16_t));
+						write(texture_palette.data(), 3 * size_t(texture_palette_color_count));
+					}
+					// Textures are 4-aligned (2 padding bytes after a 256-color palette prefixed with color count
+					// uint16_t, for example).
+					size_t const texture_end = position();
+					write_zeros(((texture_end + (sizeof(uint32_t) - 1)) & ~(sizeof(uint32_t) - 1)) - texture_end);
+				}
 			}
+			// Write the texture offsets to the header of the lump.
+			overwrite(texture_offsets_offset, texture_offsets.data(), sizeof(uint32_t) * texture_count);
 		}
 		finish_lump(id_lump_number_textures);
 	}
 
 	// Lumps header.
-	std::memcpy(map.data() + sizeof(uint32_t), lumps.data(), sizeof(id_header_lump) * id_lump_count);
+	overwrite(sizeof(uint32_t), lumps.data(), sizeof(id_header_lump) * id_lump_count);
+
+	if (!sink) {
+		return true;
+	}
+	flush();
+	if (sink_succeeded) {
+		sink_succeeded = sink->end();
+	}
+	return sink_succeeded;
 }
 
 void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbulent) {
@@ -684,11 +624,15 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 
 			struct subdivision_face {
 				// Empty if removed after having been split.
-				std::vector<size_t> vertexes;
+				std::pmr::vector<size_t> vertexes;
 				// SIZE_MAX if no next face.
 				size_t next = SIZE_MAX;
+
+				explicit subdivision_face(std::pmr::memory_resource * const resource) : vertexes(resource) {}
 			};
 			std::vector<subdivision_face> subdivision_faces;
+			// The vertexes of the subdivision faces, freed after every face.
+			scratch_arena subdivision_face_arena;
 
 			static constexpr float subdivide_size = 240.0f;
 
@@ -696,6 +640,9 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 			// -1 for in the back, 0 for on the plane, 1 for in the front.
 			std::vector<int> plane_sides;
 
+			// For welding the split vertexes to the existing ones without searching in all the vertexes of the map.
+			vertex_weld_index split_vertex_weld_index(add_vertex_epsilon);
+
 			struct edge_face {
 				size_t face_number = SIZE_MAX;
 				// is_new_face_number = false - not subdivided, face_number is the number within the old face lump.
@@ -726,11 +673,13 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 				}
 
 				subdivision_faces.clear();
+				subdivision_face_arena.reset();
 
 				// Construct the original face to start subdividing.
 				size_t face_subdivision_face_number = subdivision_faces.size();
 				{
-					subdivision_face & initial_subdivision_face = subdivision_faces.emplace_back();
+					subdivision_face & initial_subdivision_face =
+							subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 					initial_subdivision_face.vertexes.reserve(face.edge_count);
 					for (size_t face_edge_number = 0; face_edge_number < face.edge_count; ++face_edge_number) {
 						surfedge const face_surfedge = surfedges[face.first_edge + face_edge_number];
@@ -831,15 +780,13 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 								front_face_number = current_face_number;
 								back_face_number = SIZE_MAX;
 							} else {
-								face_subdivided = true;
-
 								plane_distances.push_back(plane_distances.front());
 								plane_sides.push_back(plane_sides.front());
 
 								back_face_number = subdivision_faces.size();
-								subdivision_faces.emplace_back();
+								subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 								front_face_number = subdivision_faces.size();
-								subdivision_faces.emplace_back();
+								subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 								// Update the pointer after potential reallocations.
 								current_face = &subdivision_faces[current_face_number];
 								subdivision_face & back_face = subdivision_faces[back_face_number];
@@ -894,11 +841,24 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 																	face_vertex.v[split_vertex_component]);
 										}
 									}
-									size_t const split_vertex_index = add_vertex(vertexes, split_vertex);
+									size_t const split_vertex_index =
+											add_vertex(vertexes, split_vertex, split_vertex_weld_index);
 									back_face.vertexes.push_back(split_vertex_index);
 									front_face.vertexes.push_back(split_vertex_index);
 								}
 
+								if (back_face.vertexes == current_face->vertexes ||
+										front_face.vertexes == current_face->vertexes) {
+									// A vertex slightly farther than epsilon from the split plane, with the split
+									// vertex having been merged back into it, so the face would be split the same way
+									// infinitely. Keep the face as is.
+									subdivision_faces.pop_back();
+									subdivision_faces.pop_back();
+									break;
+								}
+
+								face_subdivided = true;
+
 								// Remove the subdivided face.
 								current_face->vertexes.clear();
 							}
@@ -1163,13 +1123,14 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 				for (size_t const face_number : turbulent_lightmap_faces) {
 					faces[face_number].lighting_offset = uint32_t(lighting.size());
 				}
-				lighting.resize(lighting.size() + turbulent_lightmap_size, turbulent_lighting_value);
+				lighting.modify().resize(lighting.size() + turbulent_lightmap_size, turbulent_lighting_value);
 			}
 			if (turbulent_lightmap_size_bright) {
 				for (size_t const face_number : turbulent_lightmap_faces_bright) {
 					faces[face_number].lighting_offset = uint32_t(lighting.size());
 				}
-				lighting.resize(lighting.size() + turbulent_lightmap_size_bright, turbulent_lighting_value_bright);
+				lighting.modify().resize(
+						lighting.size() + turbulent_lightmap_size_bright, turbulent_lighting_value_bright);
 			}
 		}
 
@@ -1203,17 +1164,18 @@ void id_map::upgrade_from_quake_without_model_paths(bool const subdivide_turbule
 			face.lighting_offset *= 3;
 		}
 	}
-	size_t const lighting_luminance_count = lighting.size();
-	lighting.resize(3 * lighting_luminance_count);
+	std::vector<uint8_t> & lighting_rgb = lighting.modify();
+	size_t const lighting_luminance_count = lighting_rgb.size();
+	lighting_rgb.resize(3 * lighting_luminance_count);
 	for (size_t lighting_reverse_index = 0;
 			lighting_reverse_index < lighting_luminance_count;
 			++lighting_reverse_index) {
 		uint32_t const lighting_index = lighting_luminance_count - 1 - lighting_reverse_index;
-		uint8_t const lighting_luminance = lighting[lighting_index];
+		uint8_t const lighting_luminance = lighting_rgb[lighting_index];
 		size_t const lighting_rgb_offset = 3 * size_t(lighting_index);
-		lighting[lighting_rgb_offset] = lighting_luminance;
-		lighting[lighting_rgb_offset + 1] = lighting_luminance;
-		lighting[lighting_rgb_offset + 2] = lighting_luminance;
+		lighting_rgb[lighting_rgb_offset] = lighting_luminance;
+		lighting_rgb[lighting_rgb_offset + 1] = lighting_luminance;
+		lighting_rgb[lighting_rgb_offset + 2] = lighting_luminance;
 	}
 }
 
@@ -1,12 +1,12 @@
 #include "bs2pclib.hpp"
 
-#include <string>
+#include <string_view>
 
 namespace bs2pc {
 
-std::string parse_token(char const * & data) {
+std::string_view parse_token(char const * & data) {
 	if (!data) {
-		return std::string();
+		return std::string_view();
 	}
 
 	char character;
@@ -16,7 +16,7 @@ std::string parse_token(char const * & data) {
 		while (static_cast<unsigned char>(character = *data) <= ' ') {
 			if (!character) {
 				// End of file.
-				return std::string();
+				return std::string_view();
 			}
 			++data;
 		}
@@ -31,20 +31,20 @@ std::string parse_token(char const * & data) {
 		}
 	}
 
-	std::string token;
-
 	// Handle quoted strings specially.
 	if (character == '"') {
 		++data;
+		char const * const token_start = data;
 		while (true) {
 			character = *data++;
 			if (character == '"' || !character) {
-				return token;
+				return std::string_view(token_start, size_t(data - 1 - token_start));
 			}
-			token.push_back(character);
 		}
 	}
 
+	char const * const token_start = data;
+
 	// Parse single characters.
 	if (character == '{' ||
 			character == '}' ||
@@ -52,14 +52,12 @@ std::string parse_token(char const * & data) {
 			character == '(' ||
 			character == '\'' ||
 			character == ':') {
-		token.push_back(character);
 		++data;
-		return token;
+		return std::string_view(token_start, 1);
 	}
 
 	// Parse a regular word.
 	do {
-		token.push_back(character);
 		++data;
 		character = *data;
 		if (character == '{' ||
@@ -72,7 +70,7 @@ std::string parse_token(char const * & data) {
 		}
 	} while (static_cast<unsigned int>(character) > ' ');
 
-	return token;
+	return std::string_view(token_start, size_t(data - token_start));
 }
 
 }
@@ -1,6 +1,7 @@
 #include "bs2pclib.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cfloat>
 #include <cmath>
@@ -8,32 +9,92 @@
 #include <cstdint>
 #include <iterator>
 #include <ostream>
+#include <thread>
 #include <utility>
 #include <vector>
 
 namespace bs2pc {
 
-void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, size_t const polygons_count) {
+// The number of faces processed at once by a thread in parallel polygon generation.
+static constexpr size_t make_polygons_parallel_batch_size = 64;
+
+void gbx_map::make_polygons(
+		gbx_polygons_deserialized * const polygons_start, size_t const polygons_count, size_t const thread_count) {
+	if (thread_count > 1 && polygons_count > make_polygons_parallel_batch_size) {
+		// The faces are taken in batches from a shared counter rather than split into one range per thread, as the
+		// cost of different faces varies greatly (large liquid and sky faces are subdivided into many polygons).
+		// Every batch is processed by a single-threaded call, which has its own scratch buffers.
+		size_t const batch_count =
+				(polygons_count + (make_polygons_parallel_batch_size - 1)) / make_polygons_parallel_batch_size;
+		std::atomic<size_t> next_batch_index(0);
+		auto const make_batches = [&]() {
+			while (true) {
+				size_t const batch_index = next_batch_index.fetch_add(1, std::memory_order_relaxed);
+				if (batch_index >= batch_count) {
+					break;
+				}
+				size_t const batch_first_polygons = batch_index * make_polygons_parallel_batch_size;
+				make_polygons(
+						polygons_start + batch_first_polygons,
+						std::min(make_polygons_parallel_batch_size, polygons_count - batch_first_polygons));
+			}
+		};
+		// The calling thread processes batches too.
+		std::vector<std::thread> threads;
+		size_t const additional_thread_count = std::min(thread_count, batch_count) - 1;
+		threads.reserve(additional_thread_count);
+		for (size_t thread_index = 0; thread_index < additional_thread_count; ++thread_index) {
+			threads.emplace_back(make_batches);
+		}
+		make_batches();
+		for (std::thread & thread : threads) {
+			thread.join();
+		}
+		return;
+	}
+
 	// ON_EPSILON.
 	static constexpr float epsilon = 0.01f;
 
+	// A vertex closer than epsilon on every axis to an existing one is welded to the existing vertex with the lowest
+	// number among them.
+	// For the few vertexes of most faces, a linear search is faster, so the index for faces subdivided into many
+	// vertexes is only built once there are enough vertexes.
+	static constexpr size_t subdivision_vertex_weld_index_min_vertex_count = 32;
 	std::vector<vector3> subdivision_vertexes;
-	auto add_subdivision_vertex = [&subdivision_vertexes](vector3 const vertex) -> size_t {
-		for (size_t vertex_number = 0; vertex_number < subdivision_vertexes.size(); ++vertex_number) {
-			vector3 const & existing_vertex = subdivision_vertexes[vertex_number];
-			if (std::abs(existing_vertex.v[0] - vertex.v[0]) < epsilon &&
-					std::abs(existing_vertex.v[1] - vertex.v[1]) < epsilon &&
-					std::abs(existing_vertex.v[2] - vertex.v[2]) < epsilon) {
-				return vertex_number;
+	vertex_weld_index subdivision_vertex_weld_index(epsilon);
+	auto const add_subdivision_vertex = [&](vector3 const vertex) -> size_t {
+		size_t const new_vertex_number = subdivision_vertexes.size();
+		if (new_vertex_number < subdivision_vertex_weld_index_min_vertex_count) {
+			for (size_t vertex_number = 0; vertex_number < new_vertex_number; ++vertex_number) {
+				vector3 const & existing_vertex = subdivision_vertexes[vertex_number];
+				if (std::abs(existing_vertex.v[0] - vertex.v[0]) < epsilon &&
+						std::abs(existing_vertex.v[1] - vertex.v[1]) < epsilon &&
+						std::abs(existing_vertex.v[2] - vertex.v[2]) < epsilon) {
+					return vertex_number;
+				}
+			}
+			subdivision_vertexes.push_back(vertex);
+			if (subdivision_vertexes.size() >= subdivision_vertex_weld_index_min_vertex_count) {
+				// Build the index for the further vertexes.
+				for (vector3 const & subdivision_vertex : subdivision_vertexes) {
+					subdivision_vertex_weld_index.push_back(subdivision_vertex);
+				}
 			}
+			return new_vertex_number;
+		}
+		size_t const weld_vertex_number = subdivision_vertex_weld_index.find(subdivision_vertexes.data(), vertex);
+		if (weld_vertex_number != SIZE_MAX) {
+			return weld_vertex_number;
 		}
 		subdivision_vertexes.push_back(vertex);
-		return subdivision_vertexes.size() - 1;
+		subdivision_vertex_weld_index.push_back(vertex);
+		return new_vertex_number;
 	};
 
 	struct subdivision_face {
 		// Empty if removed after having been split.
-		std::vector<size_t> vertexes;
+		std::pmr::vector<size_t> vertexes;
 		// SIZE_MAX if no next face.
 		size_t next = SIZE_MAX;
 
@@ -43,6 +104,8 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 		std::pair<size_t, size_t> chain_prev{SIZE_MAX, SIZE_MAX};
 		std::pair<size_t, size_t> chain_next{SIZE_MAX, SIZE_MAX};
 
+		explicit subdivision_face(std::pmr::memory_resource * const resource) : vertexes(resource) {}
+
 		// <This face edge, other face edge>, or SIZE_MAX if not found.
 		std::pair<size_t, size_t> find_chaining_edge(subdivision_face const & other) const {
 			assert(this != &other);
@@ -77,6 +140,8 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 	};
 
 	std::vector<subdivision_face> subdivision_faces;
+	// The vertexes of the subdivision faces, freed after every face.
+	scratch_arena subdivision_face_arena;
 
 	std::vector<float> plane_distances;
 	// -1 for in the back, 0 for on the plane, 1 for in the front.
@@ -84,6 +149,12 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 
 	// <First face, last face>, or both SIZE_MAX if the chain has been fully consumed by another.
 	std::vector<std::pair<size_t, size_t>> chains;
+	// For looking up the chains to merge, the subdivision faces containing each vertex, from
+	// subdivision_vertex_faces[subdivision_vertex_face_offsets[vertex]] to
+	// subdivision_vertex_faces[subdivision_vertex_face_offsets[vertex + 1]].
+	std::vector<size_t> subdivision_vertex_face_offsets;
+	std::vector<size_t> subdivision_vertex_faces;
+	std::vector<size_t> chains_to_merge;
 
 	for (size_t polygons_number = 0; polygons_number < polygons_count; ++polygons_number) {
 		gbx_polygons_deserialized & face_polygons = polygons_start[polygons_number];
@@ -99,13 +170,15 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 		// However, faces placed next to each other will be subdivided continuously like in Quake GL_SubdivideSurface,
 		// not with the mins being the origin.
 
+		subdivision_vertex_weld_index.clear();
 		subdivision_vertexes.clear();
 		subdivision_faces.clear();
+		subdivision_face_arena.reset();
 
 		// Construct the original face to start subdividing.
 		size_t polygon_face_number = subdivision_faces.size();
 		{
-			subdivision_face & initial_face = subdivision_faces.emplace_back();
+			subdivision_face & initial_face = subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 			initial_face.vertexes.reserve(face.edge_count);
 			for (size_t face_edge_number = 0; face_edge_number < face.edge_count; ++face_edge_number) {
 				surfedge const face_surfedge = surfedges[face.first_edge + face_edge_number];
@@ -223,9 +296,9 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 						plane_sides.push_back(plane_sides.front());
 
 						back_face_number = subdivision_faces.size();
-						subdivision_faces.emplace_back();
+						subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 						front_face_number = subdivision_faces.size();
-						subdivision_faces.emplace_back();
+						subdivision_faces.emplace_back(subdivision_face_arena.get_resource());
 						// Update the pointer after potential reallocations.
 						current_face = &subdivision_faces[current_face_number];
 						subdivision_face & back_face = subdivision_faces[back_face_number];
@@ -282,6 +355,16 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 							front_face.vertexes.push_back(split_vertex_index);
 						}
 
+						if (back_face.vertexes == current_face->vertexes ||
+								front_face.vertexes == current_face->vertexes) {
+							// A vertex slightly farther than epsilon from the split plane, with the split vertex having
+							// been merged back into it, so the face would be split the same way infinitely.
+							// Keep the face as is.
+							subdivision_faces.pop_back();
+							subdivision_faces.pop_back();
+							break;
+						}
+
 						// Remove the subdivided face.
 						current_face->vertexes.clear();
 					}
@@ -371,127 +454,221 @@ void gbx_map::make_polygons(gbx_polygons_deserialized * const polygons_start, si
 			}
 		}
 		// Merge the chains.
-		bool any_chains_merged;
 		// For simplicity, chains merged into other chains, are not removed from the vector, and only replaced with
 		// SIZE_MAX, so chains.size never changes.
 		size_t const chain_count = chains.size();
-		do {
-			any_chains_merged = false;
-			for (size_t chain_number = 0; chain_number < chain_count; ++chain_number) {
-				std::pair<size_t, size_t> & chain = chains[chain_number];
-				assert((chain.first == SIZE_MAX) == (chain.second == SIZE_MAX));
-				if (chain.first == SIZE_MAX) {
-					continue;
+		// Returns whether the chain 2 has been merged into the chain 1.
+		auto const merge_chains = [&chains, &subdivision_faces](
+				size_t const chain_number, size_t const chain_2_number) {
+			std::pair<size_t, size_t> & chain = chains[chain_number];
+			std::pair<size_t, size_t> & chain_2 = chains[chain_2_number];
+			assert(chain.first != SIZE_MAX && chain_2.first != SIZE_MAX);
+			// Chain 1 beginning to chain 2 end.
+			subdivision_face & chain_beginning = subdivision_faces[chain.first];
+			subdivision_face & chain_2_end = subdivision_faces[chain_2.second];
+			{
+				std::pair<size_t, size_t> const chaining_edge =
+						chain_beginning.find_chaining_edge(chain_2_end);
+				if (chaining_edge.first != SIZE_MAX) {
+					chain_beginning.chain_prev.first = chaining_edge.first;
+					chain_beginning.chain_prev.second = chain_2.second;
+					chain_2_end.chain_next.first = chaining_edge.second;
+					chain_2_end.chain_next.second = chain.first;
+					size_t chain_2_merge_face_number = chain_2.second;
+					while (chain_2_merge_face_number != SIZE_MAX) {
+						subdivision_face & chain_2_merge_face =
+								subdivision_faces[chain_2_merge_face_number];
+						chain_2_merge_face.chain_number = chain_number;
+						chain_2_merge_face_number = chain_2_merge_face.chain_prev.second;
+					}
+					chain.first = chain_2.first;
+					chain_2.first = SIZE_MAX;
+					chain_2.second = SIZE_MAX;
+					return true;
 				}
-				for (size_t chain_2_number = chain_number + 1; chain_2_number < chain_count; ++chain_2_number) {
-					std::pair<size_t, size_t> & chain_2 = chains[chain_2_number];
-					assert((chain_2.first == SIZE_MAX) == (chain_2.second == SIZE_MAX));
-					if (chain_2.first == SIZE_MAX) {
-						continue;
+			}
+			// Chain 1 beginning to chain 2 beginning, reversing the chain 2.
+			subdivision_face & chain_2_beginning = subdivision_faces[chain_2.first];
+			if (chain_2.second != chain_2.first) {
+				std::pair<size_t, size_t> const chaining_edge =
+						chain_beginning.find_chaining_edge(chain_2_beginning);
+				if (chaining_edge.first != SIZE_MAX) {
+					chain_beginning.chain_prev.first = chaining_edge.first;
+					chain_beginning.chain_prev.second = chain_2.first;
+					chain_2_beginning.chain_prev.first = chaining_edge.second;
+					chain_2_beginning.chain_prev.second = chain.first;
+					size_t chain_2_merge_face_number = chain_2.first;
+					while (chain_2_merge_face_number != SIZE_MAX) {
+						subdivision_face & chain_2_merge_face =
+								subdivision_faces[chain_2_merge_face_number];
+						chain_2_merge_face.chain_number = chain_number;
+						std::swap(chain_2_merge_face.chain_prev, chain_2_merge_face.chain_next);
+						chain_2_merge_face_number = chain_2_merge_face.chain_prev.second;
 					}
-					// chain.first and chain.second must be reloaded at every chain_2 iteration since the inner loop
-					// doesn't stop after merging.
-					// Chain 1 beginning to chain 2 end.
-					subdivision_face & chain_beginning = subdivision_faces[chain.first];
-					subdivision_face & chain_2_end = subdivision_faces[chain_2.second];
-					{
-						std::pair<size_t, size_t> const chaining_edge =
-								chain_beginning.find_chaining_edge(chain_2_end);
-						if (chaining_edge.first != SIZE_MAX) {
-							chain_beginning.chain_prev.first = chaining_edge.first;
-							chain_beginning.chain_prev.second = chain_2.second;
-							chain_2_end.chain_next.first = chaining_edge.second;
-							chain_2_end.chain_next.second = chain.first;
-							size_t chain_2_merge_face_number = chain_2.second;
-							while (chain_2_merge_face_number != SIZE_MAX) {
-								subdivision_face & chain_2_merge_face =
-										subdivision_faces[chain_2_merge_face_number];
-								chain_2_merge_face.chain_number = chain_number;
-								chain_2_merge_face_number = chain_2_merge_face.chain_prev.second;
-							}
-							chain.first = chain_2.first;
-							chain_2.first = SIZE_MAX;
-							chain_2.second = SIZE_MAX;
-							any_chains_merged = true;
-							continue;
+					chain.first = chain_2.second;
+					chain_2.first = SIZE_MAX;
+					chain_2.second = SIZE_MAX;
+					return true;
+				}
+			}
+			if (chain.second != chain.first) {
+				// Chain 1 end to chain 2 beginning.
+				subdivision_face & chain_end = subdivision_faces[chain.second];
+				{
+					std::pair<size_t, size_t> const chaining_edge =
+							chain_end.find_chaining_edge(chain_2_beginning);
+					if (chaining_edge.first != SIZE_MAX) {
+						chain_end.chain_next.first = chaining_edge.first;
+						chain_end.chain_next.second = chain_2.first;
+						chain_2_beginning.chain_prev.first = chaining_edge.second;
+						chain_2_beginning.chain_prev.second = chain.second;
+						size_t chain_2_merge_face_number = chain_2.first;
+						while (chain_2_merge_face_number != SIZE_MAX) {
+							subdivision_face & chain_2_merge_face =
+									subdivision_faces[chain_2_merge_face_number];
+							chain_2_merge_face.chain_number = chain_number;
+							chain_2_merge_face_number = chain_2_merge_face.chain_next.second;
 						}
+						chain.second = chain_2.second;
+						chain_2.first = SIZE_MAX;
+						chain_2.second = SIZE_MAX;
+						return true;
 					}
-					// Chain 1 beginning to chain 2 beginning, reversing the chain 2.
-					subdivision_face & chain_2_beginning = subdivision_faces[chain_2.first];
-					if (chain_2.second != chain_2.first) {
-						std::pair<size_t, size_t> const chaining_edge =
-								chain_beginning.find_chaining_edge(chain_2_beginning);
-						if (chaining_edge.first != SIZE_MAX) {
-							chain_beginning.chain_prev.first = chaining_edge.first;
-							chain_beginning.chain_prev.second = chain_2.first;
-							chain_2_beginning.chain_prev.first = chaining_edge.second;
-							chain_2_beginning.chain_prev.second = chain.first;
-							size_t chain_2_merge_face_number = chain_2.first;
-							while (chain_2_merge_face_number != SIZE_MAX) {
-								subdivision_face & chain_2_merge_face =
-										subdivision_faces[chain_2_merge_face_number];
-								chain_2_merge_face.chain_number = chain_number;
-								std::swap(chain_2_merge_face.chain_prev, chain_2_merge_face.chain_next);
-								chain_2_merge_face_number = chain_2_merge_face.chain_prev.second;
-							}
-							chain.first = chain_2.second;
-							chain_2.first = SIZE_MAX;
-							chain_2.second = SIZE_MAX;
-							any_chains_merged = true;
-							continue;
+				}
+				// Chain 1 end to chain 2 end, reversing the chain 2.
+				if (chain_2.second != chain_2.first) {
+					std::pair<size_t, size_t> const chaining_edge =
+							chain_end.find_chaining_edge(chain_2_end);
+					if (chaining_edge.first != SIZE_MAX) {
+						chain_end.chain_next.first = chaining_edge.first;
+						chain_end.chain_next.second = chain_2.second;
+						chain_2_end.chain_next.first = chaining_edge.second;
+						chain_2_end.chain_next.second = chain.second;
+						size_t chain_2_merge_face_number = chain_2.second;
+						while (chain_2_merge_face_number != SIZE_MAX) {
+							subdivision_face & chain_2_merge_face =
+									subdivision_faces[chain_2_merge_face_number];
+							chain_2_merge_face.chain_number = chain_number;
+							std::swap(chain_2_merge_face.chain_prev, chain_2_merge_face.chain_next);
+							chain_2_merge_face_number = chain_2_merge_face.chain_next.second;
 						}
+						chain.second = chain_2.first;
+						chain_2.first = SIZE_MAX;
+						chain_2.second = SIZE_MAX;
+						return true;
 					}
-					if (chain.second != chain.first) {
-						// Chain 1 end to chain 2 beginning.
-						subdivision_face & chain_end = subdivision_faces[chain.second];
-						{
-							std::pair<size_t, size_t> const chaining_edge =
-									chain_end.find_chaining_edge(chain_2_beginning);
-							if (chaining_edge.first != SIZE_MAX) {
-								chain_end.chain_next.first = chaining_edge.first;
-								chain_end.chain_next.second = chain_2.first;
-								chain_2_beginning.chain_prev.first = chaining_edge.second;
-								chain_2_beginning.chain_prev.second = chain.second;
-								size_t chain_2_merge_face_number = chain_2.first;
-								while (chain_2_merge_face_number != SIZE_MAX) {
-									subdivision_face & chain_2_merge_face =
-											subdivision_faces[chain_2_merge_face_number];
-									chain_2_merge_face.chain_number = chain_number;
-									chain_2_merge_face_number = chain_2_merge_face.chain_next.second;
-								}
-								chain.second = chain_2.second;
-								chain_2.first = SIZE_MAX;
-								chain_2.second = SIZE_MAX;
-								any_chains_merged = true;
-								continue;
-							}
+				}
+			}
+			return false;
+		};
+		// Only the chains with end faces having an edge in common with an end face of a chain can be merged with it,
+		// so the chains to try merging are looked up through the faces containing the vertexes of the end faces, rather
+		// than by checking all pairs of chains.
+		{
+			// Counting sort of the faces by the vertexes they contain.
+			size_t const subdivision_vertex_count = subdivision_vertexes.size();
+			subdivision_vertex_face_offsets.clear();
+			subdivision_vertex_face_offsets.resize(subdivision_vertex_count + 1);
+			for (size_t chain_number = 0; chain_number < chain_count; ++chain_number) {
+				for (size_t const vertex_index : subdivision_faces[chains[chain_number].first].vertexes) {
+					++subdivision_vertex_face_offsets[vertex_index + 1];
+				}
+			}
+			for (size_t vertex_index = 0; vertex_index < subdivision_vertex_count; ++vertex_index) {
+				subdivision_vertex_face_offsets[vertex_index + 1] += subdivision_vertex_face_offsets[vertex_index];
+			}
+			subdivision_vertex_faces.resize(subdivision_vertex_face_offsets[subdivision_vertex_count]);
+			// Using the offsets as the insertion positions, moving each to the end of the range of the vertex, which is
+			// the start of the next one.
+			for (size_t chain_number = 0; chain_number < chain_count; ++chain_number) {
+				size_t const subdivision_face_number = chains[chain_number].first;
+				for (size_t const vertex_index : subdivision_faces[subdivision_face_number].vertexes) {
+					subdivision_vertex_faces[subdivision_vertex_face_offsets[vertex_index]++] = subdivision_face_number;
+				}
+			}
+			for (size_t vertex_index = subdivision_vertex_count; vertex_index > 0; --vertex_index) {
+				subdivision_vertex_face_offsets[vertex_index] = subdivision_vertex_face_offsets[vertex_index - 1];
+			}
+			subdivision_vertex_face_offsets[0] = 0;
+		}
+		// Gathers the not yet merged chains, numbered starting from chain_2_min_number, with end faces sharing an edge
+		// with the end faces of the chain, in ascending order.
+		auto const gather_chains_to_merge = [&](size_t const chain_number, size_t const chain_2_min_number) {
+			chains_to_merge.clear();
+			std::pair<size_t, size_t> const & chain = chains[chain_number];
+			for (size_t const chain_end_face_number : {chain.first, chain.second}) {
+				std::pmr::vector<size_t> const & chain_end_face_vertexes =
+						subdivision_faces[chain_end_face_number].vertexes;
+				for (size_t edge_number = 0; edge_number < chain_end_face_vertexes.size(); ++edge_number) {
+					size_t const edge_vertex_1 = chain_end_face_vertexes[edge_number];
+					size_t const edge_vertex_2 =
+							chain_end_face_vertexes[(edge_number + 1) % chain_end_face_vertexes.size()];
+					for (size_t vertex_face_number = subdivision_vertex_face_offsets[edge_vertex_1];
+							vertex_face_number < subdivision_vertex_face_offsets[edge_vertex_1 + 1];
+							++vertex_face_number) {
+						size_t const other_face_number = subdivision_vertex_faces[vertex_face_number];
+						if (other_face_number == chain_end_face_number) {
+							continue;
 						}
-						// Chain 1 end to chain 2 end, reversing the chain 2.
-						if (chain_2.second != chain_2.first) {
-							std::pair<size_t, size_t> const chaining_edge =
-									chain_end.find_chaining_edge(chain_2_end);
-							if (chaining_edge.first != SIZE_MAX) {
-								chain_end.chain_next.first = chaining_edge.first;
-								chain_end.chain_next.second = chain_2.second;
-								chain_2_end.chain_next.first = chaining_edge.second;
-								chain_2_end.chain_next.second = chain.second;
-								size_t chain_2_merge_face_number = chain_2.second;
-								while (chain_2_merge_face_number != SIZE_MAX) {
-									subdivision_face & chain_2_merge_face =
-											subdivision_faces[chain_2_merge_face_number];
-									chain_2_merge_face.chain_number = chain_number;
-									std::swap(chain_2_merge_face.chain_prev, chain_2_merge_face.chain_next);
-									chain_2_merge_face_number = chain_2_merge_face.chain_next.second;
-								}
-								chain.second = chain_2.first;
-								chain_2.first = SIZE_MAX;
-								chain_2.second = SIZE_MAX;
-								any_chains_merged = true;
-								continue;
+						size_t const chain_2_number = subdivision_faces[other_face_number].chain_number;
+						if (chain_2_number < chain_2_min_number) {
+							continue;
+						}
+						std::pair<size_t, size_t> const & chain_2 = chains[chain_2_number];
+						if (chain_2.first != other_face_number && chain_2.second != other_face_number) {
+							continue;
+						}
+						std::pmr::vector<size_t> const & other_face_vertexes =
+								subdivision_faces[other_face_number].vertexes;
+						for (size_t other_edge_number = 0;
+								other_edge_number < other_face_vertexes.size();
+								++other_edge_number) {
+							size_t const other_edge_vertex_1 = other_face_vertexes[other_edge_number];
+							size_t const other_edge_vertex_2 =
+									other_face_vertexes[(other_edge_number + 1) % other_face_vertexes.size()];
+							if ((edge_vertex_1 == other_edge_vertex_1 && edge_vertex_2 == other_edge_vertex_2) ||
+									(edge_vertex_1 == other_edge_vertex_2 && edge_vertex_2 == other_edge_vertex_1)) {
+								chains_to_merge.push_back(chain_2_number);
+								break;
 							}
 						}
 					}
 				}
+				if (chain.second == chain.first) {
+					break;
+				}
+			}
+			std::sort(chains_to_merge.begin(), chains_to_merge.end());
+			chains_to_merge.erase(std::unique(chains_to_merge.begin(), chains_to_merge.end()), chains_to_merge.end());
+		};
+		// Every chain, in ascending order, is merged with the chains numbered after it, also in ascending order, with
+		// the chain's new end faces used for the further chains after each merge, and this is repeated until no
+		// chains can be merged.
+		// The chains that can't be merged with the chain are skipped, so this produces the same strips as checking all
+		// the pairs in the same order.
+		bool any_chains_merged;
+		do {
+			any_chains_merged = false;
+			for (size_t chain_number = 0; chain_number < chain_count; ++chain_number) {
+				std::pair<size_t, size_t> const & chain = chains[chain_number];
+				assert((chain.first == SIZE_MAX) == (chain.second == SIZE_MAX));
+				if (chain.first == SIZE_MAX) {
+					continue;
+				}
+				size_t chain_2_min_number = chain_number + 1;
+				bool chain_merged;
+				do {
+					chain_merged = false;
+					gather_chains_to_merge(chain_number, chain_2_min_number);
+					for (size_t const chain_2_number : chains_to_merge) {
+						if (merge_chains(chain_number, chain_2_number)) {
+							chain_2_min_number = chain_2_number + 1;
+							chain_merged = true;
+							any_chains_merged = true;
+							break;
+						}
+					}
+				} while (chain_merged);
 			}
 		} while (any_chains_merged);
 
@@ -4,21 +4,32 @@
 #include <array>
 #include <cassert>
 #include <cctype>
+#include <chrono>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iterator>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BS2PC_TEXTURES_SSE2 1
+#else
+#define BS2PC_TEXTURES_SSE2 0
+#endif
+
 namespace bs2pc {
 
 uint16_t texture_gbx_face_flags(char const * const name) {
@@ -456,24 +467,19 @@ void gbx_map::link_texture_anim() {
 	}
 }
 
-void append_worldspawn_wad_names(entity_key_values const & worldspawn, std::vector<std::string> & names) {
+void append_worldspawn_wad_names(entity_store const & entities, std::vector<std::string> & names) {
+	if (entities.empty()) {
+		return;
+	}
 	// In WriteMiptex, the "_wad" key has a higher priority over "wad".
-	auto wad_key_value_pair_iterator = std::find_if(
-			worldspawn.cbegin(), worldspawn.cend(),
-			[](entity_key_value_pair const & worldspawn_key_value_pair) {
-				return worldspawn_key_value_pair.first == "_wad";
-			});
-	if (wad_key_value_pair_iterator == worldspawn.cend()) {
-		wad_key_value_pair_iterator = std::find_if(
-				worldspawn.cbegin(), worldspawn.cend(),
-				[](entity_key_value_pair const & worldspawn_key_value_pair) {
-					return worldspawn_key_value_pair.first == "wad";
-				});
-		if (wad_key_value_pair_iterator == worldspawn.cend()) {
+	size_t wad_key_value_number = entities.find_key(0, "_wad");
+	if (wad_key_value_number == SIZE_MAX) {
+		wad_key_value_number = entities.find_key(0, "wad");
+		if (wad_key_value_number == SIZE_MAX) {
 			return;
 		}
 	}
-	std::string const & wad_key_value = wad_key_value_pair_iterator->second;
+	std::string_view const wad_key_value = entities.get_value(0, wad_key_value_number);
 	// WAD paths are ;-separated.
 	// Using only the name, not the original path as it may be absolute from the machine where the map was compiled.
 	auto wad_name_iterator = wad_key_value.cbegin();
@@ -521,39 +527,32 @@ std::string serialize_worldspawn_wad_paths(std::vector<std::string> const & path
 	return stream.str();
 }
 
-void set_worldspawn_wad_paths(entity_key_values & worldspawn, std::string_view paths_serialized) {
+void set_worldspawn_wad_paths(entity_store & entities, std::string_view paths_serialized) {
+	if (entities.empty()) {
+		return;
+	}
 	if (paths_serialized.empty()) {
 		// Remove the WAD key and value pairs if no paths.
-		worldspawn.erase(
-				std::remove_if(
-						worldspawn.begin(), worldspawn.end(),
-						[](entity_key_value_pair const & worldspawn_key_value_pair) -> bool {
-							return worldspawn_key_value_pair.first == "_wad" ||
-									worldspawn_key_value_pair.first == "wad";
-						}),
-				worldspawn.end());
+		for (size_t key_value_number = entities.get_key_value_count(0); key_value_number-- > 0;) {
+			std::string_view const key = entities.get_key(0, key_value_number);
+			if (key == "_wad" || key == "wad") {
+				entities.remove_key_value(0, key_value_number);
+			}
+		}
 		return;
 	}
 	// In WriteMiptex, the "_wad" key has a higher priority over "wad".
-	auto wad_key_value_pair_iterator = std::find_if(
-			worldspawn.begin(), worldspawn.end(),
-			[](entity_key_value_pair const & worldspawn_key_value_pair) -> bool {
-				return worldspawn_key_value_pair.first == "_wad";
-			});
-	if (wad_key_value_pair_iterator == worldspawn.end()) {
-		wad_key_value_pair_iterator = std::find_if(
-				worldspawn.begin(), worldspawn.end(),
-				[](entity_key_value_pair const & worldspawn_key_value_pair) -> bool {
-					return worldspawn_key_value_pair.first == "wad";
-				});
-		if (wad_key_value_pair_iterator == worldspawn.end()) {
+	size_t wad_key_value_number = entities.find_key(0, "_wad");
+	if (wad_key_value_number == SIZE_MAX) {
+		wad_key_value_number = entities.find_key(0, "wad");
+		if (wad_key_value_number == SIZE_MAX) {
 			// No WAD paths in the worldspawn entity yet.
 			// The original Half-Life PC and PS2 maps use "wad", not "_wad".
-			worldspawn.emplace_back("wad", paths_serialized);
+			entities.add_key_value(0, "wad", paths_serialized);
 			return;
 		}
 	}
-	wad_key_value_pair_iterator->second = paths_serialized;
+	entities.set_value(0, wad_key_value_number, paths_serialized);
 }
 
 bool replace_hlps2_wads(std::vector<std::string> & wad_names) {
@@ -623,6 +622,8 @@ bool replace_hlps2_wads(std::vector<std::string> & wad_names) {
 char const * get_wad_textures(
 		void const * const wad, size_t const wad_size, wad_textures_deserialized & wad_textures,
 		id_texture_deserialized_palette const & quake_palette) {
+	wad_textures.wad = nullptr;
+	wad_textures.texture_lumps.clear();
 	wad_textures.textures.clear();
 	wad_textures.texture_number_map.clear();
 	if (wad_size < sizeof(wad_info)) {
@@ -636,7 +637,9 @@ char const * get_wad_textures(
 			(info.identification[3] != '2' && info.identification[3] != '3')) {
 		return "The file is not a WAD2 or a WAD3 file";
 	}
-	bool const is_wad3 = info.identification[3] == '3';
+	wad_textures.wad = reinterpret_cast<char const *>(wad);
+	wad_textures.is_wad3 = info.identification[3] == '3';
+	wad_textures.quake_palette = &quake_palette;
 	if (!info.lump_count) {
 		return nullptr;
 	}
@@ -662,25 +665,65 @@ char const * get_wad_textures(
 			// Out of bounds.
 			continue;
 		}
-		wad_texture_deserialized texture_deserialized;
-		if (texture_deserialized.texture_id.deserialize(
-				reinterpret_cast<char const *>(wad) + lump_info.file_position,
-				lump_info.size,
-				is_wad3,
-				quake_palette)) {
-			// Failed to deserialize.
+		if (lump_info.size < sizeof(id_texture)) {
+			// The texture information is out of bounds, it can't be decoded.
 			continue;
 		}
-		if (!texture_deserialized.texture_id.pixels) {
+		// Use the name from the texture itself rather than from the lump information, like the texture decoding does.
+		char texture_name[sizeof(id_texture::name)];
+		std::memcpy(
+				texture_name,
+				reinterpret_cast<char const *>(wad) + lump_info.file_position + offsetof(id_texture, name),
+				sizeof(texture_name));
+		uint32_t texture_name_length = 0;
+		while (texture_name_length < texture_name_max_length && texture_name[texture_name_length]) {
+			++texture_name_length;
+		}
+		size_t const texture_number = wad_textures.texture_lumps.size();
+		wad_textures_deserialized::texture_lump & texture_lump = wad_textures.texture_lumps.emplace_back();
+		texture_lump.file_position = lump_info.file_position;
+		texture_lump.size = lump_info.size;
+		texture_lump.next_same_name_number = SIZE_MAX;
+		texture_lump.state = wad_textures_deserialized::texture_state::not_decoded;
+		auto const texture_number_iterator = wad_textures.texture_number_map.emplace(
+				string_to_lower(std::string(texture_name, texture_name_length)), texture_number);
+		if (!texture_number_iterator.second) {
+			size_t same_name_last_number = texture_number_iterator.first->second;
+			while (wad_textures.texture_lumps[same_name_last_number].next_same_name_number != SIZE_MAX) {
+				same_name_last_number = wad_textures.texture_lumps[same_name_last_number].next_same_name_number;
+			}
+			wad_textures.texture_lumps[same_name_last_number].next_same_name_number = texture_number;
+		}
+	}
+	wad_textures.textures.resize(wad_textures.texture_lumps.size());
+	return nullptr;
+}
+
+wad_texture_deserialized const * wad_textures_deserialized::find_texture(std::string const & name_lower) const {
+	auto const texture_number_iterator = texture_number_map.find(name_lower);
+	if (texture_number_iterator == texture_number_map.cend()) {
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> const decode_lock(*decode_mutex);
+	for (size_t texture_number = texture_number_iterator->second;
+			texture_number != SIZE_MAX;
+			texture_number = texture_lumps[texture_number].next_same_name_number) {
+		texture_lump & lump = texture_lumps[texture_number];
+		if (lump.state == texture_state::not_decoded) {
+			id_texture_deserialized & texture_id = textures[texture_number].texture_id;
 			// Only map textures may have no pixels.
 			// WADs always contain the data, they themselves are what textures without data in the map are loaded from.
-			continue;
+			if (!texture_id.deserialize(wad + lump.file_position, lump.size, is_wad3, *quake_palette) &&
+					texture_id.pixels) {
+				lump.state = texture_state::decoded;
+			} else {
+				lump.state = texture_state::invalid;
+				texture_id = id_texture_deserialized();
+			}
+		}
+		if (lump.state == texture_state::decoded) {
+			return &textures[texture_number];
 		}
-		size_t const texture_number = wad_textures.textures.size();
-		wad_textures.textures.emplace_back(std::move(texture_deserialized));
-		wad_textures.texture_number_map.emplace(
-				string_to_lower(wad_textures.textures.back().texture_id.name),
-				texture_number);
 	}
 	return nullptr;
 }
@@ -808,12 +851,11 @@ wad_texture_deserialized const * find_most_identical_texture_in_wads(
 	if (wad_count) {
 		auto const find_texture_in_wads = [&](std::string const & name_key) {
 			for (size_t wad_number = 0; wad_number < wad_count; ++wad_number) {
-				wad_textures_deserialized const & wad = *wads[wad_number];
-				auto const wad_texture_number_iterator = wad.texture_number_map.find(name_key);
-				if (wad_texture_number_iterator == wad.texture_number_map.cend()) {
+				wad_texture_deserialized const * const wad_texture_pointer = wads[wad_number]->find_texture(name_key);
+				if (!wad_texture_pointer) {
 					continue;
 				}
-				wad_texture_deserialized const & wad_texture = wad.textures[wad_texture_number_iterator->second];
+				wad_texture_deserialized const & wad_texture = *wad_texture_pointer;
 				texture_identical_status const wad_texture_identical_status =
 						is_texture_data_identical(wad_texture.texture_id, texture_gbx, quake_palette);
 				if (best_wad_texture && wad_texture_identical_status != best_identical_status) {
@@ -1000,6 +1042,7 @@ palette_set::palette_set(uint8_t const * colors, size_t const color_count) {
 // When t is 1, this will return C.
 // Inbetween values will return an interpolation between B and C.
 // A and D are used to calculate slopes at the edges.
+#if !BS2PC_TEXTURES_SSE2
 static float cubic_hermite(float const a, float const b, float const c, float const d, float const t) {
     float const k3 = -a / 2.0f + (3.0f * b) / 2.0f - (3.0f * c) / 2.0f + d / 2.0f;
     float const k2 = a - (5.0f * b) / 2.0f + 2.0f * c - d / 2.0f;
@@ -1007,13 +1050,474 @@ static float cubic_hermite(float const a, float const b, float const c, float co
     float const k0 = b; 
     return k3 * (t * t * t) + k2 * (t * t) + k1 * t + k0;
 }
+#endif
+
+// cubic_hermite for all 4 components, with the same operations in the same order, so the results are exactly the same
+// as those of the scalar version as long as it's not compiled with fused multiply-add or with higher intermediate
+// precision (such as with x87), in which case they may differ by floating-point rounding.
+static vector4 cubic_hermite_vector4(
+		vector4 const & a, vector4 const & b, vector4 const & c, vector4 const & d, float const t) {
+	vector4 result;
+	#if BS2PC_TEXTURES_SSE2
+	__m128 const a_sse = _mm_loadu_ps(a.v);
+	__m128 const b_sse = _mm_loadu_ps(b.v);
+	__m128 const c_sse = _mm_loadu_ps(c.v);
+	__m128 const d_sse = _mm_loadu_ps(d.v);
+	__m128 const half = _mm_set1_ps(0.5f);
+	__m128 const three = _mm_set1_ps(3.0f);
+	// Halving is exact, so multiplication by 0.5 is the same as division by 2.
+	__m128 const negative_a_half = _mm_mul_ps(_mm_xor_ps(a_sse, _mm_set1_ps(-0.0f)), half);
+	__m128 const c_half = _mm_mul_ps(c_sse, half);
+	__m128 const d_half = _mm_mul_ps(d_sse, half);
+	__m128 const k3 = _mm_add_ps(
+			_mm_sub_ps(
+					_mm_add_ps(negative_a_half, _mm_mul_ps(_mm_mul_ps(three, b_sse), half)),
+					_mm_mul_ps(_mm_mul_ps(three, c_sse), half)),
+			d_half);
+	__m128 const k2 = _mm_sub_ps(
+			_mm_add_ps(
+					_mm_sub_ps(a_sse, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(5.0f), b_sse), half)),
+					_mm_mul_ps(_mm_set1_ps(2.0f), c_sse)),
+			d_half);
+	__m128 const k1 = _mm_add_ps(negative_a_half, c_half);
+	float const t_2 = t * t;
+	float const t_3 = t_2 * t;
+	_mm_storeu_ps(
+			result.v,
+			_mm_add_ps(
+					_mm_add_ps(
+							_mm_add_ps(_mm_mul_ps(k3, _mm_set1_ps(t_3)), _mm_mul_ps(k2, _mm_set1_ps(t_2))),
+							_mm_mul_ps(k1, _mm_set1_ps(t))),
+					b_sse));
+	#else
+	for (size_t component = 0; component < 4; ++component) {
+		result.v[component] = cubic_hermite(a.v[component], b.v[component], c.v[component], d.v[component], t);
+	}
+	#endif
+	return result;
+}
+
+// Clamped coordinates of the 4 samples, and the position between the middle two, along one axis of a pixel resampled
+// with the bicubic filter.
+struct cubic_resample_taps {
+	std::array<uint32_t, 4> samples;
+	float t;
+};
+
+static void make_cubic_resample_taps(
+		std::vector<cubic_resample_taps> & taps, uint32_t const out_size, uint32_t const in_size) {
+	taps.resize(out_size);
+	float const out_to_in = float(in_size) / float(out_size);
+	for (uint32_t out_coordinate = 0; out_coordinate < out_size; ++out_coordinate) {
+		cubic_resample_taps & coordinate_taps = taps[out_coordinate];
+		float const in_coordinate = (float(out_coordinate) + 0.5f) * out_to_in - 0.5f;
+		uint32_t const in_coordinate_b = uint32_t(std::min(float(in_size - 1), std::max(0.0f, in_coordinate)));
+		coordinate_taps.t = in_coordinate - float(in_coordinate_b);
+		for (uint32_t sample_number = 0; sample_number < 4; ++sample_number) {
+			coordinate_taps.samples[sample_number] = uint32_t(std::min(
+					int32_t(in_size - 1),
+					std::max(int32_t(0), int32_t(in_coordinate_b) + (int32_t(sample_number) - int32_t(1)))));
+		}
+	}
+}
+
+// The linear colors of a palette, and the orders of the colors along each axis for the closest color search, shared
+// between the conversions of all the textures with the same palette (such as all the textures using the Quake palette).
+struct texture_palette_analysis {
+	// Colors not present in the palette are black. Alpha is 1.
+	std::array<vector4, 256> linear;
+	// The color numbers sorted by each linear component, and by the number if the components are equal.
+	std::array<std::array<uint8_t, 256>, 3> axis_orders;
+
+	explicit texture_palette_analysis(id_texture_deserialized_palette const & palette) {
+		for (size_t color_number = 0; color_number < 256; ++color_number) {
+			vector4 & linear_color = linear[color_number];
+			if (3 * color_number + 2 < palette.size()) {
+				for (size_t component = 0; component < 3; ++component) {
+					linear_color.v[component] = std::pow(float(palette[3 * color_number + component]) / 255.0f, 2.2f);
+				}
+			} else {
+				std::fill(linear_color.v, linear_color.v + 3, 0.0f);
+			}
+			linear_color.v[3] = 1.0f;
+		}
+		for (size_t axis = 0; axis < 3; ++axis) {
+			std::array<uint8_t, 256> & axis_order = axis_orders[axis];
+			for (size_t color_number = 0; color_number < 256; ++color_number) {
+				axis_order[color_number] = uint8_t(color_number);
+			}
+			std::sort(
+					axis_order.begin(), axis_order.end(),
+					[this, axis](uint8_t const color_number_1, uint8_t const color_number_2) -> bool {
+						float const value_1 = linear[color_number_1].v[axis];
+						float const value_2 = linear[color_number_2].v[axis];
+						return value_1 < value_2 || (value_1 == value_2 && color_number_1 < color_number_2);
+					});
+		}
+	}
+};
+
+std::shared_ptr<texture_palette_analysis const> texture_palette_analysis_cache::get(
+		id_texture_deserialized_palette const & palette) {
+	{
+		std::lock_guard<std::mutex> const lock(mutex);
+		auto const entry_iterator = entries.find(palette);
+		if (entry_iterator != entries.cend()) {
+			// Mark as the most recently used.
+			usage_order.splice(usage_order.begin(), usage_order, entry_iterator->second);
+			return entry_iterator->second->analysis;
+		}
+	}
+	// Analyze outside the lock. If another thread analyzes the same palette at the same time, the results are the
+	// same, and the one stored first is used by both.
+	std::shared_ptr<texture_palette_analysis const> analysis = std::make_shared<texture_palette_analysis>(palette);
+	std::lock_guard<std::mutex> const lock(mutex);
+	auto const entry_emplaced = entries.try_emplace(palette);
+	if (entry_emplaced.second) {
+		usage_order.push_front(entry{palette, analysis});
+		entry_emplaced.first->second = usage_order.begin();
+		if (usage_order.size() > capacity) {
+			entries.erase(usage_order.back().palette);
+			usage_order.pop_back();
+		}
+		return analysis;
+	}
+	usage_order.splice(usage_order.begin(), usage_order, entry_emplaced.first->second);
+	return entry_emplaced.first->second->analysis;
+}
+
+void texture_palette_analysis_cache::clear() {
+	std::lock_guard<std::mutex> const lock(mutex);
+	entries.clear();
+	usage_order.clear();
+}
+
+// Search for the color closest to the specified one among a set of linear palette colors, by the squared distance.
+// Returns exactly the same color number as checking all the colors in ascending order of their numbers, and picking the
+// first one with the smallest distance (or 0 if none are closer than infinity, such as for NaN), but the colors are
+// sorted along the axis in which they're spread the most, so the search can stop checking colors once the distance
+// along that axis alone exceeds the smallest full distance found so far.
+// This is exact even with floating-point rounding because the distance along one axis is one of the non-negative terms
+// added to calculate the full distance, and the rounding of the subtraction is monotonic.
+class linear_palette_closest_color_search {
+public:
+	// The order of the colors with the same value along the axis doesn't affect the result of the search, so the colors
+	// are taken from the orders precomputed for the whole palette instead of being sorted for every texture.
+	linear_palette_closest_color_search(
+			texture_palette_analysis const & palette_analysis, std::array<uint32_t, 256 / 32> const & colors_used) {
+		auto const is_color_used = [&colors_used](uint8_t const color_number) -> bool {
+			return bool(colors_used[color_number >> 5] & (UINT32_C(1) << (color_number & 31)));
+		};
+		// The first and the last used colors in the order along each axis are the minimum and the maximum.
+		float axis_spread[3];
+		for (size_t component = 0; component < 3; ++component) {
+			std::array<uint8_t, 256> const & axis_order = palette_analysis.axis_orders[component];
+			auto const axis_min_iterator = std::find_if(axis_order.cbegin(), axis_order.cend(), is_color_used);
+			if (axis_min_iterator == axis_order.cend()) {
+				// No colors used.
+				axis = 0;
+				return;
+			}
+			auto const axis_max_iterator = std::find_if(axis_order.crbegin(), axis_order.crend(), is_color_used);
+			axis_spread[component] =
+					palette_analysis.linear[*axis_max_iterator].v[component] -
+					palette_analysis.linear[*axis_min_iterator].v[component];
+		}
+		axis = 0;
+		for (size_t component = 1; component < 3; ++component) {
+			if (axis_spread[component] > axis_spread[axis]) {
+				axis = component;
+			}
+		}
+		for (uint8_t const color_number : palette_analysis.axis_orders[axis]) {
+			if (!is_color_used(color_number)) {
+				continue;
+			}
+			color & sorted_color = colors[color_count++];
+			sorted_color.number = color_number;
+			vector4 const & linear_palette_color = palette_analysis.linear[color_number];
+			for (size_t component = 0; component < 3; ++component) {
+				sorted_color.linear.v[component] = linear_palette_color.v[component];
+			}
+		}
+	}
+
+	uint8_t find(vector3 const & linear) const {
+		uint8_t best_color_number = 0;
+		float best_distortion = float(INFINITY);
+		auto const check_color = [&](color const & candidate_color) -> bool {
+			float const axis_distortion = linear.v[axis] - candidate_color.linear.v[axis];
+			if (axis_distortion * axis_distortion > best_distortion) {
+				// This and all the following colors in this direction are farther.
+				return false;
+			}
+			float distortion = 0.0f;
+			for (size_t component = 0; component < 3; ++component) {
+				float const component_distortion = linear.v[component] - candidate_color.linear.v[component];
+				distortion += component_distortion * component_distortion;
+			}
+			if (distortion < best_distortion ||
+					(distortion == best_distortion && candidate_color.number < best_color_number)) {
+				best_distortion = distortion;
+				best_color_number = candidate_color.number;
+			}
+			return true;
+		};
+		// Start from the colors closest along the axis.
+		size_t const split = size_t(
+				std::lower_bound(
+						colors.cbegin(), colors.cbegin() + color_count, linear.v[axis],
+						[this](color const & sorted_color, float const value) -> bool {
+							return sorted_color.linear.v[axis] < value;
+						}) -
+				colors.cbegin());
+		for (size_t color_index = split; color_index < color_count && check_color(colors[color_index]);
+				++color_index) {}
+		for (size_t color_index = split; color_index && check_color(colors[color_index - 1]); --color_index) {}
+		return best_color_number;
+	}
+
+private:
+	struct color {
+		vector3 linear;
+		uint8_t number;
+	};
+
+	std::array<color, 256> colors;
+	size_t color_count = 0;
+	size_t axis;
+};
+
+std::filesystem::path texture_pixels_cache::get_path(sha256::digest const & key) const {
+	return directory / (sha256_digest_string(key) + ".bs2pctex");
+}
+
+bool texture_pixels_cache::load(sha256::digest const & key, uint8_t * const pixels, size_t const pixel_count) const {
+	std::ifstream stream(get_path(key), std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
+	if (!stream.is_open()) {
+		return false;
+	}
+	// The file contains the key (to make sure it's not a file with just the same name but different contents), and
+	// then the pixels.
+	std::streamoff const size(stream.tellg());
+	if (size < 0 || uint64_t(size) != key.size() + uint64_t(pixel_count)) {
+		return false;
+	}
+	stream.seekg(0, std::ios_base::beg);
+	sha256::digest file_key;
+	stream.read(reinterpret_cast<char *>(file_key.data()), std::streamsize(file_key.size()));
+	if (!stream.good() || file_key != key) {
+		return false;
+	}
+	std::vector<char> file_pixels(pixel_count);
+	stream.read(file_pixels.data(), std::streamsize(pixel_count));
+	if (!stream.good()) {
+		return false;
+	}
+	std::memcpy(pixels, file_pixels.data(), pixel_count);
+	return true;
+}
+
+void texture_pixels_cache::store(
+		sha256::digest const & key, uint8_t const * const pixels, size_t const pixel_count) const {
+	std::filesystem::path const path = get_path(key);
+	// Write to a temporary file first, and then rename it, so other threads and processes never see a partially
+	// written file.
+	std::filesystem::path temporary_path(path);
+	temporary_path += '.' + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + '.' +
+			std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	{
+		std::ofstream stream(temporary_path, std::ios_base::binary | std::ios_base::out | std::ios_base::trunc);
+		if (!stream.is_open()) {
+			return;
+		}
+		stream.write(reinterpret_cast<char const *>(key.data()), std::streamsize(key.size()));
+		stream.write(reinterpret_cast<char const *>(pixels), std::streamsize(pixel_count));
+		if (!stream.good()) {
+			stream.close();
+			std::error_code remove_error;
+			std::filesystem::remove(temporary_path, remove_error);
+			return;
+		}
+	}
+	std::error_code rename_error;
+	std::filesystem::rename(temporary_path, path, rename_error);
+	if (rename_error) {
+		std::error_code remove_error;
+		std::filesystem::remove(temporary_path, remove_error);
+	}
+}
+
+std::shared_ptr<texture_deserialized_pixels> gbx_texture_intern_table::get_pixels(
+		bool const is_transparent, id_texture_deserialized_palette const & palette,
+		uint32_t const out_width, uint32_t const out_height, uint32_t const out_mip_levels_without_base,
+		uint8_t const * const in_pixels,
+		uint32_t const in_width, uint32_t const in_height, uint32_t const in_mip_levels_without_base,
+		texture_pixels_cache const * const pixels_cache, texture_palette_analysis_cache * const palette_analysis_cache,
+		bool & reused) {
+	size_t const in_pixel_count = texture_pixel_count_with_mips(in_width, in_height, 1 + in_mip_levels_without_base);
+	sha256 key_hash;
+	std::array<uint32_t, 8> const parameters = {
+		uint32_t(is_transparent),
+		out_width,
+		out_height,
+		out_mip_levels_without_base,
+		in_width,
+		in_height,
+		in_mip_levels_without_base,
+		uint32_t(palette.size()),
+	};
+	key_hash.update(parameters.data(), sizeof(parameters));
+	key_hash.update(palette.data(), palette.size());
+	key_hash.update(in_pixels, in_pixel_count);
+	key const pixels_key = key_hash.finish();
+	{
+		std::lock_guard<std::mutex> const lock(mutex);
+		auto const pixels_iterator = pixels.find(pixels_key);
+		if (pixels_iterator != pixels.cend()) {
+			reused = true;
+			return pixels_iterator->second;
+		}
+	}
+	// Convert outside the lock as conversion is expensive. If another thread converts the same texture at the same
+	// time, the results are the same, and the one stored first is used by both.
+	std::shared_ptr<texture_deserialized_pixels> converted_pixels = std::make_shared<texture_deserialized_pixels>(
+			texture_pixel_count_with_mips(out_width, out_height, 1 + out_mip_levels_without_base));
+	convert_texture_pixels(
+			is_transparent, palette,
+			converted_pixels->data(), out_width, out_height, out_mip_levels_without_base,
+			in_pixels, in_width, in_height, in_mip_levels_without_base,
+			pixels_cache, palette_analysis_cache);
+	std::lock_guard<std::mutex> const lock(mutex);
+	auto const pixels_emplaced = pixels.emplace(pixels_key, std::move(converted_pixels));
+	reused = !pixels_emplaced.second;
+	return pixels_emplaced.first->second;
+}
+
+std::shared_ptr<gbx_texture_deserialized_palette> gbx_texture_intern_table::get_palette(
+		gbx_palette_type const palette_type, id_texture_deserialized_palette const & palette_id) {
+	sha256 key_hash;
+	uint32_t const palette_type_32 = uint32_t(palette_type);
+	key_hash.update(&palette_type_32, sizeof(palette_type_32));
+	key_hash.update(palette_id.data(), palette_id.size());
+	key const palette_key = key_hash.finish();
+	std::lock_guard<std::mutex> const lock(mutex);
+	std::shared_ptr<gbx_texture_deserialized_palette> & palette = palettes[palette_key];
+	if (!palette) {
+		// Cheap compared to the pixels, converted under the lock.
+		palette = std::make_shared<gbx_texture_deserialized_palette>();
+		gbx_palette_from_id(palette_type, *palette, palette_id);
+	}
+	return palette;
+}
+
+// Like in qlumpy GrabMip.
+static constexpr float max_transparent_coverage = 0.4f;
+
+// Generates the mips after the first existing_mip_levels_without_base + 1 levels by box filtering the base level in
+// linear space, with error diffusion within each mip.
+// The base level is converted to linear once for all the mips. The samples of each pixel are summed in the same order
+// as the pixels are stored in the base level, with the components summed in parallel, so the results are exactly the
+// same as those of summing each component separately. Filtering mips from the previous mip instead of from the base
+// level would change the rounding of the sums, and thus the selected colors.
+static void generate_texture_mips(
+		bool const is_transparent, std::array<vector4, 256> const & linear_palette,
+		linear_palette_closest_color_search const & closest_color_search,
+		uint8_t * const pixels, uint32_t const width, uint32_t const height, uint32_t const mip_levels_without_base,
+		uint32_t const existing_mip_levels_without_base) {
+	if (existing_mip_levels_without_base >= mip_levels_without_base) {
+		return;
+	}
+
+	// Transparent samples are excluded from the filtering. Their color is black, which doesn't change the sum when
+	// added, and their alpha is 0, while it's 1 for the other samples, so the sum of the alpha is the number of the
+	// samples included.
+	std::array<vector4, 256> sample_palette = linear_palette;
+	for (vector4 & sample_color : sample_palette) {
+		sample_color.v[3] = 1.0f;
+	}
+	if (is_transparent) {
+		std::fill(sample_palette[255].v, sample_palette[255].v + 4, 0.0f);
+	}
+	size_t const base_pixel_count = size_t(width) * size_t(height);
+	std::vector<vector4> base_linear(base_pixel_count);
+	for (size_t pixel_number = 0; pixel_number < base_pixel_count; ++pixel_number) {
+		base_linear[pixel_number] = sample_palette[pixels[pixel_number]];
+	}
+
+	size_t mip_offset = 0;
+	for (uint32_t mip_level = 0; mip_level <= mip_levels_without_base; ++mip_level) {
+		uint32_t const mip_width = width >> mip_level;
+		uint32_t const mip_height = height >> mip_level;
+		if (!mip_width || !mip_height) {
+			break;
+		}
+		if (mip_level > existing_mip_levels_without_base) {
+			uint32_t const mip_step = UINT32_C(1) << mip_level;
+			uint32_t const max_transparent_sample_count =
+					uint32_t(float(mip_step * mip_step) * max_transparent_coverage);
+			vector3 diffused_error;
+			std::fill(diffused_error.v, diffused_error.v + 3, 0.0f);
+			for (uint32_t y = 0; y < height; y += mip_step) {
+				uint8_t * const mip_row = pixels + mip_offset + size_t(mip_width) * (y >> mip_level);
+				uint32_t const sample_y_end = y + std::min(mip_step, height - y);
+				for (uint32_t x = 0; x < width; x += mip_step) {
+					uint32_t const sample_x_end = x + std::min(mip_step, width - x);
+					vector4 sample_sum;
+					#if BS2PC_TEXTURES_SSE2
+					__m128 sample_sum_sse = _mm_setzero_ps();
+					for (uint32_t sample_y = y; sample_y < sample_y_end; ++sample_y) {
+						vector4 const * const sample_row = base_linear.data() + size_t(width) * sample_y;
+						for (uint32_t sample_x = x; sample_x < sample_x_end; ++sample_x) {
+							sample_sum_sse = _mm_add_ps(sample_sum_sse, _mm_loadu_ps(sample_row[sample_x].v));
+						}
+					}
+					_mm_storeu_ps(sample_sum.v, sample_sum_sse);
+					#else
+					std::fill(sample_sum.v, sample_sum.v + 4, 0.0f);
+					for (uint32_t sample_y = y; sample_y < sample_y_end; ++sample_y) {
+						vector4 const * const sample_row = base_linear.data() + size_t(width) * sample_y;
+						for (uint32_t sample_x = x; sample_x < sample_x_end; ++sample_x) {
+							for (size_t component = 0; component < 4; ++component) {
+								sample_sum.v[component] += sample_row[sample_x].v[component];
+							}
+						}
+					}
+					#endif
+					// Sums of up to 65536 ones are exact.
+					uint32_t const sample_count = uint32_t(sample_sum.v[3]);
+					uint8_t mip_pixel;
+					if (sample_count <= max_transparent_sample_count) {
+						mip_pixel = 255;
+					} else {
+						vector3 pixel_with_diffused_error;
+						for (size_t component = 0; component < 3; ++component) {
+							pixel_with_diffused_error.v[component] =
+									sample_sum.v[component] / float(sample_count) + diffused_error.v[component];
+						}
+						mip_pixel = closest_color_search.find(pixel_with_diffused_error);
+						vector4 const & best_linear_color = linear_palette[mip_pixel];
+						for (size_t component = 0; component < 3; ++component) {
+							diffused_error.v[component] =
+									pixel_with_diffused_error.v[component] - best_linear_color.v[component];
+						}
+					}
+					mip_row[x >> mip_level] = mip_pixel;
+				}
+			}
+		}
+		mip_offset += size_t(mip_width) * size_t(mip_height);
+	}
+}
 
 void convert_texture_pixels(
 		bool const is_transparent, id_texture_deserialized_palette const & palette,
 		uint8_t * const out_pixels,
 		uint32_t const out_width, uint32_t const out_height, uint32_t const out_mip_levels_without_base,
 		uint8_t const * const in_pixels,
-		uint32_t const in_width, uint32_t const in_height, uint32_t in_mip_levels_without_base) {
+		uint32_t const in_width, uint32_t const in_height, uint32_t in_mip_levels_without_base,
+		texture_pixels_cache const * const pixels_cache,
+		texture_palette_analysis_cache * const palette_analysis_cache) {
 	assert(out_width && out_height);
 	assert(in_width && in_height);
 	assert(out_width <= texture_max_width_height && out_height <= texture_max_width_height);
@@ -1038,6 +1542,35 @@ void convert_texture_pixels(
 	}
 
 	// Need to resample the texture or to generate mips (if it's resampled, all mips must be regenerated).
+
+	size_t const out_pixel_count =
+			texture_pixel_count_with_mips(out_width, out_height, 1 + out_mip_levels_without_base);
+	sha256::digest pixels_cache_key{};
+	if (pixels_cache) {
+		// Hash everything the result depends on. The palette type doesn't affect the pixels, only the transparency.
+		sha256 pixels_cache_key_hash;
+		std::array<uint32_t, 8> const parameters = {
+			texture_pixels_cache::version,
+			uint32_t(is_transparent),
+			out_width,
+			out_height,
+			out_mip_levels_without_base,
+			in_width,
+			in_height,
+			in_mip_levels_without_base,
+		};
+		pixels_cache_key_hash.update(parameters.data(), sizeof(parameters));
+		uint64_t const palette_size = palette.size();
+		pixels_cache_key_hash.update(&palette_size, sizeof(palette_size));
+		pixels_cache_key_hash.update(palette.data(), palette.size());
+		pixels_cache_key_hash.update(
+				in_pixels, texture_pixel_count_with_mips(in_width, in_height, 1 + in_mip_levels_without_base));
+		pixels_cache_key = pixels_cache_key_hash.finish();
+		if (pixels_cache->load(pixels_cache_key, out_pixels, out_pixel_count)) {
+			return;
+		}
+	}
+
 	// Gather the used mip 0 colors to pick the closest colors from for resampling and for generating mips.
 	std::array<uint32_t, 256 / 32> mip_0_opaque_colors_used{};
 	size_t const in_mip_0_pixel_count = size_t(in_width) * size_t(in_height);
@@ -1045,7 +1578,12 @@ void convert_texture_pixels(
 		uint8_t const color_number = in_pixels[pixel_number];
 		mip_0_opaque_colors_used[color_number >> 5] |= UINT32_C(1) << (color_number & 31);
 	}
-	// Convert the used colors from gamma to linear.
+	// Take the linear versions of the used colors from the analysis of the palette, done once for all the textures
+	// using the palette if the cache is provided.
+	std::shared_ptr<texture_palette_analysis const> const palette_analysis =
+			palette_analysis_cache
+					? palette_analysis_cache->get(palette)
+					: std::make_shared<texture_palette_analysis const>(palette);
 	std::array<vector4, 256> linear_palette{};
 	if (is_transparent) {
 		mip_0_opaque_colors_used[255 >> 5] &= ~(UINT32_C(1) << (255 & 31));
@@ -1062,20 +1600,11 @@ void convert_texture_pixels(
 			uint32_t const color_word_bit_number(bit_scan_forward(colors_word_remaining));
 			colors_word_remaining &= ~(UINT32_C(1) << color_word_bit_number);
 			size_t const color_number = color_word_first + color_word_bit_number;
-			vector4 & linear_color = linear_palette[color_number];
-			if (3 * color_number + 2 < palette.size()) {
-				for (size_t component = 0; component < 3; ++component) {
-					linear_color.v[component] = std::pow(float(palette[3 * color_number + component]) / 255.0f, 2.2f);
-				}
-			} else {
-				std::fill(linear_color.v, linear_color.v + 3, 0.0f);
-			}
-			linear_color.v[3] = 1.0f;
+			linear_palette[color_number] = palette_analysis->linear[color_number];
 		}
 	}
 
-	// Like in qlumpy GrabMip.
-	constexpr float max_transparent_coverage = 0.4f;
+	linear_palette_closest_color_search const closest_color_search(*palette_analysis, mip_0_opaque_colors_used);
 
 	if (out_width == in_width && out_height == in_height) {
 		// Copy the mips that don't need to be generated.
@@ -1098,57 +1627,53 @@ void convert_texture_pixels(
 
 		in_mip_levels_without_base = 0;
 
-		float const out_to_in_x = float(in_width) / float(out_width);
-		float const out_to_in_y = float(in_height) / float(out_height);
+		// The bicubic filter is separable, so filter horizontally first, for all rows of the input, and then
+		// vertically, using the horizontally filtered rows.
+		// The sample coordinates and the filter positions are the same for all rows and columns, precompute them.
+		// The results are the same as of filtering horizontally the 4 rows around each output pixel individually.
+		std::vector<cubic_resample_taps> x_taps, y_taps;
+		make_cubic_resample_taps(x_taps, out_width, in_width);
+		make_cubic_resample_taps(y_taps, out_height, in_height);
+
+		std::vector<vector4> in_row_linear(in_width);
+		std::vector<vector4> x_filtered(size_t(out_width) * size_t(in_height));
+		for (uint32_t in_y = 0; in_y < in_height; ++in_y) {
+			uint8_t const * const in_row = in_pixels + size_t(in_width) * in_y;
+			for (uint32_t in_x = 0; in_x < in_width; ++in_x) {
+				in_row_linear[in_x] = linear_palette[in_row[in_x]];
+			}
+			vector4 * const x_filtered_row = x_filtered.data() + size_t(out_width) * in_y;
+			for (uint32_t out_x = 0; out_x < out_width; ++out_x) {
+				cubic_resample_taps const & out_x_taps = x_taps[out_x];
+				x_filtered_row[out_x] = cubic_hermite_vector4(
+						in_row_linear[out_x_taps.samples[0]],
+						in_row_linear[out_x_taps.samples[1]],
+						in_row_linear[out_x_taps.samples[2]],
+						in_row_linear[out_x_taps.samples[3]],
+						out_x_taps.t);
+			}
+		}
 
 		vector3 diffused_error;
 		std::fill(diffused_error.v, diffused_error.v + 3, 0.0f);
 
 		for (uint32_t out_y = 0; out_y < out_height; ++out_y) {
 			uint8_t * const out_row = out_pixels + size_t(out_width) * out_y;
-			float const in_y = (float(out_y) + 0.5f) * out_to_in_y - 0.5f;
-			uint32_t const in_y_b = uint32_t(std::min(float(in_height - 1), std::max(0.0f, in_y)));
-			float const in_y_t = in_y - float(in_y_b);
+			cubic_resample_taps const & out_y_taps = y_taps[out_y];
+			std::array<vector4 const *, 4> x_filtered_sample_rows;
+			for (uint32_t y_sample_number = 0; y_sample_number < 4; ++y_sample_number) {
+				x_filtered_sample_rows[y_sample_number] =
+						x_filtered.data() + size_t(out_width) * out_y_taps.samples[y_sample_number];
+			}
 			for (uint32_t out_x = 0; out_x < out_width; ++out_x) {
-				float const in_x = (float(out_x) + 0.5f) * out_to_in_x - 0.5f;
-				uint32_t const in_x_b = uint32_t(std::min(float(in_width - 1), std::max(0.0f, in_x)));
-				float const in_x_t = in_x - float(in_x_b);
-
-				std::array<vector4, 4> samples_y_filtered;
-				for (uint32_t y_sample_number = 0; y_sample_number < 4; ++y_sample_number) {
-					std::array<vector4, 4> samples_x;
-					uint8_t const * const in_sample_row =
-							in_pixels + in_width *
-							std::min(
-									size_t(in_height - 1),
-									size_t(std::max(
-											int32_t(0),
-											int32_t(in_y_b) + (int32_t(y_sample_number) - int32_t(1)))));
-					for (uint32_t x_sample_number = 0; x_sample_number < 4; ++x_sample_number) {
-						samples_x[x_sample_number] = linear_palette[in_sample_row[
-								std::min(
-									size_t(in_width - 1),
-									size_t(std::max(
-											int32_t(0),
-											int32_t(in_x_b) + (int32_t(x_sample_number) - int32_t(1)))))]];
-					}
-					for (size_t component = 0; component < 4; ++component) {
-						samples_y_filtered[y_sample_number].v[component] = cubic_hermite(
-								samples_x[0].v[component],
-								samples_x[1].v[component],
-								samples_x[2].v[component],
-								samples_x[3].v[component],
-								in_x_t);
-					}
-				}
-				vector4 pixel_linear;
+				vector4 pixel_linear = cubic_hermite_vector4(
+						x_filtered_sample_rows[0][out_x],
+						x_filtered_sample_rows[1][out_x],
+						x_filtered_sample_rows[2][out_x],
+						x_filtered_sample_rows[3][out_x],
+						out_y_taps.t);
 				for (size_t component = 0; component < 4; ++component) {
-					pixel_linear.v[component] = std::min(1.0f, std::max(0.0f, cubic_hermite(
-							samples_y_filtered[0].v[component],
-							samples_y_filtered[1].v[component],
-							samples_y_filtered[2].v[component],
-							samples_y_filtered[3].v[component],
-							in_y_t)));
+					pixel_linear.v[component] = std::min(1.0f, std::max(0.0f, pixel_linear.v[component]));
 				}
 
 				vector3 pixel_with_diffused_error;
@@ -1159,30 +1684,7 @@ void convert_texture_pixels(
 				if (pixel_linear.v[3] <= max_transparent_coverage) {
 					out_pixel = 255;
 				} else {
-					out_pixel = 0;
-					float best_distortion = float(INFINITY);
-					for (size_t colors_word_number = 0;
-							colors_word_number < mip_0_opaque_colors_used.size();
-							++colors_word_number) {
-						size_t const color_word_first = size_t(32) * colors_word_number;
-						uint32_t colors_word_remaining = mip_0_opaque_colors_used[colors_word_number];
-						while (colors_word_remaining) {
-							uint32_t const color_word_bit_number(bit_scan_forward(colors_word_remaining));
-							colors_word_remaining &= ~(UINT32_C(1) << color_word_bit_number);
-							size_t const color_number = color_word_first + color_word_bit_number;
-							vector4 const & linear_palette_color = linear_palette[color_number];
-							float distortion = 0.0f;
-							for (size_t component = 0; component < 3; ++component) {
-								float const component_distortion =
-										pixel_with_diffused_error.v[component] - linear_palette_color.v[component];
-								distortion += component_distortion * component_distortion;
-							}
-							if (distortion < best_distortion) {
-								best_distortion = distortion;
-								out_pixel = uint8_t(color_number);
-							}
-						}
-					}
+					out_pixel = closest_color_search.find(pixel_with_diffused_error);
 				}
 				// Error diffusion regardless of whether the pixel is transparent (black),
 				// so the error doesn't jump over transparent areas.
@@ -1198,91 +1700,21 @@ void convert_texture_pixels(
 		}
 	}
 
-	// Generate the needed mips.
-	size_t mip_offset = 0;
-	for (uint32_t mip_level = 0; mip_level <= out_mip_levels_without_base; ++mip_level) {
-		uint32_t const mip_width = out_width >> mip_level;
-		uint32_t const mip_height = out_height >> mip_level;
-		if (!mip_width || !mip_height) {
-			break;
-		}
-		if (mip_level > in_mip_levels_without_base) {
-			uint32_t const mip_step = UINT32_C(1) << mip_level;
-			vector3 diffused_error;
-			std::fill(diffused_error.v, diffused_error.v + 3, 0.0f);
-			for (uint32_t y = 0; y < out_height; y += mip_step) {
-				uint8_t * const out_row = out_pixels + mip_offset + size_t(mip_width) * (y >> mip_level);
-				uint32_t const sample_y_end = y + std::min(mip_step, out_height - y);
-				for (uint32_t x = 0; x < out_width; x += mip_step) {
-					vector3 sample_sum;
-					std::fill(sample_sum.v, sample_sum.v + 3, 0.0f);
-					uint32_t sample_count = 0;
-					uint32_t const sample_x_end = x + std::min(mip_step, out_width - x);
-					for (uint32_t sample_y = y; sample_y < sample_y_end; ++sample_y) {
-						uint8_t const * const sample_row = out_pixels + size_t(out_width) * sample_y;
-						for (uint32_t sample_x = x; sample_x < sample_x_end; ++sample_x) {
-							uint8_t const sample_color_number = sample_row[sample_x];
-							if (is_transparent && sample_color_number == 255) {
-								continue;
-							}
-							vector4 const & sample_linear_color = linear_palette[sample_color_number];
-							for (size_t component = 0; component < 3; ++component) {
-								sample_sum.v[component] += sample_linear_color.v[component];
-							}
-							++sample_count;
-						}
-					}
-					uint8_t mip_pixel;
-					if (sample_count <= uint32_t(float(mip_step * mip_step) * max_transparent_coverage)) {
-						mip_pixel = 255;
-					} else {
-						mip_pixel = 0;
-						vector3 pixel_with_diffused_error;
-						for (size_t component = 0; component < 3; ++component) {
-							pixel_with_diffused_error.v[component] =
-									sample_sum.v[component] / float(sample_count) + diffused_error.v[component];
-						}
-						float best_distortion = float(INFINITY);
-						for (size_t colors_word_number = 0;
-								colors_word_number < mip_0_opaque_colors_used.size();
-								++colors_word_number) {
-							size_t const color_word_first = size_t(32) * colors_word_number;
-							uint32_t colors_word_remaining = mip_0_opaque_colors_used[colors_word_number];
-							while (colors_word_remaining) {
-								uint32_t const color_word_bit_number(bit_scan_forward(colors_word_remaining));
-								colors_word_remaining &= ~(UINT32_C(1) << color_word_bit_number);
-								size_t const color_number = color_word_first + color_word_bit_number;
-								vector4 const & linear_palette_color = linear_palette[color_number];
-								float distortion = 0.0f;
-								for (size_t component = 0; component < 3; ++component) {
-									float const component_distortion =
-											pixel_with_diffused_error.v[component] - linear_palette_color.v[component];
-									distortion += component_distortion * component_distortion;
-								}
-								if (distortion < best_distortion) {
-									best_distortion = distortion;
-									mip_pixel = uint8_t(color_number);
-								}
-							}
-						}
-						vector4 const & best_linear_color = linear_palette[mip_pixel];
-						for (size_t component = 0; component < 3; ++component) {
-							diffused_error.v[component] =
-									pixel_with_diffused_error.v[component] - best_linear_color.v[component];
-						}
-					}
-					out_row[x >> mip_level] = mip_pixel;
-				}
-			}
-		}
-		mip_offset += size_t(mip_width) * size_t(mip_height);
+	generate_texture_mips(
+			is_transparent, linear_palette, closest_color_search,
+			out_pixels, out_width, out_height, out_mip_levels_without_base, in_mip_levels_without_base);
+
+	if (pixels_cache) {
+		pixels_cache->store(pixels_cache_key, out_pixels, out_pixel_count);
 	}
 }
 
 void id_texture_deserialized::pixels_and_palette_from_gbx(
 		gbx_texture_deserialized const & gbx,
 		std::optional<std::shared_ptr<id_texture_deserialized_palette>> const override_palette,
-		id_texture_deserialized_palette const & quake_palette) {
+		id_texture_deserialized_palette const & quake_palette,
+		texture_pixels_cache const * const pixels_cache,
+		texture_palette_analysis_cache * const palette_analysis_cache) {
 	if (override_palette) {
 		palette = *override_palette;
 	} else {
@@ -1304,7 +1736,8 @@ void id_texture_deserialized::pixels_and_palette_from_gbx(
 	convert_texture_pixels(
 			gbx.name.c_str()[0] == '{', palette ? *palette : quake_palette,
 			pixels->data(), width, height, id_texture_mip_levels - 1,
-			gbx.pixels->data(), gbx.scaled_width, gbx.scaled_height, gbx.name.c_str()[0] == '-' ? 0 : gbx.mip_levels);
+			gbx.pixels->data(), gbx.scaled_width, gbx.scaled_height, gbx.name.c_str()[0] == '-' ? 0 : gbx.mip_levels,
+			pixels_cache, palette_analysis_cache);
 }
 
 void id_texture_deserialized::pixels_and_palette_from_wads_or_gbx(
@@ -1312,7 +1745,9 @@ void id_texture_deserialized::pixels_and_palette_from_wads_or_gbx(
 		wad_textures_deserialized const * const * const wads,
 		size_t const wad_count,
 		bool const include_all_textures,
-		palette_set const & quake_palette) {
+		palette_set const & quake_palette,
+		texture_pixels_cache const * const pixels_cache,
+		texture_palette_analysis_cache * const palette_analysis_cache) {
 	texture_identical_status wad_texture_identical_status;
 	size_t wad_texture_wad_number;
 	bool wad_texture_inclusion_required;
@@ -1329,7 +1764,8 @@ void id_texture_deserialized::pixels_and_palette_from_wads_or_gbx(
 			assert(wad_texture_identical_status ==
 					texture_identical_status::same_palette_different_pixels);
 			// Use the 24-bit palette from the WAD.
-			pixels_and_palette_from_gbx(gbx, wad_texture->texture_id.palette, quake_palette.id);
+			pixels_and_palette_from_gbx(
+					gbx, wad_texture->texture_id.palette, quake_palette.id, pixels_cache, palette_analysis_cache);
 		}
 		// Even if the pixels are included, or only the palette is reused, still mark the WAD as used so the WAD, for
 		// instance, isn't removed from the list if that's the case for all textures there, and the pixels and the
@@ -1337,44 +1773,66 @@ void id_texture_deserialized::pixels_and_palette_from_wads_or_gbx(
 		// conversion.
 		wad_number = wad_texture_wad_number;
 	} else {
-		pixels_and_palette_from_gbx(gbx, std::nullopt, quake_palette.id);
+		pixels_and_palette_from_gbx(gbx, std::nullopt, quake_palette.id, pixels_cache, palette_analysis_cache);
 	}
 }
 
-void gbx_texture_deserialized::pixels_and_palette_from_id(
+bool gbx_texture_deserialized::pixels_and_palette_from_id(
 		id_texture_deserialized const & id,
-		id_texture_deserialized_palette const & quake_palette) {
+		id_texture_deserialized_palette const & quake_palette,
+		texture_pixels_cache const * const pixels_cache,
+		gbx_texture_intern_table * const intern_table,
+		texture_palette_analysis_cache * const palette_analysis_cache) {
 	assert(!id.empty());
 	width = id.width;
 	height = id.height;
 	scaled_width = gbx_texture_scaled_size(width);
 	scaled_height = gbx_texture_scaled_size(height);
 	mip_levels = gbx_texture_mip_levels_without_base(scaled_width, scaled_height);
-	if (id.pixels) {
-		if (id.palette) {
+	if (!id.pixels) {
+		// Texture not found on the map and in any WAD, write a checkerboard during serialization.
+		remove_pixels();
+		return false;
+	}
+	if (id.palette) {
+		if (intern_table) {
+			// The interned palette is shared, so it must be replaced rather than modified.
+			palette_id_indexed = intern_table->get_palette(gbx_texture_palette_type(name.c_str()), *id.palette);
+		} else {
 			if (!palette_id_indexed) {
 				palette_id_indexed = std::make_shared<gbx_texture_deserialized_palette>();
 			}
 			gbx_palette_from_id(gbx_texture_palette_type(name.c_str()), *palette_id_indexed, *id.palette);
-		} else {
-			// Use the Quake palette.
-			palette_id_indexed.reset();
 		}
-		pixels = std::make_shared<texture_deserialized_pixels>(
-				texture_pixel_count_with_mips(scaled_width, scaled_height, 1 + mip_levels));
-		convert_texture_pixels(
-				name.c_str()[0] == '{', id.palette ? *id.palette : quake_palette,
-				pixels->data(), scaled_width, scaled_height, mip_levels,
-				id.pixels->data(), id.width, id.height, id_texture_mip_levels - 1);
 	} else {
-		// Texture not found on the map and in any WAD, write a checkerboard during serialization.
-		remove_pixels();
+		// Use the Quake palette.
+		palette_id_indexed.reset();
+	}
+	if (intern_table) {
+		bool pixels_reused = false;
+		pixels = intern_table->get_pixels(
+				name.c_str()[0] == '{', id.palette ? *id.palette : quake_palette,
+				scaled_width, scaled_height, mip_levels,
+				id.pixels->data(), id.width, id.height, id_texture_mip_levels - 1,
+				pixels_cache, palette_analysis_cache, pixels_reused);
+		return pixels_reused;
 	}
+	pixels = std::make_shared<texture_deserialized_pixels>(
+			texture_pixel_count_with_mips(scaled_width, scaled_height, 1 + mip_levels));
+	convert_texture_pixels(
+			name.c_str()[0] == '{', id.palette ? *id.palette : quake_palette,
+			pixels->data(), scaled_width, scaled_height, mip_levels,
+			id.pixels->data(), id.width, id.height, id_texture_mip_levels - 1,
+			pixels_cache, palette_analysis_cache);
+	return false;
 }
 
-void gbx_texture_deserialized::pixels_and_palette_from_wad(
+bool gbx_texture_deserialized::pixels_and_palette_from_wad(
 		wad_texture_deserialized & wad_texture,
-		id_texture_deserialized_palette const & quake_palette) {
+		id_texture_deserialized_palette const & quake_palette,
+		texture_pixels_cache const * const pixels_cache,
+		gbx_texture_intern_table * const intern_table,
+		texture_palette_analysis_cache * const palette_analysis_cache) {
 	width = wad_texture.texture_id.width;
 	height = wad_texture.texture_id.height;
 	scaled_width = gbx_texture_scaled_size(width);
@@ -1386,8 +1844,12 @@ void gbx_texture_deserialized::pixels_and_palette_from_wad(
 		std::shared_ptr<gbx_texture_deserialized_palette> & palette_gbx_ref =
 				wad_texture.palettes_id_indexed_gbx[palette_type];
 		if (!palette_gbx_ref) {
-			palette_gbx_ref = std::make_shared<gbx_texture_deserialized_palette>();
-			gbx_palette_from_id(palette_type, *palette_gbx_ref, *wad_texture.texture_id.palette);
+			if (intern_table) {
+				palette_gbx_ref = intern_table->get_palette(palette_type, *wad_texture.texture_id.palette);
+			} else {
+				palette_gbx_ref = std::make_shared<gbx_texture_deserialized_palette>();
+				gbx_palette_from_id(palette_type, *palette_gbx_ref, *wad_texture.texture_id.palette);
+			}
 		}
 		palette_id_indexed = palette_gbx_ref;
 	} else {
@@ -1398,17 +1860,30 @@ void gbx_texture_deserialized::pixels_and_palette_from_wad(
 			name.c_str()[0] == '-'
 					? wad_texture.default_scaled_size_pixels_random_gbx
 					: wad_texture.default_scaled_size_pixels_gbx;
+	bool pixels_reused = bool(pixels_gbx_ref);
 	if (!pixels_gbx_ref) {
-		pixels_gbx_ref = std::make_shared<texture_deserialized_pixels>(
-				texture_pixel_count_with_mips(scaled_width, scaled_height, 1 + mip_levels));
-		convert_texture_pixels(
-				name.c_str()[0] == '{',
-				wad_texture.texture_id.palette ? *wad_texture.texture_id.palette : quake_palette,
-				pixels_gbx_ref->data(), scaled_width, scaled_height, mip_levels,
-				wad_texture.texture_id.pixels->data(), wad_texture.texture_id.width, wad_texture.texture_id.height,
-				id_texture_mip_levels - 1);
+		if (intern_table) {
+			pixels_gbx_ref = intern_table->get_pixels(
+					name.c_str()[0] == '{',
+					wad_texture.texture_id.palette ? *wad_texture.texture_id.palette : quake_palette,
+					scaled_width, scaled_height, mip_levels,
+					wad_texture.texture_id.pixels->data(), wad_texture.texture_id.width, wad_texture.texture_id.height,
+					id_texture_mip_levels - 1,
+					pixels_cache, palette_analysis_cache, pixels_reused);
+		} else {
+			pixels_gbx_ref = std::make_shared<texture_deserialized_pixels>(
+					texture_pixel_count_with_mips(scaled_width, scaled_height, 1 + mip_levels));
+			convert_texture_pixels(
+					name.c_str()[0] == '{',
+					wad_texture.texture_id.palette ? *wad_texture.texture_id.palette : quake_palette,
+					pixels_gbx_ref->data(), scaled_width, scaled_height, mip_levels,
+					wad_texture.texture_id.pixels->data(), wad_texture.texture_id.width, wad_texture.texture_id.height,
+					id_texture_mip_levels - 1,
+					pixels_cache, palette_analysis_cache);
+		}
 	}
 	pixels = pixels_gbx_ref;
+	return pixels_reused;
 }
 
 void reconstruct_random_texture_sequences(
@@ -1475,10 +1950,9 @@ void reconstruct_random_texture_sequences(
 			// Try to locate the pixels in the WAD.
 			std::string const wad_texture_key = string_to_lower(texture.name);
 			for (size_t wad_number = 0; wad_number < wad_count; ++wad_number) {
-				wad_textures_deserialized const & wad = *wads[wad_number];
-				auto const wad_texture_number_iterator = wad.texture_number_map.find(wad_texture_key);
-				if (wad_texture_number_iterator != wad.texture_number_map.cend()) {
-					pixels_texture = &wad.textures[wad_texture_number_iterator->second].texture_id;
+				wad_texture_deserialized const * const wad_texture = wads[wad_number]->find_texture(wad_texture_key);
+				if (wad_texture) {
+					pixels_texture = &wad_texture->texture_id;
 					pixels_texture_wad_number = wad_number;
 					break;
 				}
@@ -1528,10 +2002,9 @@ void reconstruct_random_texture_sequences(
 			id_texture_deserialized const * wad_frame_0 = nullptr;
 			size_t wad_frame_0_wad_number = SIZE_MAX;
 			for (size_t wad_number = 0; wad_number < wad_count; ++wad_number) {
-				wad_textures_deserialized const & wad = *wads[wad_number];
-				auto const wad_texture_number_iterator = wad.texture_number_map.find(frame_key);
-				if (wad_texture_number_iterator != wad.texture_number_map.cend()) {
-					wad_frame_0 = &wad.textures[wad_texture_number_iterator->second].texture_id;
+				wad_texture_deserialized const * const wad_texture = wads[wad_number]->find_texture(frame_key);
+				if (wad_texture) {
+					wad_frame_0 = &wad_texture->texture_id;
 					wad_frame_0_wad_number = wad_number;
 					break;
 				}
@@ -1550,10 +2023,9 @@ void reconstruct_random_texture_sequences(
 					size_t wad_frame_wad_number = SIZE_MAX;
 					++frame_key[1];
 					for (size_t wad_number = 0; wad_number < wad_count; ++wad_number) {
-						wad_textures_deserialized const & wad = *wads[wad_number];
-						auto const wad_texture_number_iterator = wad.texture_number_map.find(frame_key);
-						if (wad_texture_number_iterator != wad.texture_number_map.cend()) {
-							wad_frame = &wad.textures[wad_texture_number_iterator->second].texture_id;
+						wad_texture_deserialized const * const wad_texture = wads[wad_number]->find_texture(frame_key);
+						if (wad_texture) {
+							wad_frame = &wad_texture->texture_id;
 							wad_frame_wad_number = wad_number;
 							break;
 						}
@@ -1700,26 +2172,39 @@ void reconstruct_random_texture_sequences(
 	}
 }
 
+static size_t align_wadg_indexed_offset(size_t const offset) {
+	return (offset + (wadg_indexed_lump_alignment - 1)) & ~(wadg_indexed_lump_alignment - 1);
+}
+
 void write_wadg(
 		std::ofstream & output_stream,
 		std::map<std::string, gbx_texture_deserialized> & textures,
 		palette_set const & quake_palette) {
-	size_t wadg_info_table_offset = sizeof(wad_info);
+	// The textures are iterated in the order of their keys, which are the names of the lumps in the index.
+	size_t wadg_info_table_offset = sizeof(wadg_indexed_info);
 	for (std::pair<std::string const, gbx_texture_deserialized> const & texture_pair : textures) {
 		gbx_texture_deserialized const & texture = texture_pair.second;
-		wadg_info_table_offset += sizeof(gbx_texture) + texture.pixels->size() + texture.palette_id_indexed->size();
-	}
-	wad_info wadg_info;
-	wadg_info.identification[0] = 'W';
-	wadg_info.identification[1] = 'A';
-	wadg_info.identification[2] = 'D';
+		wadg_info_table_offset = align_wadg_indexed_offset(
+				wadg_info_table_offset +
+				sizeof(gbx_texture) + texture.pixels->size() + texture.palette_id_indexed->size());
+	}
+	wadg_indexed_info wadg_info;
+	wadg_info.info.identification[0] = 'W';
+	wadg_info.info.identification[1] = 'A';
+	wadg_info.info.identification[2] = 'D';
 	// BS2PC-specific type containing Gearbox textures, not a PC WAD3.
-	// Also lumps are not 4-aligned for simplicity.
-	wadg_info.identification[3] = 'G';
-	wadg_info.lump_count = uint32_t(textures.size());
-	wadg_info.info_table_offset = uint32_t(wadg_info_table_offset);
+	wadg_info.info.identification[3] = 'G';
+	wadg_info.info.lump_count = uint32_t(textures.size());
+	wadg_info.info.info_table_offset = uint32_t(wadg_info_table_offset);
+	wadg_info.index_identification[0] = 'W';
+	wadg_info.index_identification[1] = 'G';
+	wadg_info.index_identification[2] = 'I';
+	wadg_info.index_identification[3] = 'X';
+	wadg_info.version = wadg_indexed_version;
+	std::memset(wadg_info.padding, 0, sizeof(wadg_info.padding));
 	output_stream.write(reinterpret_cast<char const *>(&wadg_info), std::streamsize(sizeof(wadg_info)));
 	// Write the textures.
+	static char const wadg_alignment_padding[wadg_indexed_lump_alignment] = {};
 	gbx_texture wadg_texture_serialized;
 	wadg_texture_serialized.pixels = sizeof(gbx_texture);
 	std::memset(&wadg_texture_serialized.unknown_0, 0, sizeof(wadg_texture_serialized.unknown_0));
@@ -1764,6 +2249,11 @@ void write_wadg(
 							4 * size_t(convert_palette_color_number(uint8_t(texture_color_number))),
 					4 * 8);
 		}
+		size_t const texture_lump_size =
+				sizeof(gbx_texture) + texture.pixels->size() + texture.palette_id_indexed->size();
+		output_stream.write(
+				wadg_alignment_padding,
+				std::streamsize(align_wadg_indexed_offset(texture_lump_size) - texture_lump_size));
 	}
 	// Write the lump information.
 	size_t wadg_lump_offset = sizeof(wadg_info);
@@ -1772,26 +2262,167 @@ void write_wadg(
 	wadg_lump_info.compression = wad_lump_compression_none;
 	wadg_lump_info.padding = 0;
 	for (std::pair<std::string const, gbx_texture_deserialized> const & texture_pair : textures) {
+		std::string const & texture_name_lower = texture_pair.first;
 		gbx_texture_deserialized const & texture = texture_pair.second;
 		wadg_lump_info.file_position = uint32_t(wadg_lump_offset);
 		size_t const texture_lump_size =
 				sizeof(gbx_texture) + texture.pixels->size() + texture.palette_id_indexed->size();
 		wadg_lump_info.disk_size = uint32_t(texture_lump_size);
 		wadg_lump_info.size = uint32_t(texture_lump_size);
-		size_t const texture_name_length = std::min(size_t(wad_lump_name_max_length), texture.name.size());
+		size_t const texture_name_length = std::min(size_t(wad_lump_name_max_length), texture_name_lower.size());
 		std::memcpy(
 				wadg_lump_info.name,
-				texture.name.c_str(),
+				texture_name_lower.c_str(),
 				texture_name_length);
 		std::memset(
 				wadg_lump_info.name + texture_name_length,
 				0,
 				wad_lump_name_max_length + 1 - texture_name_length);
 		output_stream.write(reinterpret_cast<char const *>(&wadg_lump_info), std::streamsize(sizeof(wadg_lump_info)));
-		wadg_lump_offset += texture_lump_size;
+		wadg_lump_offset = align_wadg_indexed_offset(wadg_lump_offset + texture_lump_size);
 	}
 }
 
+char const * get_wadg_textures(
+		void const * const wadg, size_t const wadg_size, wadg_textures_deserialized & wadg_textures,
+		palette_set const & quake_palette) {
+	wadg_textures.wadg = nullptr;
+	wadg_textures.wadg_size = 0;
+	wadg_textures.lump_count = 0;
+	wadg_textures.info_table_offset = 0;
+	wadg_textures.texture_states.clear();
+	wadg_textures.textures.clear();
+	wadg_textures.deserialized_textures.clear();
+	wadg_indexed_info info;
+	if (wadg_size < sizeof(wadg_indexed_info)) {
+		// Can't be the indexed layout.
+		return add_wadg_textures(wadg, wadg_size, wadg_textures.deserialized_textures, quake_palette);
+	}
+	std::memcpy(&info, wadg, sizeof(wadg_indexed_info));
+	if (info.info.identification[0] != 'W' ||
+			info.info.identification[1] != 'A' ||
+			info.info.identification[2] != 'D' ||
+			info.info.identification[3] != 'G') {
+		return "The file is not a BS2PC WADG file";
+	}
+	if (info.index_identification[0] != 'W' ||
+			info.index_identification[1] != 'G' ||
+			info.index_identification[2] != 'I' ||
+			info.index_identification[3] != 'X' ||
+			info.version != wadg_indexed_version) {
+		// The original layout, or an unknown version (which is still compatible with the original layout).
+		return add_wadg_textures(wadg, wadg_size, wadg_textures.deserialized_textures, quake_palette);
+	}
+	if (info.info.lump_count &&
+			(info.info.info_table_offset > wadg_size ||
+					(wadg_size - info.info.info_table_offset) / sizeof(wad_lump_info) < info.info.lump_count)) {
+		return "The information table is out of bounds";
+	}
+	wadg_textures.wadg = reinterpret_cast<char const *>(wadg);
+	wadg_textures.wadg_size = wadg_size;
+	wadg_textures.lump_count = info.info.lump_count;
+	wadg_textures.info_table_offset = info.info.info_table_offset;
+	wadg_textures.quake_palette = &quake_palette;
+	wadg_textures.texture_states.resize(info.info.lump_count, wadg_textures_deserialized::texture_state::not_decoded);
+	wadg_textures.textures.resize(info.info.lump_count);
+	return nullptr;
+}
+
+gbx_texture_deserialized const * wadg_textures_deserialized::find_texture(std::string_view const name_lower) const {
+	if (!wadg) {
+		auto const texture_iterator = deserialized_textures.find(std::string(name_lower));
+		return texture_iterator != deserialized_textures.cend() ? &texture_iterator->second : nullptr;
+	}
+	if (name_lower.size() > wad_lump_name_max_length) {
+		return nullptr;
+	}
+	// Binary search in the lump information table sorted by the names.
+	uint32_t search_begin = 0;
+	uint32_t search_end = lump_count;
+	while (search_begin < search_end) {
+		uint32_t const lump_number = search_begin + (search_end - search_begin) / 2;
+		wad_lump_info lump_info;
+		std::memcpy(&lump_info, wadg + info_table_offset + sizeof(wad_lump_info) * lump_number, sizeof(wad_lump_info));
+		size_t lump_name_length = 0;
+		while (lump_name_length < wad_lump_name_max_length && lump_info.name[lump_name_length]) {
+			++lump_name_length;
+		}
+		int const name_comparison = std::string_view(lump_info.name, lump_name_length).compare(name_lower);
+		if (name_comparison < 0) {
+			search_begin = lump_number + 1;
+			continue;
+		}
+		if (name_comparison > 0) {
+			search_end = lump_number;
+			continue;
+		}
+		std::lock_guard<std::mutex> const decode_lock(*decode_mutex);
+		if (texture_states[lump_number] == texture_state::not_decoded) {
+			gbx_texture_deserialized & texture = textures[lump_number];
+			if (lump_info.type == wad_lump_type_texture &&
+					lump_info.compression == wad_lump_compression_none &&
+					lump_info.file_position <= wadg_size &&
+					wadg_size - lump_info.file_position >= lump_info.size &&
+					!texture.deserialize_with_anim_offsets(
+							wadg + lump_info.file_position,
+							lump_info.size,
+							0,
+							false,
+							*quake_palette)) {
+				// Clean up the animation fields as they will be reconstructed for every map.
+				texture.reset_anim();
+				texture_states[lump_number] = texture_state::decoded;
+			} else {
+				texture_states[lump_number] = texture_state::invalid;
+				texture = gbx_texture_deserialized();
+			}
+		}
+		return texture_states[lump_number] == texture_state::decoded ? &textures[lump_number] : nullptr;
+	}
+	return nullptr;
+}
+
+gbx_texture_deserialized const * find_identical_wadg_texture(
+		wadg_textures_deserialized const & wadg_textures,
+		std::string_view const name,
+		id_texture_deserialized const & texture_id,
+		palette_set const & quake_palette) {
+	std::string key = string_to_lower(name);
+	gbx_texture_deserialized const * const wadg_texture = wadg_textures.find_texture(key);
+	if (wadg_texture &&
+			is_texture_data_identical(texture_id, *wadg_texture, quake_palette) ==
+					texture_identical_status::same_palette_same_or_resampled_pixels) {
+		return wadg_texture;
+	}
+	// Some animated textures have one specific frame selected on certain maps with the + prefix removed.
+	// Try finding the pixels in the frame with the prefix toggled.
+	// Not doing the same for random-tiled ('-'-prefixed) textures as their palettes have inverted colors (in the
+	// original Valve 24-bit texture, not even in 21 bits directly), can't simply copy the palette between a
+	// `-`-prefixed texture and one without the prefix. Using pixels from a '-'-prefixed texture for one without the
+	// prefix is even worse, as they have incorrect mips in the original Gearbox maps, thus the pixels can't be reused
+	// directly. The PS2 engine doesn't display the '-'-prefixed textures correctly at all though, with the interleaving
+	// and the inversion being visible to the player. Therefore, it's recommended to remove the '-' prefix completely
+	// when converting from Valve maps to Gearbox.
+	if (key.c_str()[0] == '+') {
+		key = key.substr(1);
+		gbx_texture_deserialized const * const wadg_texture_without_animation = wadg_textures.find_texture(key);
+		if (wadg_texture_without_animation &&
+				is_texture_data_identical(texture_id, *wadg_texture_without_animation, quake_palette) ==
+						texture_identical_status::same_palette_same_or_resampled_pixels) {
+			return wadg_texture_without_animation;
+		}
+	} else if (key.size() < texture_name_max_length && texture_anim_frame(key.c_str()[0]) != UINT32_MAX) {
+		key = '+' + key;
+		gbx_texture_deserialized const * const wadg_texture_with_animation = wadg_textures.find_texture(key);
+		if (wadg_texture_with_animation &&
+				is_texture_data_identical(texture_id, *wadg_texture_with_animation, quake_palette) ==
+						texture_identical_status::same_palette_same_or_resampled_pixels) {
+			return wadg_texture_with_animation;
+		}
+	}
+	return nullptr;
+}
+
 uint8_t const quake_default_palette[3 * 256] = {
 	0x00, 0x00, 0x00, 0x0F, 0x0F, 0x0F, 0x1F, 0x1F, 0x1F, 0x2F, 0x2F, 0x2F,
 	0x3F, 0x3F, 0x3F, 0x4B, 0x4B, 0x4B, 0x5B, 0x5B, 0x5B, 0x6B, 0x6B, 0x6B,
@@ -8,9 +8,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <list>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <string>
@@ -31,6 +35,9 @@
 #include <intrin.h>
 #endif
 
+// zlib stream state, declared here so zlib doesn't need to be included in the header.
+struct z_stream_s;
+
 namespace bs2pc {
 
 // Non-standard function wrappers and additional string functions.
@@ -69,6 +76,31 @@ inline int32_t bit_scan_forward(uint32_t const value) {
 	#endif
 }
 
+// SHA-256, for identifying data by its contents where a collision would result in incorrect output, such as when
+// reusing earlier conversions of textures.
+class sha256 {
+public:
+	using digest = std::array<uint8_t, 32>;
+
+	void update(void const * data, size_t size);
+	// Returns the digest of all the data passed to update. The object must not be updated afterwards.
+	digest finish();
+
+private:
+	void process_block(uint8_t const * block);
+
+	std::array<uint32_t, 8> state = {
+		UINT32_C(0x6A09E667), UINT32_C(0xBB67AE85), UINT32_C(0x3C6EF372), UINT32_C(0xA54FF53A),
+		UINT32_C(0x510E527F), UINT32_C(0x9B05688C), UINT32_C(0x1F83D9AB), UINT32_C(0x5BE0CD19),
+	};
+	std::array<uint8_t, 64> buffer;
+	size_t buffer_size = 0;
+	uint64_t total_size = 0;
+};
+
+// Uppercase hexadecimal digits of the digest.
+std::string sha256_digest_string(sha256::digest const & digest);
+
 // Common types.
 
 // Can be used for map file identification even for a compressed Gearbox map, because the first 4 bytes of one are the
@@ -351,17 +383,78 @@ enum class texture_identical_status {
 
 // Entities.
 
-// Like COM_Parse from Quake, but returning the com_token and modifying the data pointer.
-std::string parse_token(char const * & data);
+// Like COM_Parse from Quake, but returning the com_token as a view of the data and modifying the data pointer.
+// Returns an empty token in the end of the data.
+std::string_view parse_token(char const * & data);
 
+// The key-value pairs of all entities of a map, with all the keys and the values stored in one string rather than
+// allocated individually.
 // Keys are case-sensitive (ValueForKey uses Q_strcmp).
-using entity_key_value_pair = std::pair<std::string, std::string>;
-using entity_key_values = std::vector<entity_key_value_pair>;
+// The keys and the values are null-terminated.
+class entity_store {
+public:
+	size_t size() const { return entity_first_key_values.size(); }
+	bool empty() const { return entity_first_key_values.empty(); }
+	void clear();
+
+	// Adds an entity without key-value pairs to the end.
+	void add_entity();
+	void remove_last_entity();
+
+	size_t get_key_value_count(size_t const entity_number) const {
+		return get_key_value_end(entity_number) - entity_first_key_values[entity_number];
+	}
+	std::string_view get_key(size_t const entity_number, size_t const key_value_number) const {
+		key_value const & pair = key_values[entity_first_key_values[entity_number] + key_value_number];
+		return std::string_view(strings.data() + pair.key_offset, pair.key_length);
+	}
+	std::string_view get_value(size_t const entity_number, size_t const key_value_number) const {
+		key_value const & pair = key_values[entity_first_key_values[entity_number] + key_value_number];
+		return std::string_view(strings.data() + pair.value_offset, pair.value_length);
+	}
+	// For modifying the value in place without changing its length.
+	char * get_value_data(size_t const entity_number, size_t const key_value_number) {
+		return strings.data() + key_values[entity_first_key_values[entity_number] + key_value_number].value_offset;
+	}
+	// Returns the number of the first key-value pair with the key in the entity, or SIZE_MAX if there's none.
+	size_t find_key(size_t entity_number, std::string_view key) const;
+
+	// The key and the value must not be views of the strings in the entity store itself.
+	void add_key_value(size_t entity_number, std::string_view key, std::string_view value);
+	// The value must not be a view of the strings in the entity store itself.
+	void set_value(size_t entity_number, size_t key_value_number, std::string_view value);
+	// Replaces the first prefix_length characters of the value.
+	// The new prefix must not be a view of the strings in the entity store itself.
+	void replace_value_prefix(
+			size_t entity_number, size_t key_value_number, size_t prefix_length, std::string_view new_prefix);
+	void remove_key_value(size_t entity_number, size_t key_value_number);
+
+private:
+	struct key_value {
+		size_t key_offset;
+		size_t key_length;
+		size_t value_offset;
+		size_t value_length;
+	};
+
+	// Replaced values are not removed from the strings, only new values are appended.
+	std::string strings;
+	std::vector<key_value> key_values;
+	std::vector<size_t> entity_first_key_values;
+
+	size_t get_key_value_end(size_t const entity_number) const {
+		return entity_number + 1 < entity_first_key_values.size()
+				? entity_first_key_values[entity_number + 1]
+				: key_values.size();
+	}
+	// Returns the offset of the string.
+	size_t append_string(std::string_view string);
+};
 
-std::vector<entity_key_values> deserialize_entities(char const * entities_string);
-std::string serialize_entities(entity_key_values const * entities, size_t entity_count);
+entity_store deserialize_entities(char const * entities_string);
+std::string serialize_entities(entity_store const & entities);
 
-void convert_model_paths(entity_key_values * entities, size_t entity_count, uint32_t version_from, uint32_t version_to);
+void convert_model_paths(entity_store & entities, uint32_t version_from, uint32_t version_to);
 
 // id (disk structures) and Gearbox (memory structures stored on the disc) map file structures.
 
@@ -470,23 +563,139 @@ struct gbx_leaf {
 };
 static_assert(sizeof(gbx_leaf) == 0x40);
 
-// Similar to qbsp2 GetVertex, but without hashing.
-// The resulting vertex may be different (rounded, or selected from an existing one with a threshold).
-template<typename vertex_type>
-size_t add_vertex(std::vector<vertex_type> & vertexes, vector3 const vertex) {
+// Lookup of the vertex closer than an epsilon on every axis to the specified one, returning the vertex with the lowest
+// number among them, like a linear search over all the vertexes would.
+// The vertexes are placed in a grid of cells much larger than the epsilon, and the neighboring cells are only checked
+// on the axes where the vertex is near the cell boundary. The cell size is chosen so integer coordinates and texture
+// subdivision lines rarely lie on the boundaries.
+struct vertex_weld_index {
+	explicit vertex_weld_index(float const epsilon) : epsilon(epsilon) {}
+
+	// The number of vertexes added to the index.
+	size_t size() const { return cell_previous.size(); }
+
+	void clear() {
+		if (!cells.empty()) {
+			cells.clear();
+		}
+		cell_previous.clear();
+	}
+
+	// The vertex numbers are assigned in the order of addition.
+	void push_back(vector3 const & vertex) {
+		size_t const vertex_number = cell_previous.size();
+		cell_previous.push_back(SIZE_MAX);
+		int32_t cell[3], check_previous[3], check_next[3];
+		if (get_cell(vertex, cell, check_previous, check_next)) {
+			size_t & cell_last_vertex_number = cells.try_emplace(get_cell_key(cell[0], cell[1], cell[2]), SIZE_MAX)
+					.first->second;
+			cell_previous[vertex_number] = cell_last_vertex_number;
+			cell_last_vertex_number = vertex_number;
+		}
+	}
+
+	// vertexes must contain the vertexes added to the index.
+	// Returns SIZE_MAX if there's no vertex within the epsilon.
+	template<typename vertex_type>
+	size_t find(vertex_type const * const vertexes, vector3 const & vertex) const {
+		int32_t cell[3], check_previous[3], check_next[3];
+		if (!get_cell(vertex, cell, check_previous, check_next)) {
+			return SIZE_MAX;
+		}
+		size_t found_vertex_number = SIZE_MAX;
+		for (int32_t cell_z = cell[2] - check_previous[2]; cell_z <= cell[2] + check_next[2]; ++cell_z) {
+			for (int32_t cell_y = cell[1] - check_previous[1]; cell_y <= cell[1] + check_next[1]; ++cell_y) {
+				for (int32_t cell_x = cell[0] - check_previous[0]; cell_x <= cell[0] + check_next[0]; ++cell_x) {
+					auto const cell_iterator = cells.find(get_cell_key(cell_x, cell_y, cell_z));
+					if (cell_iterator == cells.cend()) {
+						continue;
+					}
+					// The vertexes in a cell are linked in descending order of their numbers.
+					for (size_t vertex_number = cell_iterator->second;
+							vertex_number != SIZE_MAX && vertex_number < found_vertex_number;
+							vertex_number = cell_previous[vertex_number]) {
+						vertex_type const & existing_vertex = vertexes[vertex_number];
+						if (std::abs(existing_vertex.v[0] - vertex.v[0]) < epsilon &&
+								std::abs(existing_vertex.v[1] - vertex.v[1]) < epsilon &&
+								std::abs(existing_vertex.v[2] - vertex.v[2]) < epsilon) {
+							found_vertex_number = vertex_number;
+						}
+					}
+				}
+			}
+		}
+		return found_vertex_number;
+	}
+
+private:
+	static constexpr double cell_size = 0.8125;
+	// Farther coordinates are clamped to the outermost cells, which only makes the lookup in them slower.
+	static constexpr int32_t cell_max = (INT32_C(1) << 20) - 2;
+
+	float epsilon;
+	// The previous vertex in the same cell, or SIZE_MAX if none.
+	std::vector<size_t> cell_previous;
+	// Key: cell coordinates, 21 bits per axis, value: the last vertex in the cell.
+	std::unordered_map<uint64_t, size_t> cells;
+
+	static uint64_t get_cell_key(int32_t const x, int32_t const y, int32_t const z) {
+		return uint64_t(uint32_t(x) & ((UINT32_C(1) << 21) - 1)) |
+				(uint64_t(uint32_t(y) & ((UINT32_C(1) << 21) - 1)) << 21) |
+				(uint64_t(uint32_t(z) & ((UINT32_C(1) << 21) - 1)) << 42);
+	}
+
+	// Returns false for non-finite vertexes, which are never within the epsilon of any vertex, and thus not placed in
+	// the grid.
+	// The cells to check on each axis are cell - check_previous to cell + check_next.
+	bool get_cell(
+			vector3 const & vertex, int32_t * const cell, int32_t * const check_previous, int32_t * const check_next)
+			const {
+		// With a margin for rounding.
+		double const near_boundary = 2.0 * double(epsilon) / cell_size;
+		for (size_t axis = 0; axis < 3; ++axis) {
+			if (!std::isfinite(vertex.v[axis])) {
+				return false;
+			}
+			double const axis_position = double(vertex.v[axis]) * (1.0 / cell_size);
+			double const axis_cell = std::floor(axis_position);
+			if (axis_cell < -double(cell_max) || axis_cell > double(cell_max)) {
+				cell[axis] = axis_cell < 0.0 ? -cell_max : cell_max;
+				check_previous[axis] = 1;
+				check_next[axis] = 1;
+				continue;
+			}
+			cell[axis] = int32_t(axis_cell);
+			check_previous[axis] = int32_t(axis_position - axis_cell < near_boundary);
+			check_next[axis] = int32_t(axis_position - axis_cell > 1.0 - near_boundary);
+		}
+		return true;
+	}
+};
+
+// POINT_EPSILON, that is ON_EPSILON.
+constexpr float add_vertex_epsilon = 0.01f;
+
+// The vertex to add or to look up in add_vertex, rounded to an integer if it's very close to one.
+inline vector3 round_vertex_to_add(vector3 const vertex) {
 	vector3 vertex_rounded;
 	for (size_t axis = 0; axis < 3; ++axis) {
 		float const component = vertex.v[axis];
 		float const component_rounded = std::floor(component + 0.5f);
 		vertex_rounded.v[axis] = ((std::abs(component - component_rounded) < 0.001f) ? component_rounded : component);
 	}
-	// POINT_EPSILON, that is ON_EPSILON.
-	static constexpr float epsilon = 0.01f;
+	return vertex_rounded;
+}
+
+// Similar to qbsp2 GetVertex, but without hashing.
+// The resulting vertex may be different (rounded, or selected from an existing one with a threshold).
+template<typename vertex_type>
+size_t add_vertex(std::vector<vertex_type> & vertexes, vector3 const vertex) {
+	vector3 const vertex_rounded = round_vertex_to_add(vertex);
 	for (size_t vertex_number = 0; vertex_number < vertexes.size(); ++vertex_number) {
 		vector3 const & existing_vertex = vertexes[vertex_number];
-		if (std::abs(existing_vertex.v[0] - vertex_rounded.v[0]) < epsilon &&
-				std::abs(existing_vertex.v[1] - vertex_rounded.v[1]) < epsilon &&
-				std::abs(existing_vertex.v[2] - vertex_rounded.v[2]) < epsilon) {
+		if (std::abs(existing_vertex.v[0] - vertex_rounded.v[0]) < add_vertex_epsilon &&
+				std::abs(existing_vertex.v[1] - vertex_rounded.v[1]) < add_vertex_epsilon &&
+				std::abs(existing_vertex.v[2] - vertex_rounded.v[2]) < add_vertex_epsilon) {
 			return vertex_number;
 		}
 	}
@@ -494,6 +703,82 @@ size_t add_vertex(std::vector<vertex_type> & vertexes, vector3 const vertex) {
 	return vertexes.size() - 1;
 }
 
+// The same as add_vertex, but with hashing, for adding many vertexes.
+// The index must be created with add_vertex_epsilon, and must be used only with the same vertexes vector, as long as it
+// isn't modified other than by appending vertexes, which are added to the index when needed.
+template<typename vertex_type>
+size_t add_vertex(std::vector<vertex_type> & vertexes, vector3 const vertex, vertex_weld_index & index) {
+	vector3 const vertex_rounded = round_vertex_to_add(vertex);
+	while (index.size() < vertexes.size()) {
+		index.push_back(vertexes[index.size()]);
+	}
+	size_t const existing_vertex_number = index.find(vertexes.data(), vertex_rounded);
+	if (existing_vertex_number != SIZE_MAX) {
+		return existing_vertex_number;
+	}
+	vertexes.push_back(vertex_rounded);
+	index.push_back(vertex_rounded);
+	return vertexes.size() - 1;
+}
+
+// Memory for short-lived scratch data, such as the polygons of a face being subdivided, allocated linearly without the
+// overhead of individual heap allocations, and freed all at once when the next item is processed.
+// The memory is reused after a reset, and if it has run out before the reset, it's enlarged to the size that was
+// needed, so after a few items, processing an item usually doesn't allocate from the heap at all.
+class scratch_arena {
+public:
+	explicit scratch_arena(size_t const initial_size = size_t(1) << 14) {
+		allocate_buffer(initial_size);
+	}
+	scratch_arena(scratch_arena const & other) = delete;
+	scratch_arena & operator=(scratch_arena const & other) = delete;
+
+	std::pmr::memory_resource * get_resource() { return &*resource; }
+
+	// Nothing allocated from the arena must be used after the reset.
+	void reset() {
+		if (!overflow.allocated_size) {
+			resource->release();
+			return;
+		}
+		size_t const needed_size = buffer_size + overflow.allocated_size;
+		resource.reset();
+		overflow.allocated_size = 0;
+		allocate_buffer(needed_size);
+	}
+
+private:
+	// Takes the memory from the heap when the buffer runs out, tracking how much more memory has been needed.
+	class overflow_resource : public std::pmr::memory_resource {
+	public:
+		size_t allocated_size = 0;
+
+	private:
+		void * do_allocate(size_t const bytes, size_t const alignment) override {
+			allocated_size += bytes;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+		void do_deallocate(void * const p, size_t const bytes, size_t const alignment) override {
+			std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+		}
+		bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override {
+			return this == &other;
+		}
+	};
+
+	std::unique_ptr<std::byte[]> buffer;
+	size_t buffer_size = 0;
+	overflow_resource overflow;
+	std::optional<std::pmr::monotonic_buffer_resource> resource;
+
+	void allocate_buffer(size_t const size) {
+		buffer.reset();
+		buffer = std::make_unique<std::byte[]>(size);
+		buffer_size = size;
+		resource.emplace(buffer.get(), buffer_size, &overflow);
+	}
+};
+
 struct id_model {
 	vector3 mins;
 	vector3 maxs;
@@ -707,14 +992,18 @@ struct id_texture_deserialized {
 	void pixels_and_palette_from_gbx(
 			struct gbx_texture_deserialized const & gbx,
 			std::optional<std::shared_ptr<id_texture_deserialized_palette>> override_palette,
-			id_texture_deserialized_palette const & quake_palette);
+			id_texture_deserialized_palette const & quake_palette,
+			struct texture_pixels_cache const * pixels_cache = nullptr,
+			struct texture_palette_analysis_cache * palette_analysis_cache = nullptr);
 
 	void pixels_and_palette_from_wads_or_gbx(
 			struct gbx_texture_deserialized const & gbx,
 			struct wad_textures_deserialized const * const * wads,
 			size_t wad_count,
 			bool include_all_textures,
-			palette_set const & quake_palette);
+			palette_set const & quake_palette,
+			struct texture_pixels_cache const * pixels_cache = nullptr,
+			struct texture_palette_analysis_cache * palette_analysis_cache = nullptr);
 
 	void remove_pixels() {
 		pixels.reset();
@@ -798,13 +1087,23 @@ struct gbx_texture_deserialized {
 			void const * base, size_t size_after_base, size_t offset, bool deinterleave_random,
 			palette_set const & quake_palette);
 
-	void pixels_and_palette_from_id(
+	// If the intern table is provided, the pixels and the palette may be shared with other textures.
+	// Returns whether the pixels have been reused from an earlier conversion in the intern table.
+	bool pixels_and_palette_from_id(
 			struct id_texture_deserialized const & id,
-			id_texture_deserialized_palette const & quake_palette);
-
-	void pixels_and_palette_from_wad(
+			id_texture_deserialized_palette const & quake_palette,
+			struct texture_pixels_cache const * pixels_cache = nullptr,
+			struct gbx_texture_intern_table * intern_table = nullptr,
+			struct texture_palette_analysis_cache * palette_analysis_cache = nullptr);
+
+	// Returns whether the pixels have been reused from an earlier conversion of the WAD texture or from the intern
+	// table.
+	bool pixels_and_palette_from_wad(
 			struct wad_texture_deserialized & wad_texture,
-			id_texture_deserialized_palette const & quake_palette);
+			id_texture_deserialized_palette const & quake_palette,
+			struct texture_pixels_cache const * pixels_cache = nullptr,
+			struct gbx_texture_intern_table * intern_table = nullptr,
+			struct texture_palette_analysis_cache * palette_analysis_cache = nullptr);
 
 	void remove_pixels() {
 		pixels.reset();
@@ -914,23 +1213,146 @@ enum gbx_lump_number {
 	// While the order the lumps are stored in doesn't matter, the lumps are stored in the map file in the same order.
 };
 
+// Version and lumps (arrays of offsets, lengths, counts, and then unknown - zeros - for lumps).
+constexpr size_t gbx_map_header_size = sizeof(uint32_t) + sizeof(uint32_t) * gbx_lump_count * 4;
+
 struct id_header_lump {
 	uint32_t offset;
 	uint32_t length;
 };
 static_assert(sizeof(id_header_lump) == 0x8);
 
+// Bytes of a large lump that are either owned, or reference a part of a buffer shared with other objects, such as the
+// loaded map file, to avoid copying.
+// Copies reference the same bytes, which are copied to an owned vector only when they need to be modified.
+class shared_bytes {
+public:
+	shared_bytes() = default;
+
+	uint8_t const * data() const { return owned_ ? owned_->data() : borrowed_data_; }
+	size_t size() const { return owned_ ? owned_->size() : borrowed_size_; }
+	bool empty() const { return !size(); }
+	uint8_t operator[](size_t const index) const { return data()[index]; }
+
+	void clear() {
+		owned_.reset();
+		borrowed_owner_.reset();
+		borrowed_data_ = nullptr;
+		borrowed_size_ = 0;
+	}
+
+	void assign(void const * const data, size_t const size) {
+		clear();
+		if (size) {
+			owned_ = std::make_shared<std::vector<uint8_t>>(
+					reinterpret_cast<uint8_t const *>(data), reinterpret_cast<uint8_t const *>(data) + size);
+		}
+	}
+
+	// The owner keeps the buffer containing the bytes alive while they're referenced.
+	void borrow(std::shared_ptr<void const> owner, void const * const data, size_t const size) {
+		clear();
+		if (size) {
+			borrowed_owner_ = std::move(owner);
+			borrowed_data_ = reinterpret_cast<uint8_t const *>(data);
+			borrowed_size_ = size;
+		}
+	}
+
+	// Whether the bytes reference a buffer not owned by this object or its copies.
+	bool is_borrowed() const { return bool(borrowed_owner_); }
+
+	// Returns the bytes for modification, copying them first unless they're owned only by this object.
+	// The data pointer may be invalidated by the modification.
+	std::vector<uint8_t> & modify() {
+		if (!owned_ || owned_.use_count() > 1) {
+			uint8_t const * const original_data = data();
+			owned_ = std::make_shared<std::vector<uint8_t>>(original_data, original_data + size());
+			borrowed_owner_.reset();
+			borrowed_data_ = nullptr;
+			borrowed_size_ = 0;
+		}
+		return *owned_;
+	}
+
+private:
+	// If not null, the bytes are owned, and the borrowed fields are not used.
+	std::shared_ptr<std::vector<uint8_t>> owned_;
+	std::shared_ptr<void const> borrowed_owner_;
+	uint8_t const * borrowed_data_ = nullptr;
+	size_t borrowed_size_ = 0;
+};
+
+// Destination of a map serialized in parts, in order, without the whole serialized map being kept in memory.
+class serialized_map_sink {
+public:
+	virtual ~serialized_map_sink() = default;
+
+	// Called before the first write with the total size of the serialized map.
+	virtual bool begin(size_t size) = 0;
+	virtual bool write(void const * data, size_t size) = 0;
+	// Called after the last write.
+	virtual bool end() = 0;
+};
+
+// Destination of a map serialized in parts, in order, when the total size is not known in advance, and some of the
+// data, such as the header, can be filled only after writing everything else.
+class seekable_map_sink {
+public:
+	virtual ~seekable_map_sink() = default;
+
+	virtual bool write(void const * data, size_t size) = 0;
+	// Only for replacing the data that has already been written.
+	virtual bool overwrite(size_t offset, void const * data, size_t size) = 0;
+	// Called after the last write.
+	virtual bool end() = 0;
+};
+
+// Writes the map to a seekable stream, such as an std::ofstream opened in the binary mode, which buffers the writes.
+class ostream_map_sink : public seekable_map_sink {
+public:
+	explicit ostream_map_sink(std::ostream & stream) : stream(stream), start(stream.tellp()) {}
+
+	bool write(void const * const data, size_t const size) override {
+		stream.write(reinterpret_cast<char const *>(data), std::streamsize(size));
+		written_size += size;
+		return stream.good();
+	}
+
+	bool overwrite(size_t const offset, void const * const data, size_t const size) override {
+		if (offset > written_size || size > written_size - offset) {
+			return false;
+		}
+		stream.seekp(start + std::streamoff(offset));
+		stream.write(reinterpret_cast<char const *>(data), std::streamsize(size));
+		stream.seekp(start + std::streamoff(written_size));
+		return stream.good();
+	}
+
+	bool end() override {
+		stream.flush();
+		return stream.good();
+	}
+
+	size_t get_written_size() const { return written_size; }
+
+private:
+	std::ostream & stream;
+	std::ostream::pos_type start;
+	size_t written_size = 0;
+};
+
 struct id_map {
 	uint32_t version = id_map_version_valve;
-	std::vector<entity_key_values> entities;
+	entity_store entities;
 	std::vector<id_plane> planes;
 	std::vector<id_texture_deserialized> textures;
 	std::vector<vector3> vertexes;
-	std::vector<uint8_t> visibility;
+	shared_bytes visibility;
 	std::vector<id_node> nodes;
 	std::vector<id_texinfo> texinfo;
 	std::vector<id_face> faces;
-	std::vector<uint8_t> lighting;
+	shared_bytes lighting;
 	std::vector<clipnode> clipnodes;
 	std::vector<id_leaf> leafs;
 	std::vector<id_marksurface> marksurfaces;
@@ -940,15 +1362,20 @@ struct id_map {
 
 	// On success, returns nullptr.
 	// On failure, returns the error description string, and the object is left in an indeterminate state.
+	// If map_owner is not null, the visibility and the lighting will reference the map data kept alive by it instead
+	// of being copied.
 	char const * deserialize(
 			void const * map, size_t map_size, bool quake_as_valve,
-			id_texture_deserialized_palette const & quake_palette);
+			id_texture_deserialized_palette const & quake_palette,
+			std::shared_ptr<void const> const & map_owner = nullptr);
 
 	// During the conversion, lumps that have equivalents in the other format won't be reindexed,
 	// and nothing will be erased from them, so iterating both at once afterwards is possible.
 	void from_gbx_no_texture_pixels(struct gbx_map const & gbx);
 
 	void serialize(std::vector<char> & map, id_texture_deserialized_palette const & quake_palette) const;
+	// Returns false if the sink has failed.
+	bool serialize(seekable_map_sink & sink, id_texture_deserialized_palette const & quake_palette) const;
 
 	// Does not add the Quake palette to the textures to prevent duplication.
 	// Empty palette in id_texture, even for Valve maps, should be treated as the Quake palette being used.
@@ -963,6 +1390,12 @@ struct id_map {
 	// Sorts textures by the file they're loaded from and then by the name for the most efficient loading in the engine.
 	// Similar to the goal of sorting in qcsg.
 	void sort_textures();
+
+private:
+	// Without a sink, the whole map is written to the buffer, otherwise it's used for gathering small writes.
+	bool serialize(
+			std::vector<char> & buffer, seekable_map_sink * sink,
+			id_texture_deserialized_palette const & quake_palette) const;
 };
 
 struct gbx_map {
@@ -977,10 +1410,10 @@ struct gbx_map {
 	std::vector<gbx_model> models;
 	std::vector<gbx_face> faces;
 	std::vector<gbx_marksurface> marksurfaces;
-	std::vector<uint8_t> visibility;
-	std::vector<uint8_t> lighting;
+	shared_bytes visibility;
+	shared_bytes lighting;
 	std::vector<gbx_texture_deserialized> textures;
-	std::vector<entity_key_values> entities;
+	entity_store entities;
 	std::vector<gbx_polygons_deserialized> polygons;
 
 	void set_node_or_leaf_parent(int32_t node_or_leaf_number, uint32_t parent);
@@ -990,21 +1423,36 @@ struct gbx_map {
 	// Relinks all animated textures.
 	void link_texture_anim();
 
-	void make_polygons(gbx_polygons_deserialized * polygons_start, size_t polygons_count);
+	// Each face is subdivided and stripped independently, so with more than one thread, the faces are processed in
+	// parallel, with the same result as on one thread.
+	void make_polygons(gbx_polygons_deserialized * polygons_start, size_t polygons_count, size_t thread_count = 1);
 
 	// On success, returns nullptr.
 	// On failure, returns the error description string, and the object is left in an indeterminate state.
-	char const * deserialize(void const * map, size_t map_size, palette_set const & quake_palette);
+	// If map_owner is not null, the visibility and the lighting will reference the map data kept alive by it instead
+	// of being copied.
+	char const * deserialize(
+			void const * map, size_t map_size, palette_set const & quake_palette,
+			std::shared_ptr<void const> const & map_owner = nullptr);
 
 	char const * deserialize_only_textures(void const * map, size_t map_size, palette_set const & quake_palette);
+	// Returns how much of the beginning of the map file deserialize_only_textures needs if the texture pixels and
+	// palettes are within the textures lump, as they are in the maps created by Gearbox and BS2PC.
+	// The map must contain at least gbx_map_header_size bytes.
+	static size_t get_size_for_only_textures(void const * map);
 
 	// During the conversion, lumps that have equivalents in the other format won't be reindexed,
 	// and nothing will be erased from them, so iterating both at once afterwards is possible.
 	void from_id_no_texture_pixels_and_polygons(struct id_map const & id);
 
 	void serialize(std::vector<char> & map, palette_set const & quake_palette) const;
+	// Returns false if the sink has failed.
+	bool serialize(serialized_map_sink & sink, palette_set const & quake_palette) const;
 
 private:
+	// Without a sink, the whole map is written to the buffer, otherwise it's used for gathering small writes.
+	bool serialize(std::vector<char> & buffer, serialized_map_sink * sink, palette_set const & quake_palette) const;
+
 	char const * deserialize_textures(
 			void const * map, size_t map_size,
 			size_t textures_offset, size_t textures_lump_length, size_t texture_count,
@@ -1055,24 +1503,64 @@ struct wad_texture_deserialized {
 	std::array<std::shared_ptr<gbx_texture_deserialized_palette>, gbx_palette_type_count> palettes_id_indexed_gbx;
 };
 
+// Only the directory of the lumps (and the names of the textures) is read when loading a WAD, and the textures are
+// decoded when they're looked up for the first time, as maps usually use only a small fraction of the textures in large
+// WADs such as halflife.wad.
+// Lookups may be done from multiple threads at once.
 struct wad_textures_deserialized {
-	std::vector<wad_texture_deserialized> textures;
-	// The keys are string_to_lower(name).
+	// Returns nullptr if there's no texture with the name in the WAD that can be loaded.
+	wad_texture_deserialized const * find_texture(std::string const & name_lower) const;
+	wad_texture_deserialized * find_texture(std::string const & name_lower) {
+		return const_cast<wad_texture_deserialized *>(
+				static_cast<wad_textures_deserialized const &>(*this).find_texture(name_lower));
+	}
+
+private:
+	friend char const * get_wad_textures(
+			void const * wad, size_t wad_size, wad_textures_deserialized & wad_textures,
+			id_texture_deserialized_palette const & quake_palette);
+
+	enum class texture_state : uint8_t {
+		not_decoded,
+		decoded,
+		// Failed to decode, or has no pixels.
+		invalid,
+	};
+
+	struct texture_lump {
+		uint32_t file_position;
+		uint32_t size;
+		// Lumps with the same texture name are searched in the order they're stored in the WAD file, and the first
+		// valid one is used.
+		size_t next_same_name_number;
+		texture_state state;
+	};
+
+	char const * wad = nullptr;
+	bool is_wad3 = false;
+	id_texture_deserialized_palette const * quake_palette = nullptr;
+	// Both are only modified by decoding, and never resized after loading, so pointers to the textures stay valid.
+	mutable std::vector<texture_lump> texture_lumps;
+	mutable std::vector<wad_texture_deserialized> textures;
+	// The keys are string_to_lower(name), the values are the numbers of the first lumps with the name.
 	std::unordered_map<std::string, size_t> texture_number_map;
+	std::unique_ptr<std::mutex> decode_mutex = std::make_unique<std::mutex>();
 };
 
-void append_worldspawn_wad_names(entity_key_values const & worldspawn, std::vector<std::string> & names);
+// The worldspawn is the first entity, nothing is done if there are no entities.
+void append_worldspawn_wad_names(entity_store const & entities, std::vector<std::string> & names);
 std::string serialize_worldspawn_wad_paths(std::vector<std::string> const & paths);
-void set_worldspawn_wad_paths(entity_key_values & worldspawn, std::string_view paths_serialized);
-inline void set_worldspawn_wad_paths(entity_key_values & worldspawn, std::vector<std::string> const & paths) {
-	set_worldspawn_wad_paths(worldspawn, serialize_worldspawn_wad_paths(paths));
+void set_worldspawn_wad_paths(entity_store & entities, std::string_view paths_serialized);
+inline void set_worldspawn_wad_paths(entity_store & entities, std::vector<std::string> const & paths) {
+	set_worldspawn_wad_paths(entities, serialize_worldspawn_wad_paths(paths));
 }
 // Adds PC Half-Life WAD files to the WAD names if there's hlps2.wad, and removes gbx1.wad.
 // On the PC, any texture without pixels included means search in all WADs and crash if any WAD is not loaded.
 // Returns if any changes were made.
 bool replace_hlps2_wads(std::vector<std::string> & wad_names);
 
-// Writes textures that have been successfully loaded from the WAD.
+// Reads the directory of the textures in the WAD, which are decoded when they're looked up.
+// The WAD file data and the Quake palette must stay available for the whole lifetime of the resulting object.
 // On success, returns nullptr.
 // On failure to load the WAD file itself, returns the error description string, and the resulting object will be empty.
 // For a Quake WAD (WAD2), the textures will be without a palette.
@@ -1113,10 +1601,112 @@ inline wad_texture_deserialized * find_most_identical_texture_in_wads(
 
 // Resamples the texture if the output size is different than the input size, and generates mips.
 // If only mips need to be generated, the output pointer may be the same as the input one.
+// Resampling is done with a bicubic filter in linear space. The SSE2 and the scalar paths produce the same filtered
+// colors before palette matching, unless the compiler uses fused multiply-add or excess precision (x87) for the scalar
+// one, in which case the colors may differ by floating-point rounding (within 1e-6 in the 0 to 1 range), which may
+// rarely cause a different palette color to be selected.
+// If the pixels cache is provided, the results of resampling and mip generation are loaded from it if they have been
+// stored in it previously, or are stored in it otherwise.
+// If the palette analysis cache is provided, the analysis of the palette is reused between textures with the same
+// palette.
 void convert_texture_pixels(
 		bool is_transparent, id_texture_deserialized_palette const & palette,
 		uint8_t * out_pixels, uint32_t out_width, uint32_t out_height, uint32_t out_mip_levels_without_base,
-		uint8_t const * in_pixels, uint32_t in_width, uint32_t in_height, uint32_t in_mip_levels_without_base);
+		uint8_t const * in_pixels, uint32_t in_width, uint32_t in_height, uint32_t in_mip_levels_without_base,
+		struct texture_pixels_cache const * pixels_cache = nullptr,
+		struct texture_palette_analysis_cache * palette_analysis_cache = nullptr);
+
+// Persistent storage of the results of convert_texture_pixels in a directory, for skipping resampling and mip
+// generation for textures converted in previous runs.
+// The files are named by the SHA-256 digest of all the inputs of the conversion and the version of the conversion
+// algorithms.
+// Can be used from multiple threads and processes at once.
+struct texture_pixels_cache {
+	// Must be incremented whenever convert_texture_pixels is changed in a way that affects the results.
+	static constexpr uint32_t version = 1;
+
+	std::filesystem::path directory;
+
+	explicit texture_pixels_cache(std::filesystem::path const & cache_directory) : directory(cache_directory) {}
+
+	// The key is the digest of all the inputs of the conversion, which is also stored in the file and compared when
+	// loading.
+	// Returns whether the pixels have been loaded.
+	// If they haven't, the contents of the pixels array are left unchanged.
+	bool load(sha256::digest const & key, uint8_t * pixels, size_t pixel_count) const;
+	// Failures to store are ignored, the pixels will just be converted again next time.
+	void store(sha256::digest const & key, uint8_t const * pixels, size_t pixel_count) const;
+
+private:
+	std::filesystem::path get_path(sha256::digest const & key) const;
+};
+
+// Storage of the linear colors and the closest color search orders of the palettes used by convert_texture_pixels, for
+// reusing them between the textures with the same palette, such as all the textures using the Quake palette.
+// Half-Life textures usually have palettes of their own, so only the analyses of the most recently used palettes are
+// kept.
+// Can be used from multiple threads at once.
+struct texture_palette_analysis_cache {
+	static constexpr size_t default_capacity = 64;
+
+	explicit texture_palette_analysis_cache(size_t const capacity = default_capacity) : capacity(capacity) {}
+
+	// Returns the analysis of the palette, from an earlier call with the same palette if possible.
+	std::shared_ptr<struct texture_palette_analysis const> get(id_texture_deserialized_palette const & palette);
+
+	void clear();
+
+private:
+	struct entry {
+		id_texture_deserialized_palette palette;
+		std::shared_ptr<texture_palette_analysis const> analysis;
+	};
+
+	size_t capacity;
+	std::mutex mutex;
+	// The most recently used first.
+	std::list<entry> usage_order;
+	std::map<id_texture_deserialized_palette, std::list<entry>::iterator> entries;
+};
+
+// Storage of the results of converting id textures to Gearbox shared between all the maps converted in one run, so the
+// same texture embedded in multiple maps (or present in multiple WADs) is converted only once, and the converted
+// pixels and palettes are shared between the maps rather than allocated for each of them.
+// The conversions are identified by the SHA-256 digest of everything they depend on, so the inputs themselves don't
+// need to be kept.
+// Can be used from multiple threads at once.
+struct gbx_texture_intern_table {
+	using key = sha256::digest;
+
+	// Returns the pixels converted with convert_texture_pixels, from an earlier conversion with the same inputs if
+	// possible, in which case reused is set to true.
+	std::shared_ptr<texture_deserialized_pixels> get_pixels(
+			bool is_transparent, id_texture_deserialized_palette const & palette,
+			uint32_t out_width, uint32_t out_height, uint32_t out_mip_levels_without_base,
+			uint8_t const * in_pixels, uint32_t in_width, uint32_t in_height, uint32_t in_mip_levels_without_base,
+			struct texture_pixels_cache const * pixels_cache,
+			struct texture_palette_analysis_cache * palette_analysis_cache,
+			bool & reused);
+
+	// Returns the palette converted with gbx_palette_from_id, from an earlier conversion with the same inputs if
+	// possible.
+	std::shared_ptr<gbx_texture_deserialized_palette> get_palette(
+			gbx_palette_type palette_type, id_texture_deserialized_palette const & palette_id);
+
+private:
+	struct key_hasher {
+		size_t operator()(key const & key) const {
+			// The digest is uniformly distributed already.
+			size_t hash;
+			std::memcpy(&hash, key.data(), sizeof(hash));
+			return hash;
+		}
+	};
+
+	std::mutex mutex;
+	std::unordered_map<key, std::shared_ptr<texture_deserialized_pixels>, key_hasher> pixels;
+	std::unordered_map<key, std::shared_ptr<gbx_texture_deserialized_palette>, key_hasher> palettes;
+};
 
 // textures_gbx must contain the original Gearbox textures corresponding to the id map textures (but possibly at
 // different indexes).
@@ -1135,6 +1725,28 @@ void reconstruct_random_texture_sequences(
 // For more visual consistency with the original maps, especially between level changes, so the filtering and the sizes
 // of the textures when converting from id to Gearbox are the same as in the original conversions.
 // The map key is string_to_lower(gbx_texture.name).
+// The original layout consists of wad_info with the 'WADG' identification, the lumps containing gbx_texture headers
+// with the pixels and the palettes, with no alignment, and the lump information table in the order of the names.
+// Version 2 is a superset of the original layout that can be used directly in a mapped file (older versions of BS2PC
+// can still read it as the original layout).
+// It has wadg_indexed_info as the header, the lumps aligned to wadg_indexed_lump_alignment, and the lump information
+// table sorted by the names of the lumps which are string_to_lower(gbx_texture.name), so textures can be located via a
+// binary search.
+
+struct wadg_indexed_info {
+	// The identification is 'WADG'.
+	wad_info info;
+	// 'WGIX'. In the original layout, the first lump directly follows wad_info, and gbx_texture::pixels, which is
+	// always sizeof(gbx_texture) in it, is located here instead.
+	char index_identification[4];
+	// wadg_indexed_version.
+	uint32_t version;
+	uint32_t padding[3];
+};
+static_assert(sizeof(wadg_indexed_info) == 0x20);
+
+constexpr uint32_t wadg_indexed_version = 2;
+constexpr size_t wadg_indexed_lump_alignment = 16;
 
 // On success, returns nullptr.
 // On failure to load the WADG file itself, returns the error description string, and no textures will be added.
@@ -1191,56 +1803,61 @@ char const * add_wadg_textures(
 	return nullptr;
 }
 
+// Writes the indexed layout.
 // The output stream must be in the binary mode.
 void write_wadg(
 		std::ofstream & output_stream,
 		std::map<std::string, gbx_texture_deserialized> & textures,
 		palette_set const & quake_palette);
 
+// For converting maps, a WADG file (of either layout) may be used without deserializing all textures in it.
+// With the indexed layout, only the lump information table is accessed when loading, and the textures are located via
+// a binary search and decoded when they're looked up for the first time, so the WADG must stay in memory while the
+// textures are used. The original layout is fully deserialized when loading, as it has no index.
+// Lookups may be done from multiple threads at once.
+struct wadg_textures_deserialized {
+	// Returns nullptr if there's no texture with the name in the WADG that can be loaded.
+	gbx_texture_deserialized const * find_texture(std::string_view name_lower) const;
+
+private:
+	friend char const * get_wadg_textures(
+			void const * wadg, size_t wadg_size, wadg_textures_deserialized & wadg_textures,
+			palette_set const & quake_palette);
+
+	enum class texture_state : uint8_t {
+		not_decoded,
+		decoded,
+		// Failed to decode.
+		invalid,
+	};
+
+	// Indexed layout.
+	char const * wadg = nullptr;
+	size_t wadg_size = 0;
+	uint32_t lump_count = 0;
+	uint32_t info_table_offset = 0;
+	palette_set const * quake_palette = nullptr;
+	// Both are only modified by decoding, and never resized after loading, so pointers to the textures stay valid.
+	mutable std::vector<texture_state> texture_states;
+	mutable std::vector<gbx_texture_deserialized> textures;
+	std::unique_ptr<std::mutex> decode_mutex = std::make_unique<std::mutex>();
+
+	// Original layout.
+	std::unordered_map<std::string, gbx_texture_deserialized> deserialized_textures;
+};
+
+// On success, returns nullptr.
+// On failure to load the WADG file itself, returns the error description string, and no textures will be available.
+char const * get_wadg_textures(
+		void const * wadg, size_t wadg_size, wadg_textures_deserialized & wadg_textures,
+		palette_set const & quake_palette);
+
 // The resulting texture may have a different name than requested.
-template<typename map_type>
-typename map_type::const_iterator find_identical_wadg_texture(
-		map_type const & wadg_textures,
-		std::string_view const name,
+gbx_texture_deserialized const * find_identical_wadg_texture(
+		wadg_textures_deserialized const & wadg_textures,
+		std::string_view name,
 		id_texture_deserialized const & texture_id,
-		palette_set const & quake_palette) {
-	std::string key = string_to_lower(name);
-	auto const wadg_texture_iterator = wadg_textures.find(key);
-	if (wadg_texture_iterator != wadg_textures.cend() &&
-			bs2pc::is_texture_data_identical(texture_id, wadg_texture_iterator->second, quake_palette) ==
-					bs2pc::texture_identical_status::same_palette_same_or_resampled_pixels) {
-		return wadg_texture_iterator;
-	}
-	// Some animated textures have one specific frame selected on certain maps with the + prefix removed.
-	// Try finding the pixels in the frame with the prefix toggled.
-	// Not doing the same for random-tiled ('-'-prefixed) textures as their palettes have inverted colors (in the
-	// original Valve 24-bit texture, not even in 21 bits directly), can't simply copy the palette between a
-	// `-`-prefixed texture and one without the prefix. Using pixels from a '-'-prefixed texture for one without the
-	// prefix is even worse, as they have incorrect mips in the original Gearbox maps, thus the pixels can't be reused
-	// directly. The PS2 engine doesn't display the '-'-prefixed textures correctly at all though, with the interleaving
-	// and the inversion being visible to the player. Therefore, it's recommended to remove the '-' prefix completely
-	// when converting from Valve maps to Gearbox.
-	if (key.c_str()[0] == '+') {
-		key = key.substr(1);
-		auto const wadg_texture_iterator_without_animation = wadg_textures.find(key);
-		if (wadg_texture_iterator_without_animation != wadg_textures.cend() &&
-				bs2pc::is_texture_data_identical(
-						texture_id, wadg_texture_iterator_without_animation->second, quake_palette) ==
-						bs2pc::texture_identical_status::same_palette_same_or_resampled_pixels) {
-			return wadg_texture_iterator_without_animation;
-		}
-	} else if (key.size() < texture_name_max_length && texture_anim_frame(key.c_str()[0]) != UINT32_MAX) {
-		key = '+' + key;
-		auto const wadg_texture_iterator_with_animation = wadg_textures.find(key);
-		if (wadg_texture_iterator_with_animation != wadg_textures.cend() &&
-				bs2pc::is_texture_data_identical(
-						texture_id, wadg_texture_iterator_with_animation->second, quake_palette) ==
-						bs2pc::texture_identical_status::same_palette_same_or_resampled_pixels) {
-			return wadg_texture_iterator_with_animation;
-		}
-	}
-	return wadg_textures.cend();
-}
+		palette_set const & quake_palette);
 
 // Compression.
 
@@ -1255,9 +1872,83 @@ constexpr uint8_t gbx_map_zlib_flg = 0xDA;
 // Checks whether the map file is compressed with the compression settings used by Gearbox.
 // Does not, however, check if the map is actually a Gearbox map - must decompress and check externally.
 bool is_gbx_map_compressed(void const * map_file, size_t map_file_size);
-bool compress_gbx_map(void const * uncompressed, size_t uncompressed_size, std::vector<char> & compressed);
+// With more than one thread, the map is compressed as multiple blocks in parallel and stitched into one zlib stream.
+// The result is different from single-threaded compression (usually slightly in size), but the same for any number of
+// threads above 1.
+bool compress_gbx_map(
+		void const * uncompressed,
+		size_t uncompressed_size,
+		std::vector<char> & compressed,
+		size_t thread_count = 1);
 bool decompress_gbx_map(void const * compressed, size_t compressed_size, std::vector<char> & uncompressed);
 
+// Incremental compression of a Gearbox map written in parts, such as by gbx_map::serialize, with the same result as
+// compress_gbx_map with the same number of threads, without the whole uncompressed map being kept in memory.
+class gbx_map_compression_stream : public serialized_map_sink {
+public:
+	// `compressed` must stay alive while compressing.
+	explicit gbx_map_compression_stream(std::vector<char> & compressed, size_t thread_count = 1);
+	gbx_map_compression_stream(gbx_map_compression_stream const & other) = delete;
+	gbx_map_compression_stream & operator=(gbx_map_compression_stream const & other) = delete;
+	~gbx_map_compression_stream();
+
+	// Clears `compressed`.
+	bool begin(size_t uncompressed_size) override;
+	bool write(void const * data, size_t size) override;
+	// Fails if the size of the written data is different than the one passed to begin.
+	bool end() override;
+
+private:
+	void reset();
+	bool deflate_to_compressed(int flush);
+	bool deflate_pending_blocks();
+
+	std::vector<char> & compressed;
+	size_t thread_count;
+	std::unique_ptr<z_stream_s> stream;
+	bool stream_initialized = false;
+	bool failed = false;
+	size_t uncompressed_size = 0;
+	size_t written_size = 0;
+	// For single-threaded compression, the size of the data in `compressed`, which is resized in advance.
+	size_t compressed_size = 0;
+	bool parallel = false;
+	// For multithreaded compression of blocks, the data not compressed yet, preceded by the dictionary for the first
+	// block.
+	std::vector<uint8_t> pending;
+	size_t pending_dictionary_size = 0;
+	unsigned long adler = 0;
+};
+
+// Incremental decompression of a Gearbox map into a caller-owned buffer, for stopping as soon as the needed part of the
+// beginning of the map (such as the header and the textures lump) has been decompressed.
+// The checksum of the uncompressed data is verified only if the map is decompressed fully.
+class gbx_map_decompression_stream {
+public:
+	gbx_map_decompression_stream();
+	gbx_map_decompression_stream(gbx_map_decompression_stream const & other) = delete;
+	gbx_map_decompression_stream & operator=(gbx_map_decompression_stream const & other) = delete;
+	~gbx_map_decompression_stream();
+
+	// Starts decompressing the map, clearing `uncompressed`.
+	// Both the compressed map and `uncompressed` must stay alive while decompressing.
+	bool begin(void const * compressed, size_t compressed_size, std::vector<char> & uncompressed);
+	// Decompresses until the size of the uncompressed data is at least `size`, or the whole map is decompressed if it
+	// doesn't contain that much data (SIZE_MAX can be used to decompress the rest of the map).
+	// Resizes the uncompressed data vector, so pointers to its data must be obtained again afterwards.
+	bool decompress(size_t size);
+	bool is_finished() const { return finished; }
+
+private:
+	void end();
+
+	std::unique_ptr<z_stream_s> stream;
+	bool stream_initialized = false;
+	std::vector<char> * uncompressed = nullptr;
+	size_t uncompressed_size = 0;
+	bool finished = false;
+};
+
 }
 
 #endif
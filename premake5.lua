@@ -61,6 +61,7 @@ workspace("bs2pc");
 			"bs2pclib/bs2pc_compress.cpp",
 			"bs2pclib/bs2pc_entities.cpp",
 			"bs2pclib/bs2pc_gbx_map.cpp",
+			"bs2pclib/bs2pc_hash.cpp",
 			"bs2pclib/bs2pc_id_map.cpp",
 			"bs2pclib/bs2pc_parse_token.cpp",
 			"bs2pclib/bs2pc_polygons.cpp",
@@ -93,4 +94,34 @@ workspace("bs2pc");
 			-- For the gmake2 action, which doesn't support transitive linkage.
 			"zlib",
 		});
+		filter("system:not windows");
+			links({
+				-- For std::thread.
+				"pthread",
+			});
+		filter({});
+		strictaliasing("Level3");
+
+	project("bs2pc_bench");
+		characterset("Unicode");
+		cppdialect("C++17");
+		files({
+			"bs2pc_bench.cpp",
+		});
+		flags({
+			"FatalWarnings",
+		});
+		kind("ConsoleApp");
+		language("C++");
+		links({
+			"bs2pclib",
+			-- For the gmake2 action, which doesn't support transitive linkage.
+			"zlib",
+		});
+		filter("system:not windows");
+			links({
+				-- For std::thread.
+				"pthread",
+			});
+		filter({});
 		strictaliasing("Level3");